@@ -0,0 +1,205 @@
+// arena.cpp
+// Contains the memory that stages use for their temporaries.
+
+// Standard header files
+#include <stdint.h>
+#include <stdlib.h>
+#include <utility>
+
+#include "image.h"
+#include "arena.h"
+
+using namespace std;
+
+// ----------------------------------------------------------
+// Frame_Arena
+
+Frame_Arena::Frame_Arena(size_t block_size)
+   : block_size(block_size), current(0), offset(0) {
+}
+
+Frame_Arena::~Frame_Arena() {
+   for (size_t b = 0; b < blocks.size(); b++) {
+      delete [] blocks[b].memory;
+   }
+}
+
+/*-----------------------------------------------------------
+   Frame_Arena::Allocate
+
+   INPUTS
+   size  - Number of bytes wanted
+   align - Alignment of the memory, a power of two
+
+   DESCRIPTION
+   Takes the memory from the current block. When it does not fit, moves
+   on to the next block that is big enough, allocating a new block
+   only when none of the blocks kept from earlier frames will do.
+
+   RETURNS
+   A pointer to the memory
+------------------------------------------------------------*/
+void *Frame_Arena::Allocate(size_t size, size_t align) {
+
+   while (current < blocks.size()) {
+      Block &block = blocks[current];
+      uintptr_t base  = (uintptr_t)block.memory;
+      uintptr_t start = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+
+      if (start + size <= base + block.size) {
+         offset = start + size - base;
+         return (void *)start;
+      }
+
+      current++;
+      offset = 0;
+   }
+
+   Block block;
+
+   block.size   = max(block_size, size + align);
+   block.memory = new char[block.size];
+   blocks.push_back(block);
+   current = blocks.size() - 1;
+   offset  = 0;
+
+   return Allocate(size, align);
+}
+
+Frame_Arena::Marker Frame_Arena::Mark() const {
+   Marker marker;
+
+   marker.block  = current;
+   marker.offset = offset;
+   return marker;
+}
+
+void Frame_Arena::Rewind(const Marker &marker) {
+   current = marker.block;
+   offset  = marker.offset;
+}
+
+void Frame_Arena::Reset() {
+   current = 0;
+   offset  = 0;
+}
+
+size_t Frame_Arena::Used() const {
+   size_t used = offset;
+
+   for (size_t b = 0; b < current && b < blocks.size(); b++) {
+      used += blocks[b].size;
+   }
+   return used;
+}
+
+size_t Frame_Arena::Capacity() const {
+   size_t capacity = 0;
+
+   for (size_t b = 0; b < blocks.size(); b++) {
+      capacity += blocks[b].size;
+   }
+   return capacity;
+}
+
+/*-----------------------------------------------------------
+   Thread_Arena
+
+   INPUTS
+   None
+
+   DESCRIPTION
+   Every thread has an arena of its own for the temporaries of the
+   stages it runs, so threads never contend for it.
+
+   RETURNS
+   The arena of the calling thread
+------------------------------------------------------------*/
+Frame_Arena &Thread_Arena() {
+   static thread_local Frame_Arena arena;
+
+   return arena;
+}
+
+/*-----------------------------------------------------------
+   Arena_Image
+
+   INPUTS
+   arena  - The arena to take the memory from
+   format - An image whose headers and palette are copied
+   image  - The bitmap to fill in
+
+   DESCRIPTION
+   Allocates the row pointers and pixels of a scratch image from the
+   arena. The rows are contiguous, as with Allocate_Image, and the
+   pixels are not initialized. The image goes away when the arena is
+   rewound or reset; it must not be passed to Remove_Image.
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Arena_Image(Frame_Arena &arena, const bmpBITMAP_FILE &format, bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(format.info_header.biHeight);
+   int width  = Assemble_Integer(format.info_header.biWidth);
+   byte_t *pixels;
+
+   image.file_header = format.file_header;
+   image.info_header = format.info_header;
+   image.palette     = format.palette;
+
+   pixels = arena.Allocate_Array<byte_t>((size_t)height * width);
+   image.image_ptr = arena.Allocate_Array<byte_t *>(height > 0 ? height : 1);
+   image.image_ptr[0] = pixels;
+
+   for (int i = 0; i < height; i++) {
+      image.image_ptr[i] = pixels + (size_t)i * width;
+   }
+}
+
+// ----------------------------------------------------------
+// Image_Pool
+
+Image_Pool::Image_Pool(size_t max_images) : max_images(max_images) {
+}
+
+Image Image_Pool::Acquire(const bmpBITMAP_FILE &format) {
+   int height = Assemble_Integer(format.info_header.biHeight);
+   int width  = Assemble_Integer(format.info_header.biWidth);
+
+   {
+      lock_guard<mutex> guard(lock);
+
+      for (size_t i = 0; i < images.size(); i++) {
+         if (images[i].Width() == width && images[i].Height() == height) {
+            Image image = std::move(images[i]);
+
+            images.erase(images.begin() + i);
+            image.Bitmap().file_header = format.file_header;
+            image.Bitmap().info_header = format.info_header;
+            image.Bitmap().palette     = format.palette;
+            return image;
+         }
+      }
+   }
+
+   return Image::Same_Format(format);
+}
+
+void Image_Pool::Release(Image image) {
+
+   if (image.Empty())
+      return;
+
+   lock_guard<mutex> guard(lock);
+
+   if (images.size() < max_images) {
+      images.push_back(std::move(image));
+   }
+}
+
+size_t Image_Pool::Size() {
+   lock_guard<mutex> guard(lock);
+
+   return images.size();
+}
@@ -0,0 +1,122 @@
+// arena.h
+// Declarations for the memory that stages use for their temporaries.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+#include "image.h"
+
+/*-----------------------------------------------------------
+   Frame_Arena
+
+   DESCRIPTION
+   A bump allocator for the temporaries of one frame. Allocate() hands
+   out memory from large blocks, nothing is freed individually, and
+   Reset() makes all of it available again in constant time. The blocks
+   are kept between frames, so once the arena has grown to the needs of
+   a frame no further calls to the system allocator are made.
+
+   An arena is not thread safe. Each thread uses its own, see
+   Thread_Arena().
+------------------------------------------------------------*/
+class Frame_Arena {
+public:
+   // Where the arena is up to. Rewind() returns to a marker.
+   struct Marker {
+      size_t block;
+      size_t offset;
+   };
+
+   explicit Frame_Arena(size_t block_size = 4 << 20);
+   ~Frame_Arena();
+
+   Frame_Arena(const Frame_Arena &) = delete;
+   Frame_Arena &operator=(const Frame_Arena &) = delete;
+
+   // Uninitialized memory, aligned to align bytes (a power of two)
+   void *Allocate(size_t size, size_t align = 16);
+
+   template <class T>
+   T *Allocate_Array(size_t count) {
+      return static_cast<T *>(Allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+   }
+
+   Marker Mark() const;
+   void Rewind(const Marker &marker);
+   void Reset();
+
+   // Bytes handed out since the last Reset() and bytes held in blocks
+   size_t Used() const;
+   size_t Capacity() const;
+
+private:
+   struct Block {
+      char *memory;
+      size_t size;
+   };
+
+   std::vector<Block> blocks;
+   size_t block_size;
+   size_t current;
+   size_t offset;
+};
+
+/*-----------------------------------------------------------
+   Arena_Scope
+
+   DESCRIPTION
+   Rewinds an arena to where it was when the scope was entered, so
+   that a stage's temporaries are released as soon as it returns.
+------------------------------------------------------------*/
+class Arena_Scope {
+public:
+   explicit Arena_Scope(Frame_Arena &arena) : arena(arena), marker(arena.Mark()) {}
+   ~Arena_Scope() { arena.Rewind(marker); }
+
+   Arena_Scope(const Arena_Scope &) = delete;
+   Arena_Scope &operator=(const Arena_Scope &) = delete;
+
+private:
+   Frame_Arena &arena;
+   Frame_Arena::Marker marker;
+};
+
+/*-----------------------------------------------------------
+   Image_Pool
+
+   DESCRIPTION
+   Keeps images that are no longer needed so a later frame of the same
+   size can reuse their pixels instead of allocating new ones. A pool
+   may be shared between threads.
+------------------------------------------------------------*/
+class Image_Pool {
+public:
+   explicit Image_Pool(size_t max_images = 8);
+
+   // An image with the headers and palette of format. The pixels are
+   // undefined.
+   Image Acquire(const bmpBITMAP_FILE &format);
+
+   // Gives an image back to the pool. It is freed if the pool is full.
+   void Release(Image image);
+
+   size_t Size();
+
+private:
+   std::mutex lock;
+   std::vector<Image> images;
+   size_t max_images;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+Frame_Arena &Thread_Arena();
+void Arena_Image(Frame_Arena &arena, const bmpBITMAP_FILE &format, bmpBITMAP_FILE &image);
+// ----------------------------------------------------------
+
+#endif
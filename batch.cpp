@@ -0,0 +1,153 @@
+// batch.cpp
+// Contains the code that runs the box finding program over a list of
+// bitmaps, reading the next file and writing the last result while the
+// current frame is processed.
+
+// Standard header files
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string.h>
+#include <thread>
+#include <utility>
+
+#include "image.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "batch.h"
+
+using namespace std;
+
+// A frame on its way from the loader, or to the writer, and the job it
+// belongs to
+struct Batch_Frame {
+   size_t job;
+   Image image;
+};
+
+// The loader thread. Reads the image file of each job, in order, into an
+// image from the pool. A file that cannot be read is reported and its job
+// skipped; stopping the program here would pull the stages out from under
+// the calling thread.
+static void Load_Frames(const vector<Batch_Job> &jobs, Image_Pool &pool,
+                        Bounded_Queue<Batch_Frame> &loaded) {
+
+   for (size_t k = 0; k < jobs.size(); k++) {
+      const char *in_file_name = jobs[k].in_file_name.c_str();
+      ifstream in_file(in_file_name, ios::in | ios::binary);
+      Batch_Frame frame;
+      string error;
+
+      if (!in_file) {
+         cerr << "Error: cannot open " << in_file_name << ", skipped\n";
+         continue;
+      }
+
+      Bitmap_Decoder decoder(in_file, in_file_name, error);
+
+      if (error.empty()) {
+         frame.job   = k;
+         frame.image = pool.Acquire(decoder.Format());
+
+         if (!decoder.Read_Rows(in_file, frame.image, error))
+            pool.Release(std::move(frame.image));
+      }
+
+      if (!error.empty()) {
+         cerr << "Error: " << in_file_name << ": " << error << ", skipped\n";
+         continue;
+      }
+
+      loaded.Put(std::move(frame));
+   }
+
+   loaded.Close();
+}
+
+// The writer thread. Saves each result and gives its image back to the
+// pool for the loader. A result whose file cannot be made is reported and
+// dropped, as the loader does.
+static void Save_Frames(const vector<Batch_Job> &jobs, Image_Pool &pool,
+                        Bounded_Queue<Batch_Frame> &results) {
+   Batch_Frame frame;
+
+   while (results.Take(frame)) {
+      const char *out_file_name = jobs[frame.job].out_file_name.c_str();
+      ofstream out_file(out_file_name, ios::out | ios::binary);
+
+      if (out_file)
+         Write_Image(out_file, frame.image, File_Type(out_file_name));
+      else
+         cerr << "Error: cannot open " << out_file_name << ", skipped\n";
+
+      pool.Release(std::move(frame.image));
+   }
+}
+
+/*------------------------------------------------------------
+   Run_Batch
+
+   INPUTS
+   jobs         - The bitmaps to process and where to save the results
+   process      - Runs the stages on frames.Front() and leaves the
+                  result there
+   queue_frames - Frames read ahead, and results waiting to be saved
+
+   DESCRIPTION
+   Processes the jobs in order on the calling thread. A loader thread
+   reads up to queue_frames bitmaps ahead, and a writer thread saves
+   the results behind, so reading and writing the files overlaps the
+   stages instead of holding them up. When the stages are faster than
+   the disk, the calling thread waits for the loader, and when they are
+   slower, the loader waits for room in its queue, so no more than
+   2 * queue_frames + 1 frames are ever held.
+
+   The frames come from an Image_Pool and go back to it once saved, so
+   after the first few jobs nothing is allocated. The stages run on a
+   pair of Frame_Buffers, as they do in main, and may use the shared
+   thread pool.
+
+   A job whose file cannot be read, or whose result cannot be saved, is
+   reported on cerr and skipped, and the others go on.
+
+   RETURNS
+   Nothing, once every result has been saved
+-------------------------------------------------------------*/
+void Run_Batch(const vector<Batch_Job> &jobs, const function<void(Frame_Buffers &)> &process,
+               int queue_frames) {
+
+   queue_frames = max(queue_frames, 1);
+
+   Image_Pool pool(2 * queue_frames + 2);
+   Bounded_Queue<Batch_Frame> loaded(queue_frames);
+   Bounded_Queue<Batch_Frame> results(queue_frames);
+
+   thread loader(Load_Frames, cref(jobs), ref(pool), ref(loaded));
+   thread writer(Save_Frames, cref(jobs), ref(pool), ref(results));
+
+   Frame_Buffers frames(&pool);
+   Batch_Frame frame;
+
+   while (loaded.Take(frame)) {
+      frames.Load(frame.image);
+      pool.Release(std::move(frame.image));
+
+      process(frames);
+
+      bmpBITMAP_FILE &result = frames.Front();
+      int height = Assemble_Integer(result.info_header.biHeight);
+      int width  = Assemble_Integer(result.info_header.biWidth);
+
+      frame.image = pool.Acquire(result);
+      for (int i = 0; i < height; i++) {
+         memcpy(frame.image[i], result.image_ptr[i], width);
+      }
+
+      results.Put(std::move(frame));
+   }
+
+   results.Close();
+
+   loader.join();
+   writer.join();
+}
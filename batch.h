@@ -0,0 +1,104 @@
+// batch.h
+// Declarations for running the box finding program over a list of
+// bitmaps, with the files read and written in the background.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "pipeline.h"
+
+// Frames Run_Batch reads ahead of the one being processed, and results
+// it lets wait for the writer
+const int BATCH_QUEUE_FRAMES = 2;
+
+/*-----------------------------------------------------------
+   Bounded_Queue
+
+   DESCRIPTION
+   A first in, first out queue between threads that holds at most
+   capacity items. Put() waits while the queue is full and Take() waits
+   while it is empty, so a thread that gets ahead of the other is held
+   back rather than filling memory.
+
+   Close() is called by the producer after the last item. Take() then
+   returns false once the queue is empty.
+------------------------------------------------------------*/
+template <class T>
+class Bounded_Queue {
+public:
+   explicit Bounded_Queue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {
+   }
+
+   Bounded_Queue(const Bounded_Queue &) = delete;
+   Bounded_Queue &operator=(const Bounded_Queue &) = delete;
+
+   void Put(T item) {
+      {
+         std::unique_lock<std::mutex> guard(lock);
+
+         while (items.size() >= capacity) {
+            not_full.wait(guard);
+         }
+         items.push_back(std::move(item));
+      }
+      not_empty.notify_one();
+   }
+
+   bool Take(T &item) {
+      {
+         std::unique_lock<std::mutex> guard(lock);
+
+         while (!closed && items.empty()) {
+            not_empty.wait(guard);
+         }
+         if (items.empty())
+            return false;
+
+         item = std::move(items.front());
+         items.pop_front();
+      }
+      not_full.notify_one();
+      return true;
+   }
+
+   void Close() {
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         closed = true;
+      }
+      not_empty.notify_all();
+   }
+
+private:
+   std::mutex lock;
+   std::condition_variable not_empty;
+   std::condition_variable not_full;
+   std::deque<T> items;
+   size_t capacity;
+   bool closed;
+};
+
+// A bitmap to read and the file its result is written to
+struct Batch_Job {
+   std::string in_file_name;
+   std::string out_file_name;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Run_Batch(const std::vector<Batch_Job> &jobs,
+               const std::function<void(Frame_Buffers &)> &process,
+               int queue_frames = BATCH_QUEUE_FRAMES);
+// ----------------------------------------------------------
+
+#endif
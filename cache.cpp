@@ -0,0 +1,334 @@
+// cache.cpp
+// Contains the cache of results, and the hash of the pixels of a frame
+// that results are found by.
+
+// Standard header files
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "server.h"
+#include "cache.h"
+
+using namespace std;
+
+// The multipliers of the hash, odd constants with well mixed bits
+const uint64_t HASH_PRIME_1 = 0x9e3779b97f4a7c15ULL;
+const uint64_t HASH_PRIME_2 = 0xc2b2ae3d27d4eb4fULL;
+
+// Folds the 8 bytes in value into the hash
+static inline uint64_t Hash_Word(uint64_t hash, uint64_t value) {
+
+   hash ^= value * HASH_PRIME_1;
+   hash = (hash << 31) | (hash >> 33);
+   return hash * HASH_PRIME_2;
+}
+
+// Spreads every bit of the hash over all of it
+static inline uint64_t Hash_Finish(uint64_t hash) {
+
+   hash ^= hash >> 33;
+   hash *= HASH_PRIME_2;
+   hash ^= hash >> 29;
+   hash *= HASH_PRIME_1;
+   return hash ^ (hash >> 32);
+}
+
+/*------------------------------------------------------------
+   Frame_Hash
+
+   INPUTS
+   image - The frame to hash
+
+   DESCRIPTION
+   A 64 bit hash of the pixels and the size of the frame, to know a
+   frame that has been seen before. It is not meant to stand up to
+   frames made to collide.
+
+   The rows are read 8 bytes at a time into four hashes at once, so the
+   multiplies of one do not wait for another, and the four are folded
+   together at the end. A 1024 x 768 frame takes a fraction of a
+   millisecond, far less than the stages.
+
+   RETURNS
+   The hash
+-------------------------------------------------------------*/
+uint64_t Frame_Hash(bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   uint64_t lanes[4] = {1, 2, 3, 4};
+
+   for (int i = 0; i < height; i++) {
+      const byte_t *row = image.image_ptr[i];
+      uint64_t words[4];
+      int j = 0;
+
+      for (; j + 32 <= width; j += 32) {
+         memcpy(words, row + j, 32);
+         lanes[0] = Hash_Word(lanes[0], words[0]);
+         lanes[1] = Hash_Word(lanes[1], words[1]);
+         lanes[2] = Hash_Word(lanes[2], words[2]);
+         lanes[3] = Hash_Word(lanes[3], words[3]);
+      }
+
+      // The end of the row, padded with zeros
+      if (j < width) {
+         memset(words, 0, 32);
+         memcpy(words, row + j, width - j);
+         for (int w = 0; w < 4; w++) {
+            lanes[w] = Hash_Word(lanes[w], words[w]);
+         }
+      }
+   }
+
+   uint64_t hash = Hash_Word((uint64_t)width << 32 | (uint32_t)height, HASH_PRIME_1);
+
+   for (int w = 0; w < 4; w++) {
+      hash = Hash_Word(hash, lanes[w]);
+   }
+
+   return Hash_Finish(hash);
+}
+
+// The key of frame with the parameters of request
+Result_Key Make_Result_Key(bmpBITMAP_FILE &frame, const Detection_Request &request) {
+
+   Result_Key key;
+
+   key.frame_hash    = Frame_Hash(frame);
+   key.width         = Assemble_Integer(frame.info_header.biWidth);
+   key.height        = Assemble_Integer(frame.info_header.biHeight);
+   key.parameters[0] = request.average_size;
+   key.parameters[1] = request.contrast_level;
+   key.parameters[2] = request.op_size;
+   key.parameters[3] = request.edge_threshold;
+   key.parameters[4] = request.min_pixels;
+   key.parameters[5] = request.min_span;
+   key.parameters[6] = request.line_threshold;
+
+   return key;
+}
+
+bool Result_Key::operator==(const Result_Key &other) const {
+   return frame_hash == other.frame_hash && width == other.width && height == other.height &&
+          equal(parameters, parameters + 7, other.parameters);
+}
+
+size_t Result_Key_Hash::operator()(const Result_Key &key) const {
+
+   uint64_t hash = key.frame_hash;
+
+   for (int p = 0; p < 7; p++) {
+      hash = Hash_Word(hash, (uint64_t)(uint32_t)key.parameters[p]);
+   }
+
+   return (size_t)hash;
+}
+
+// Writes key and result as a line of an index file
+static void Write_Entry(ostream &out, const Result_Key &key, const Detection_Result &result) {
+
+   out << hex << key.frame_hash << dec << " " << key.width << " " << key.height;
+   for (int p = 0; p < 7; p++) {
+      out << " " << key.parameters[p];
+   }
+   out << " " << result.boxes.size() << " " << result.lines.size();
+
+   for (size_t b = 0; b < result.boxes.size(); b++) {
+      const Component &box = result.boxes[b];
+
+      out << " " << box.top << " " << box.left << " " << box.bottom << " " << box.right << " "
+          << box.pixels;
+   }
+
+   for (size_t l = 0; l < result.lines.size(); l++) {
+      const hough_line_t &line = result.lines[l];
+
+      out << " " << line.first.first << " " << line.first.second << " " << line.second.first
+          << " " << line.second.second;
+   }
+
+   out << "\n";
+}
+
+// Reads a line of an index file written by Write_Entry. Returns false if
+// the line is not whole, as the last one may not be if the program
+// stopped while writing it, or is not a line Write_Entry could have
+// written. A frame has no more boxes or lines than pixels, and each
+// number takes at least two characters, so the counts are checked
+// against both before anything is allocated.
+static bool Read_Entry(const string &line, Result_Key &key, Detection_Result &result) {
+
+   istringstream in(line);
+   size_t boxes, lines;
+
+   in >> hex >> key.frame_hash >> dec >> key.width >> key.height;
+   for (int p = 0; p < 7; p++) {
+      in >> key.parameters[p];
+   }
+   in >> boxes >> lines;
+
+   if (!in || key.width <= 0 || key.height <= 0)
+      return false;
+
+   size_t pixels = (size_t)key.width * key.height;
+
+   if (boxes > pixels || lines > pixels || boxes > line.size() / 10 || lines > line.size() / 8)
+      return false;
+
+   result.boxes.resize(boxes);
+   result.lines.resize(lines);
+
+   for (size_t b = 0; b < boxes; b++) {
+      Component &box = result.boxes[b];
+
+      in >> box.top >> box.left >> box.bottom >> box.right >> box.pixels;
+   }
+
+   for (size_t l = 0; l < lines; l++) {
+      hough_line_t &line = result.lines[l];
+
+      in >> line.first.first >> line.first.second >> line.second.first >> line.second.second;
+   }
+
+   if (!in)
+      return false;
+
+   // Nothing may follow
+   in >> ws;
+   return in.eof();
+}
+
+Result_Cache::Result_Cache(size_t capacity, const char *index_file_name)
+   : capacity(max(capacity, (size_t)1)), hits(0), index_lines(0) {
+
+   if (index_file_name == 0)
+      return;
+
+   this->index_file_name = index_file_name;
+
+   ifstream in_file(index_file_name);
+   string line;
+
+   while (getline(in_file, line)) {
+      Result_Key key;
+      Detection_Result result;
+
+      if (Read_Entry(line, key, result))
+         Remember(key, result);
+   }
+
+   in_file.close();
+
+   if (!Rewrite_Index()) {
+      cerr << "Error: cannot write the result cache " << index_file_name << "\n";
+      exit(111);
+   }
+}
+
+bool Result_Cache::Find(const Result_Key &key, Detection_Result &result) {
+
+   lock_guard<mutex> guard(lock);
+   Entry_Index::iterator found = index.find(key);
+
+   if (found == index.end())
+      return false;
+
+   entries.splice(entries.begin(), entries, found->second);
+   result = found->second->second;
+   hits++;
+   return true;
+}
+
+void Result_Cache::Insert(const Result_Key &key, const Detection_Result &result) {
+
+   lock_guard<mutex> guard(lock);
+
+   Remember(key, result);
+
+   if (index_file.is_open()) {
+      Write_Entry(index_file, key, result);
+      index_file.flush();
+
+      bool written = (bool)index_file;
+
+      if (written && ++index_lines >= 2 * capacity)
+         written = Rewrite_Index();
+
+      // A server must not stop for its cache, so it goes on without the
+      // file
+      if (!written) {
+         cerr << "Error: cannot write the result cache " << index_file_name
+              << ", the results are kept in memory only\n";
+         index_file.close();
+      }
+   }
+}
+
+size_t Result_Cache::Size() {
+
+   lock_guard<mutex> guard(lock);
+
+   return entries.size();
+}
+
+size_t Result_Cache::Hits() {
+
+   lock_guard<mutex> guard(lock);
+
+   return hits;
+}
+
+// Writes the results kept to a new index file, the least recently used
+// first so reading it back gives the same order, and puts it in place of
+// the old one, which is then added to. Returns false, with the index file
+// closed, if it cannot be written. The lock is held by the caller, or the
+// cache is being made.
+bool Result_Cache::Rewrite_Index() {
+
+   string new_file_name = index_file_name + ".new";
+   ofstream new_file(new_file_name.c_str(), ios::out | ios::trunc);
+
+   for (Entry_List::reverse_iterator entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+      Write_Entry(new_file, entry->first, entry->second);
+   }
+   new_file.close();
+   index_file.close();
+
+   if (!new_file || rename(new_file_name.c_str(), index_file_name.c_str()) != 0) {
+      remove(new_file_name.c_str());
+      return false;
+   }
+
+   index_file.clear();
+   index_file.open(index_file_name.c_str(), ios::out | ios::app);
+   index_lines = entries.size();
+
+   return index_file.is_open();
+}
+
+// Puts the result at the front, dropping the oldest if the cache is
+// full. The lock is held by the caller.
+void Result_Cache::Remember(const Result_Key &key, const Detection_Result &result) {
+
+   Entry_Index::iterator found = index.find(key);
+
+   if (found != index.end()) {
+      found->second->second = result;
+      entries.splice(entries.begin(), entries, found->second);
+      return;
+   }
+
+   if (entries.size() >= capacity) {
+      index.erase(entries.back().first);
+      entries.pop_back();
+   }
+
+   entries.push_front(make_pair(key, result));
+   index[key] = entries.begin();
+}
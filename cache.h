@@ -0,0 +1,104 @@
+// cache.h
+// Declarations for remembering what was found in a frame, so a frame
+// that is sent again is answered without running the stages.
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "image.h"
+#include "server.h"
+
+// Results a cache holds when it is made with no capacity
+const int RESULT_CACHE_ENTRIES = 256;
+
+// A frame and the parameters of the stages that ran on it. The frame is
+// known by Frame_Hash() of its pixels and its size.
+struct Result_Key {
+   uint64_t frame_hash;
+   int width;
+   int height;
+   int parameters[7];
+
+   bool operator==(const Result_Key &other) const;
+};
+
+struct Result_Key_Hash {
+   size_t operator()(const Result_Key &key) const;
+};
+
+/*-----------------------------------------------------------
+   Result_Cache
+
+   DESCRIPTION
+   The results of the last capacity frames, most recently used first.
+   Find() moves the result it finds to the front and Insert() drops the
+   one at the back when the cache is full. Both may be called from any
+   thread.
+
+   Given the name of an index file, the results in it are read back
+   when the cache is made, and each new result is added to the end of
+   it, so a cache survives the program. The file holds a line of text
+   per result,
+
+      <hash> <width> <height> <parameters> <boxes> <lines>
+      followed by top left bottom right pixels for each box
+      and x1 y1 x2 y2 for each line
+
+   and is read from the top, so the results at the end of it are the
+   ones kept when there are more than capacity. Lines that cannot be
+   read are skipped. The file is written again with only the results
+   kept, least recently used first, once it has been read and whenever
+   it grows to twice capacity lines, so it never holds more than that.
+   The program stops if the file cannot be written when the cache is
+   made. If it cannot be written later, the results are kept in memory
+   only from then on.
+
+   Hits() counts the results Find() has found.
+------------------------------------------------------------*/
+class Result_Cache {
+public:
+   explicit Result_Cache(size_t capacity = RESULT_CACHE_ENTRIES, const char *index_file_name = 0);
+
+   Result_Cache(const Result_Cache &) = delete;
+   Result_Cache &operator=(const Result_Cache &) = delete;
+
+   // Copies the result for key, if there is one, to result
+   bool Find(const Result_Key &key, Detection_Result &result);
+   void Insert(const Result_Key &key, const Detection_Result &result);
+
+   size_t Size();
+   size_t Hits();
+
+private:
+   typedef std::list<std::pair<Result_Key, Detection_Result>> Entry_List;
+   typedef std::unordered_map<Result_Key, Entry_List::iterator, Result_Key_Hash> Entry_Index;
+
+   void Remember(const Result_Key &key, const Detection_Result &result);
+   bool Rewrite_Index();
+
+   std::mutex lock;
+   Entry_List entries;
+   Entry_Index index;
+   size_t capacity;
+   size_t hits;
+   std::string index_file_name;
+   std::ofstream index_file;
+   size_t index_lines;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+uint64_t Frame_Hash(bmpBITMAP_FILE &image);
+Result_Key Make_Result_Key(bmpBITMAP_FILE &frame, const Detection_Request &request);
+// ----------------------------------------------------------
+
+#endif
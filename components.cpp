@@ -0,0 +1,384 @@
+// components.cpp
+// Contains the connected component labelling of edge maps and the stages
+// built on it.
+
+// Standard header files
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+#include "runs.h"
+#include "components.h"
+
+using namespace std;
+
+// Root of a label in the union-find forest, halving the path on the way
+static int Find_Root(int *parent, int label) {
+
+   while (parent[label] != label) {
+      parent[label] = parent[parent[label]];
+      label = parent[label];
+   }
+   return label;
+}
+
+// Joins the sets of two labels, keeping the smaller label as the root.
+// Returns the root.
+static int Union(int *parent, int a, int b) {
+
+   a = Find_Root(parent, a);
+   b = Find_Root(parent, b);
+
+   if (a < b) {
+      parent[b] = a;
+      return a;
+   }
+   parent[a] = b;
+   return b;
+}
+
+/*------------------------------------------------------------
+   Label_Components
+
+   INPUTS
+   image      - Pointer to an edge map, edge elements are BLACK
+   labels     - Array of width * height ints, row by row, that receives
+                the label of every pixel
+   components - Receives one entry per component
+
+   DESCRIPTION
+   Labels the groups of BLACK pixels that touch, including diagonally,
+   in two passes. The first pass gives each pixel the label of the
+   neighbours above it and to its left, joining their labels in a
+   union-find forest where they differ. The second replaces every label
+   with its root, numbered in the order the components are first met,
+   and gathers the pixel count and bounding box of each.
+
+   Background pixels get label 0; component k gets label k + 1.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Label_Components(bmpBITMAP_FILE &image, int *labels, vector<Component> &components) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   size_t pixels = (size_t)height * width;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   // Provisional labels start at 1; there can be no more than pixels
+   int *parent = arena.Allocate_Array<int>(pixels + 1);
+   int *number = arena.Allocate_Array<int>(pixels + 1);
+   int next = 1;
+
+   components.clear();
+
+   for (int i = 0; i < height; i++) {
+      byte_t *row = image.image_ptr[i];
+      int *out  = labels + (size_t)i * width;
+      int *above = i > 0 ? out - width : 0;
+
+      for (int j = 0; j < width; j++) {
+         int label = 0;
+
+         if (row[j] != BLACK) {
+            out[j] = 0;
+            continue;
+         }
+
+         // The neighbours that have already been labelled
+         if (j > 0 && out[j - 1])
+            label = out[j - 1];
+
+         if (above) {
+            for (int b = max(j - 1, 0); b <= min(j + 1, width - 1); b++) {
+               if (!above[b])
+                  continue;
+               label = label ? Union(parent, label, above[b]) : above[b];
+            }
+         }
+
+         if (!label) {
+            label = next++;
+            parent[label] = label;
+         }
+         out[j] = label;
+      }
+   }
+
+   // Number the roots in the order they are met
+   for (int label = 1; label < next; label++) {
+      int root = Find_Root(parent, label);
+
+      if (root == label) {
+         Component component;
+
+         number[label] = components.size() + 1;
+         component.pixels = 0;
+         component.top    = height;
+         component.left   = width;
+         component.bottom = -1;
+         component.right  = -1;
+         components.push_back(component);
+      }
+      else
+         number[label] = number[root];
+   }
+
+   for (int i = 0; i < height; i++) {
+      int *out = labels + (size_t)i * width;
+
+      for (int j = 0; j < width; j++) {
+         if (!out[j])
+            continue;
+
+         out[j] = number[out[j]];
+
+         Component &component = components[out[j] - 1];
+         component.pixels++;
+         component.top    = min(component.top, i);
+         component.bottom = max(component.bottom, i);
+         component.left   = min(component.left, j);
+         component.right  = max(component.right, j);
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Find_Components
+
+   INPUTS
+   image      - Pointer to an edge map, edge elements are BLACK
+   components - Receives one entry per component
+
+   DESCRIPTION
+   Same as Label_Components, when the labels themselves are not needed.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Find_Components(bmpBITMAP_FILE &image, vector<Component> &components) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *labels = arena.Allocate_Array<int>((size_t)height * width);
+
+   Label_Components(image, labels, components);
+}
+
+/*------------------------------------------------------------
+   Magic_eraser
+
+   INPUTS
+   image      - Pointer to an edge map, edge elements are BLACK
+   min_pixels - Components with at least this many pixels are kept
+   min_span   - Components whose bounding box is at least this wide or
+                tall are kept
+
+   DESCRIPTION
+   Erases the small specks left by edge detection and thinning. Each
+   group of touching edge elements that is too small on both counts is
+   set to WHITE, so a long thin line survives even when it has few
+   pixels. The cost is linear in the number of pixels.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Magic_eraser(bmpBITMAP_FILE &image, int min_pixels, int min_span) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<Component> components;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *labels = arena.Allocate_Array<int>((size_t)height * width);
+
+   Label_Components(image, labels, components);
+
+   // erase[k] is set for label k that is to go; label 0 is background
+   byte_t *erase = arena.Allocate_Array<byte_t>(components.size() + 1);
+
+   erase[0] = 0;
+   for (size_t c = 0; c < components.size(); c++) {
+      Component &component = components[c];
+
+      erase[c + 1] = component.pixels < min_pixels &&
+                     max(component.Width(), component.Height()) < min_span;
+   }
+
+   for (int i = 0; i < height; i++) {
+      byte_t *row = image.image_ptr[i];
+      int *in = labels + (size_t)i * width;
+
+      for (int j = 0; j < width; j++) {
+         if (erase[in[j]])
+            row[j] = WHITE;
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Label_Run_Components
+
+   INPUTS
+   runs       - Runs of edge elements
+   run_labels - Array of runs.Size() ints that receives the label of
+                every run
+   components - Receives one entry per component
+
+   DESCRIPTION
+   Same as Label_Components, but works on whole runs, so the cost
+   depends on the number of runs rather than the size of the image.
+   Two runs in neighbouring rows touch when they overlap once each is
+   widened by a pixel on both sides. The components and their numbering
+   are the same as those of Label_Components on the decoded image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Label_Run_Components(const Edge_Runs &runs, int *run_labels, vector<Component> &components) {
+
+   size_t count = runs.Size();
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *parent = arena.Allocate_Array<int>(count);
+
+   components.clear();
+
+   for (size_t r = 0; r < count; r++) {
+      parent[r] = r;
+   }
+
+   // Join every run with the runs it touches in the row above. The runs
+   // of both rows are in order, so one pass over each is enough.
+   for (int i = 1; i < runs.Height(); i++) {
+      size_t above     = runs.Row_Begin(i - 1);
+      size_t above_end = runs.Row_End(i - 1);
+
+      for (size_t r = runs.Row_Begin(i); r < runs.Row_End(i); r++) {
+         const Edge_Run &run = runs.Run(r);
+
+         while (above < above_end && runs.Run(above).end < run.start) {
+            above++;
+         }
+
+         for (size_t a = above; a < above_end && runs.Run(a).start <= run.end; a++) {
+            Union(parent, r, a);
+         }
+      }
+   }
+
+   // Number the roots in the order they are met
+   for (size_t r = 0; r < count; r++) {
+      int root = Find_Root(parent, r);
+
+      if (root == (int)r) {
+         Component component;
+
+         run_labels[r] = components.size() + 1;
+         component.pixels = 0;
+         component.top    = runs.Height();
+         component.left   = runs.Width();
+         component.bottom = -1;
+         component.right  = -1;
+         components.push_back(component);
+      }
+      else
+         run_labels[r] = run_labels[root];
+   }
+
+   for (int i = 0; i < runs.Height(); i++) {
+      for (size_t r = runs.Row_Begin(i); r < runs.Row_End(i); r++) {
+         const Edge_Run &run = runs.Run(r);
+         Component &component = components[run_labels[r] - 1];
+
+         component.pixels += run.end - run.start;
+         component.top    = min(component.top, i);
+         component.bottom = max(component.bottom, i);
+         component.left   = min(component.left, run.start);
+         component.right  = max(component.right, run.end - 1);
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Find_Components
+
+   INPUTS
+   runs       - Runs of edge elements
+   components - Receives one entry per component
+
+   DESCRIPTION
+   Same as Label_Run_Components, when the labels themselves are not
+   needed.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Find_Components(const Edge_Runs &runs, vector<Component> &components) {
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *run_labels = arena.Allocate_Array<int>(runs.Size());
+
+   Label_Run_Components(runs, run_labels, components);
+}
+
+/*------------------------------------------------------------
+   Magic_eraser
+
+   INPUTS
+   runs       - Runs of edge elements
+   min_pixels - Components with at least this many pixels are kept
+   min_span   - Components whose bounding box is at least this wide or
+                tall are kept
+
+   DESCRIPTION
+   Same as above, but removes the runs of the small components.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Magic_eraser(Edge_Runs &runs, int min_pixels, int min_span) {
+
+   vector<Component> components;
+   Edge_Runs kept;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *run_labels = arena.Allocate_Array<int>(runs.Size());
+
+   Label_Run_Components(runs, run_labels, components);
+
+   kept.Reset(runs.Width(), runs.Height());
+
+   for (int i = 0; i < runs.Height(); i++) {
+      for (size_t r = runs.Row_Begin(i); r < runs.Row_End(i); r++) {
+         Component &component = components[run_labels[r] - 1];
+
+         if (component.pixels < min_pixels &&
+             max(component.Width(), component.Height()) < min_span)
+            continue;
+
+         kept.Add(i, runs.Run(r).start, runs.Run(r).end);
+      }
+   }
+
+   kept.Finish();
+   swap(runs, kept);
+}
@@ -0,0 +1,43 @@
+// components.h
+// Declarations for finding the connected groups of edge elements in an
+// edge map, and for the stages built on them.
+
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <vector>
+
+#include "image.h"
+#include "runs.h"
+
+/*-----------------------------------------------------------
+   Component
+
+   DESCRIPTION
+   A group of BLACK pixels that touch, including diagonally. The
+   bounding box is inclusive.
+------------------------------------------------------------*/
+struct Component {
+   long pixels;
+   int top;
+   int left;
+   int bottom;
+   int right;
+
+   int Width() const { return right - left + 1; }
+   int Height() const { return bottom - top + 1; }
+   long Area() const { return (long)Width() * Height(); }
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Label_Components(bmpBITMAP_FILE &image, int *labels, std::vector<Component> &components);
+void Find_Components(bmpBITMAP_FILE &image, std::vector<Component> &components);
+void Magic_eraser(bmpBITMAP_FILE &image, int min_pixels, int min_span);
+void Label_Run_Components(const Edge_Runs &runs, int *run_labels, std::vector<Component> &components);
+void Find_Components(const Edge_Runs &runs, std::vector<Component> &components);
+void Magic_eraser(Edge_Runs &runs, int min_pixels, int min_span);
+// ----------------------------------------------------------
+
+#endif
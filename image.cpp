@@ -1,79 +1,21 @@
 // image.cpp
 // Contains the code that handles bitmap images.
 
-typedef unsigned char byte_t;
+// Standard header files
+#include <algorithm>
+#include <climits>
+#include <ctype.h>
+#include <iomanip>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
 
-struct bmpFILEHEADER {
-   byte_t bfType[2]; // Bitmap identifier, Must be "BM"
-   byte_t bfSize[4];
-   byte_t bfReserved[4];
+#include "image.h"
 
-   // Specifies the location (in bytes) in the file of the image data.
-   // Should be equal to sizeof(bmpFileHeader) + sizeof(bmpInfoHeader) + sizeof(Palette)
-   byte_t bfOffbits[4];
-};
-
-struct bmpINFOHEADER {
-
-   // Size of the bmpInfoHeader
-   byte_t biSize[4];
-
-   // Width of bitmap, in pixels.
-   // Change this if size of image is changed.
-   byte_t biWidth[4];
-
-   // Height of bitmap, in pixels.
-   // Change this if size of image is changed.
-   byte_t biHeight[4];
-
-   byte_t biPlanes[2];
-   byte_t biBitCount[2];
-   byte_t biCompression[4]; // Should be 0 for uncomressed bitmaps
-   byte_t biSizeImage[4]; // The size of the padded image, in bytes
-   byte_t biXPelsPerMeter[4];
-   byte_t biYPelsPermeter[4];
-   byte_t biClrUsed[4];
-   byte_t biClrImportant[4];
-};
-
-struct bmpPALLETTE {
-
-   // This will need to be improved if the program is to scale.
-   // Unless we change the palette, this will do.
-   byte_t palPalette[1024];
-};
-
-// Note: This structure may not be written to file all at once.
-//       The two headers may be written normally, but the image
-//       requires a write for each line followed by a possilbe
-//       1-3 padding bytes.
-struct bmpBITMAP_FILE {
-   bmpFILEHEADER file_header;
-   bmpINFOHEADER info_header;
-   bmpPALLETTE   palette;
-
-   // This implementation will not generalize. Fixed at 256 shades of grey.
-
-   // This points to the image. Allows the allocation of a two
-   // dimensional array dynamically.
-   byte_t **image_ptr;
-};
-
-// ----------------------------------------------------------
-// Function Declarations
-
-void open_input_file(ifstream &in_file);
-int Assemble_Integer(unsigned char bytes[]);
-void Display_FileHeader(bmpFILEHEADER &file_header);
-void Display_InfoHeader(bmpINFOHEADER &info_header);
-int Calc_Padding(int pixel_width);
-void Load_Bitmap_File(bmpBITMAP_FILE &image);
-void Display_Bitmap_File(bmpBITMAP_FILE &image);
-void Copy_Image(bmpBITMAP_FILE &image_orig, bmpBITMAP_FILE &image_copy);
-void Remove_Image(bmpBITMAP_FILE &image);
-void Save_Bitmap_File(bmpBITMAP_FILE &image);
-void Open_Output_File(ofstream &out_file);
-// ----------------------------------------------------------
+using namespace std;
 
 
 /* ----------------------------------------------------------
@@ -94,6 +36,24 @@ void open_input_file (ifstream &in_file) {
    cout << "Enter the name of the file " << endl << "which contains the bitmap: ";
    cin >> in_file_name;
 
+   open_input_file(in_file, in_file_name);
+}
+
+/* ----------------------------------------------------------
+   open_input_file
+
+   INPUTS
+   in_file      - Input stream that points to the file.
+   in_file_name - Name of the file to open
+
+   DESCRIPTION
+   Opens the named file for input without prompting the user
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void open_input_file (ifstream &in_file, const char *in_file_name) {
+
    in_file.open(in_file_name, ios::in | ios::binary);
    if (!in_file) {
       cerr << "Error opening file \a\a\n", exit(101);
@@ -114,16 +74,85 @@ void open_input_file (ifstream &in_file) {
    RETURNS
    A signed integer
 -------------------------------------------------------------*/
-int Assemble_Integer(unsigned char bytes[]) {
+int Assemble_Integer(const unsigned char bytes[]) {
+
+   unsigned int an_integer;
+
+   // Assembled unsigned, as the top byte of a negative value such as
+   // the height of a top down bitmap would overflow an int
+   an_integer  = unsigned(bytes[0]);
+   an_integer += (unsigned(bytes[1]) << 8);
+   an_integer += (unsigned(bytes[2]) << 16);
+   an_integer += (unsigned(bytes[3]) << 24);
+
+   return int(an_integer);
+}
+
+/*-----------------------------------------------------------
+   Disassemble_Integer
+
+   INPUTS
+   value - The integer to store
+   bytes - A pointer to an array of unsigned characters (should be 4 bytes)
+
+   DESCRIPTION
+   The reverse of Assemble_Integer. Stores value in bytes, least
+   significant byte first.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Disassemble_Integer(int value, unsigned char bytes[]) {
+
+   bytes[0] = value & 0xFF;
+   bytes[1] = (value >> 8) & 0xFF;
+   bytes[2] = (value >> 16) & 0xFF;
+   bytes[3] = (value >> 24) & 0xFF;
+}
+
+/*-----------------------------------------------------------
+   Init_Bitmap_Header
 
-   int an_integer;
+   INPUTS
+   image  - Pointer to the bitmap whose headers are filled in
+   width  - Width of the bitmap, in pixels
+   height - Height of the bitmap, in pixels
 
-   an_integer  = int(bytes[0]);
-   an_integer += (int(bytes[1]) * 256);
-   an_integer += (int(bytes[2]) * 256 * 256);
-   an_integer += (int(bytes[3]) * 256 * 256 * 256);
+   DESCRIPTION
+   Fills in the file header, info header and palette of an 8-bit
+   greyscale bitmap of the given size, laid out the same way as the
+   bitmaps in images/. The pixels are not allocated.
 
-   return an_integer;
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Init_Bitmap_Header(bmpBITMAP_FILE &image, int width, int height) {
+
+   int offset = sizeof(bmpFILEHEADER) + sizeof(bmpINFOHEADER) + sizeof(bmpPALLETTE);
+   int size_image = (width + Calc_Padding(width)) * height;
+
+   memset(&image.file_header, 0, sizeof(bmpFILEHEADER));
+   memset(&image.info_header, 0, sizeof(bmpINFOHEADER));
+
+   image.file_header.bfType[0] = 'B';
+   image.file_header.bfType[1] = 'M';
+   Disassemble_Integer(offset + size_image, image.file_header.bfSize);
+   Disassemble_Integer(offset, image.file_header.bfOffbits);
+
+   Disassemble_Integer(sizeof(bmpINFOHEADER), image.info_header.biSize);
+   Disassemble_Integer(width, image.info_header.biWidth);
+   Disassemble_Integer(height, image.info_header.biHeight);
+   image.info_header.biPlanes[0]   = 1;
+   image.info_header.biBitCount[0] = 8;
+   Disassemble_Integer(size_image, image.info_header.biSizeImage);
+
+   // 256 shades of grey, stored as blue, green, red, reserved
+   for (int i = 0; i < 256; i++) {
+      image.palette.palPalette[4*i]     = i;
+      image.palette.palPalette[4*i + 1] = i;
+      image.palette.palPalette[4*i + 2] = i;
+      image.palette.palPalette[4*i + 3] = 0;
+   }
 }
 
 /*-----------------------------------------------------------
@@ -227,216 +256,1376 @@ int Calc_Padding(int pixel_width){
    image - A pointer to a bitmap image.
 
    DESCRIPTION
-   Will fill the structure pointed to with info about the .bmp file
+   Will fill the structure pointed to with info about the .bmp file.
+   The name of the file is requested from the user.
 
    RETURNS
    Nothing
 -------------------------------------------------------------*/
 void Load_Bitmap_File(bmpBITMAP_FILE &image) {
 
-   ifstream fs_data;
+   char in_file_name[80];
 
-   int bitmap_width;
-   int bitmap_height;
-   int padding;
+   cout << "Enter the name of the file " << endl << "which contains the bitmap: ";
+   cin >> in_file_name;
+
+   Load_Bitmap_File(image, in_file_name);
+}
 
-   long int cursor1;
+/*------------------------------------------------------------
+   Load_Bitmap_File
 
-   open_input_file(fs_data);
-   fs_data.read((char*) &image.file_header, sizeof(bmpFILEHEADER));
-   fs_data.read((char*) &image.info_header, sizeof(bmpINFOHEADER));
-   fs_data.read((char*) &image.palette, sizeof(bmpPALLETTE));
+   INPUTS
+   image     - A pointer to a bitmap image.
+   file_name - Name of the .bmp file to load
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
-   padding       = Calc_Padding(bitmap_width);
+   DESCRIPTION
+   Same as above, but loads the named file without prompting. A .pgm or
+   .raw file is loaded instead of a bitmap when the name ends that way.
 
-   // Allocate a 2 dimensional array
-   image.image_ptr = new byte_t*[bitmap_height];
-   for (int i = 0; i < bitmap_height; i++) {
-      image.image_ptr[i] = new byte_t[bitmap_width];
-   }
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Load_Bitmap_File(bmpBITMAP_FILE &image, const char *file_name) {
 
-   cursor1 = Assemble_Integer(image.file_header.bfOffbits);
-   fs_data.seekg(cursor1); // Moves cursor to beginning of the image data
+   ifstream fs_data;
 
-   // Load the bytes into the new aray one line at a time
-   for (int i = 0; i < bitmap_height; i++) {
-      fs_data.read((char*) image.image_ptr[i], bitmap_width);
-   }
+   open_input_file(fs_data, file_name);
+
+   Bitmap_Decoder decoder(fs_data, file_name);
 
+   image.file_header = decoder.Format().file_header;
+   image.info_header = decoder.Format().info_header;
+   image.palette     = decoder.Format().palette;
+
+   // Allocate a 2 dimensional array
+   Allocate_Image(image);
+
+   decoder.Read_Rows(fs_data, image);
    fs_data.close();
 }
 
 /*------------------------------------------------------------
-   Display_Bitmap_File
+   Read_Bitmap_File
 
    INPUTS
-   image - Pointer to a bitmap image
+   fs_data - An open input stream positioned at the start of a .bmp
+   image   - A pointer to a bitmap image.
 
    DESCRIPTION
-   Displays a bitmap image
+   Reads the headers, palette and image data from the stream and
+   allocates the image. Files that are not 8 bit grey are converted as
+   they are read, see Bitmap_Decoder.
 
    RETURNS
    Nothing
 -------------------------------------------------------------*/
-void Display_Bitmap_File(bmpBITMAP_FILE &image) {
+void Read_Bitmap_File(istream &fs_data, bmpBITMAP_FILE &image) {
 
-   int bitmap_width;
-   int bitmap_height;
+   Bitmap_Decoder decoder(fs_data);
 
-   Display_FileHeader(image.file_header);
-   Display_InfoHeader(image.info_header);
+   image.file_header = decoder.Format().file_header;
+   image.info_header = decoder.Format().info_header;
+   image.palette     = decoder.Format().palette;
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   // Allocate a 2 dimensional array
+   Allocate_Image(image);
 
-   for (int i = 0; i < bitmap_height; i++) {
-      for (int j = 0; j < bitmap_width; j++) {
-         cout << setw(4) << int(image.image_ptr[i][j]);
-      }
+   decoder.Read_Rows(fs_data, image);
+}
+
+// ----------------------------------------------------------
+// Bitmap_Decoder
+
+// 32 bit pixels that give their layout as masks must be laid out as
+// blue, green, red, alpha, which is what these masks say
+static const int BGRA_MASKS[3] = {0x00FF0000, 0x0000FF00, 0x000000FF};
+
+// The level of grey of a colour. The weights are those of Rec. 601
+// scaled to add to 256, so a grey colour keeps its level.
+static inline byte_t Luminance(unsigned blue, unsigned green, unsigned red) {
+   return (29 * blue + 150 * green + 77 * red + 128) >> 8;
+}
+
+// Stops the program with code if error is set, which it is by the
+// readers of the headers below when code is not 0
+static void Stop_On_Error(int code, const string &error) {
+
+   if (code != 0) {
+      cerr << "Error: " << error << "\n";
+      exit(code);
    }
 }
 
-/*-----------------------------------------------------------
-   Copy_Image
+Bitmap_Decoder::Bitmap_Decoder(istream &in, const char *file_name) {
 
-   INPUTS
-   image_copy - Pointer to the destination image
-   image_orig - Pointer to the original image
+   string error;
 
-   DESCRIPTION
-   Copies imag_orig to image_copy
+   Stop_On_Error(Open(in, file_name, error), error);
+}
 
-   RETURNS
-   Nothing
-------------------------------------------------------------*/
-void Copy_Image(bmpBITMAP_FILE &image_orig,
-                bmpBITMAP_FILE &image_copy) {
+Bitmap_Decoder::Bitmap_Decoder(istream &in, const char *file_name, string &error) {
 
-   int height;
-   int width;
+   error.clear();
+   Open(in, file_name, error);
+}
 
-   image_copy.file_header = image_orig.file_header;
-   image_copy.info_header = image_orig.info_header;
-   image_copy.palette    = image_orig.palette;
+Bitmap_Decoder::Bitmap_Decoder(istream &in, Image_File_Type type, int raw_width, int raw_height) {
 
-   height = Assemble_Integer(image_copy.info_header.biHeight);
-   width  = Assemble_Integer(image_copy.info_header.biWidth);
+   string error;
+
+   Stop_On_Error(Read_Headers(in, type, raw_width, raw_height, error), error);
+}
 
-   image_copy.image_ptr = new byte_t*[height];
+// The readers of the headers return 0, or the code the program stops
+// with, with error set, if the file cannot be read
+int Bitmap_Decoder::Open(istream &in, const char *file_name, string &error) {
 
-   for (int i = 0; i < height; i++) {
-      image_copy.image_ptr[i] = new byte_t[width];
+   Image_File_Type type = file_name ? File_Type(file_name) : FILE_BMP;
+   int raw_width = 0;
+   int raw_height = 0;
+
+   if (type == FILE_RAW && !Raw_File_Size(file_name, raw_width, raw_height)) {
+      error = "the name of a raw file must give its size, as in name.1024x768.raw";
+      return 106;
    }
 
-   // Load the bytes into the new array one byte at a time
-   for (int i = 0; i < height; i++) {
-      for (int j = 0; j < width; j++) {
-         image_copy.image_ptr[i][j] = image_orig.image_ptr[i][j];
-      }
+   return Read_Headers(in, type, raw_width, raw_height, error);
+}
+
+int Bitmap_Decoder::Read_Headers(istream &in, Image_File_Type type, int raw_width, int raw_height,
+                                 string &error) {
+
+   format.image_ptr = 0;
+
+   switch (type) {
+      case FILE_PGM:
+         return Read_PGM_Header(in, error);
+
+      case FILE_RAW:
+         if (raw_width <= 0 || raw_height <= 0) {
+            error = "the size of a raw image must be given";
+            return 106;
+         }
+         width  = raw_width;
+         height = raw_height;
+         data   = in.tellg();
+         Grey_Layout(255);
+         return 0;
+
+      default:
+         return Read_BMP_Headers(in, error);
    }
 }
 
-/*-----------------------------------------------------------
-   Remove_Image
+int Bitmap_Decoder::Read_BMP_Headers(istream &in, string &error) {
 
-   INPUTS
-   image - Pointer to an image,
-           image.byte_t contains pointers to a 2-dim array
+   int header_size;
+   int stored_height;
+   int compression;
+   bool grey = false;
 
-   DESCRIPTION
-   Memory that **byte_t points to in the image is freed, and
-   image.bfType[] is set to "XX".
+   in.read((char *) &format.file_header, sizeof(bmpFILEHEADER));
+   in.read((char *) &format.info_header, sizeof(bmpINFOHEADER));
 
-   RETURNS
-   Nothing
------------------------------------------------------------*/
-void Remove_Image(bmpBITMAP_FILE &image) {
+   if (!in || format.file_header.bfType[0] != 'B' || format.file_header.bfType[1] != 'M') {
+      error = "the file does not hold a bitmap";
+      return 105;
+   }
 
-   int height;
-   int width;
+   header_size   = Assemble_Integer(format.info_header.biSize);
+   width         = Assemble_Integer(format.info_header.biWidth);
+   stored_height = Assemble_Integer(format.info_header.biHeight);
+   bits          = int(format.info_header.biBitCount[0]) + int(format.info_header.biBitCount[1]) * 256;
+   compression   = Assemble_Integer(format.info_header.biCompression);
+   data          = Assemble_Integer(format.file_header.bfOffbits);
 
-   height = Assemble_Integer(image.info_header.biHeight);
-   width  = Assemble_Integer(image.info_header.biWidth);
+   height   = abs(stored_height);
+   top_down = stored_height < 0;
 
-   // Delete the dynamic memory
-   for (int i = 0; i < height; i++) {
-      delete [] image.image_ptr[i];
+   if (header_size < (int)sizeof(bmpINFOHEADER) || width <= 0 ||
+       (bits != 1 && bits != 4 && bits != 8 && bits != 24 && bits != 32)) {
+      error = "bitmaps of " + to_string(bits) + " bits per pixel cannot be read";
+      return 106;
    }
 
-   delete [] image.image_ptr;
+   // The masks follow a 40 byte info header, and are the first thing
+   // after it in the larger ones
+   if (compression == 3 && bits == 32) {
+      byte_t masks[12];
 
-   image.file_header.bfType[0] = 'X';  // just to mark it as
-   image.file_header.bfType[1] = 'X';  // unused.
+      in.read((char *) masks, sizeof(masks));
 
-   // Also, we may wish to initialize all the header
-   // info to zero.
-}
+      if (!in || Assemble_Integer(masks) != BGRA_MASKS[0] ||
+          Assemble_Integer(masks + 4) != BGRA_MASKS[1] || Assemble_Integer(masks + 8) != BGRA_MASKS[2]) {
+         error = "only 32 bit bitmaps laid out as BGRA can be read";
+         return 106;
+      }
+   }
+   else if (compression != 0 && !(compression == 1 && bits == 8)) {
+      error = "only RLE8 compressed bitmaps can be read";
+      return 106;
+   }
 
-//================= Save_Bitmap_File =======================
-//
-void Save_Bitmap_File(bmpBITMAP_FILE &image) {
+   // The palette holds biClrUsed colours, or all of them when that is 0
+   if (bits <= 8) {
+      byte_t palette[1024];
+      int colours = Assemble_Integer(format.info_header.biClrUsed);
 
-   ofstream fs_data;
+      if (colours <= 0 || colours > (1 << bits))
+         colours = 1 << bits;
 
-   int width;
-   int height;
-   int padding;
-   long int cursor1;
+      in.seekg(sizeof(bmpFILEHEADER) + header_size);
+      in.read((char *) palette, 4 * colours);
 
-   height = Assemble_Integer(image.info_header.biHeight);
-   width  = Assemble_Integer(image.info_header.biWidth);
+      if (!in) {
+         error = "the palette of the bitmap is missing";
+         return 105;
+      }
 
-   Open_Output_File(fs_data);
+      // Pixels past the end of the palette are taken as black
+      grey = colours == 256;
+      for (int c = 0; c < 256; c++) {
+         byte_t *colour = palette + 4 * c;
 
-   fs_data.write ((char *) &image.file_header, sizeof(bmpFILEHEADER));
+         grey_of[c] = c < colours ? Luminance(colour[0], colour[1], colour[2]) : 0;
 
-   if (!fs_data.good()) {
-      cout << "\aError 101 writing bitmapfile_header";
-      cout << " to file.\n";
-      exit (101);
+         if (c < colours && (colour[0] != c || colour[1] != c || colour[2] != c))
+            grey = false;
+      }
+
+      if (grey && bits == 8)
+         memcpy(format.palette.palPalette, palette, sizeof(palette));
    }
 
-   fs_data.write ((char *) &image.info_header, sizeof(bmpINFOHEADER));
+   row_bytes  = ((long)width * bits + 7) / 8;
+   row_stride = ((long)width * bits + 31) / 32 * 4;
+   compressed = compression == 1;
+   verbatim   = grey && bits == 8 && !compressed;
 
-   if (!fs_data.good()) {
-      cout << "\aError 102 writing bitmap";
-      cout << " info_header to file.\n";
-      exit (102);
+   // Only the bitmaps the program writes itself keep their headers
+   if (!verbatim || top_down || header_size != (int)sizeof(bmpINFOHEADER) ||
+       data != (long)(sizeof(bmpFILEHEADER) + sizeof(bmpINFOHEADER) + sizeof(bmpPALLETTE))) {
+      Init_Bitmap_Header(format, width, height);
    }
 
-   fs_data.write ((char *) &image.palette, sizeof(bmpPALLETTE));
+   return 0;
+}
 
-   if (!fs_data.good()) {
-      cout << "\aError 103 writing bitmap palette to";
-      cout << "file.\n";
-      exit (103);
-   }
+// The next number in the header of a PGM file, or -1 if there is none.
+// White space and comments before it are skipped, and the one white
+// space character after it is read.
+static int PGM_Number(istream &in) {
 
-   // This loop writes the image data
-   for (int i = 0; i < height; i++) {
-      for (int j=0; j<width; j++) {
-         fs_data.write((char *) &image.image_ptr[i][j], sizeof(byte_t));
+   int c = in.get();
+   int value = 0;
 
-         if (!fs_data.good()) {
-            cout << "\aError 104 writing bitmap data";
-            cout << "to file.\n";
-            exit (104);
+   while (isspace(c) || c == '#') {
+      if (c == '#') {
+         while (c != '\n' && c != EOF) {
+            c = in.get();
          }
       }
+      c = in.get();
    }
 
-   fs_data.close();
+   if (!isdigit(c))
+      return -1;
+
+   while (isdigit(c) && value < (1 << 24)) {
+      value = value * 10 + (c - '0');
+      c = in.get();
+   }
+
+   return isspace(c) ? value : -1;
 }
 
-//=================== Open_Output_File =====================
-//
-void Open_Output_File(ofstream &out_file) {
-   char out_file_name[80];
+int Bitmap_Decoder::Read_PGM_Header(istream &in, string &error) {
 
-   cout << "Save file as: ";
-   cin >> out_file_name;
+   char magic[2];
+   int max_value;
+
+   in.read(magic, sizeof(magic));
+
+   if (!in || magic[0] != 'P' || magic[1] != '5') {
+      error = "the file is not a binary PGM";
+      return 105;
+   }
+
+   width     = PGM_Number(in);
+   height    = PGM_Number(in);
+   max_value = PGM_Number(in);
+
+   if (width <= 0 || height <= 0 || max_value <= 0 || max_value > 255) {
+      error = "only PGM files of 8 bits per pixel can be read";
+      return 106;
+   }
+
+   data = in.tellg();
+   Grey_Layout(max_value);
+   return 0;
+}
+
+// The rows of a PGM or raw file: 8 bits per pixel, the top row first and
+// no padding. Levels up to max_value are stretched to 0 .. 255.
+void Bitmap_Decoder::Grey_Layout(int max_value) {
+
+   bits       = 8;
+   row_bytes  = width;
+   row_stride = width;
+   top_down   = true;
+   compressed = false;
+   verbatim   = max_value == 255;
+
+   for (int v = 0; v < 256; v++) {
+      grey_of[v] = v < max_value ? (v * 255 + max_value / 2) / max_value : 255;
+   }
+
+   Init_Bitmap_Header(format, width, height);
+}
+
+void Bitmap_Decoder::Convert_Row(const byte_t *stored, byte_t *grey) const {
+
+   // A local count, as grey could otherwise alias width
+   int count = width;
+
+   switch (bits) {
+      case 1:
+         for (int j = 0; j < count; j++) {
+            grey[j] = grey_of[(stored[j >> 3] >> (7 - (j & 7))) & 1];
+         }
+         break;
+
+      case 4:
+         for (int j = 0; j < count; j++) {
+            grey[j] = grey_of[(stored[j >> 1] >> ((j & 1) ? 0 : 4)) & 15];
+         }
+         break;
+
+      case 8:
+         if (verbatim) {
+            memcpy(grey, stored, count);
+            break;
+         }
+         for (int j = 0; j < count; j++) {
+            grey[j] = grey_of[stored[j]];
+         }
+         break;
+
+      // The colour loops have no table lookups, so the compiler
+      // vectorizes them. The 24 bit one needs byte shuffles (SSSE3 on
+      // x86) for its loads three bytes apart.
+      case 24:
+         for (int j = 0; j < count; j++) {
+            grey[j] = Luminance(stored[3*j], stored[3*j + 1], stored[3*j + 2]);
+         }
+         break;
+
+      case 32:
+         for (int j = 0; j < count; j++) {
+            grey[j] = Luminance(stored[4*j], stored[4*j + 1], stored[4*j + 2]);
+         }
+         break;
+   }
+}
+
+/*------------------------------------------------------------
+   Bitmap_Decoder::Decode_RLE_Row
+
+   INPUTS
+   in       - The stream, at the next row of an RLE8 file
+   grey     - Row of Width() pixels to decode into
+   position - Where the file is up to, carried from row to row
+
+   DESCRIPTION
+   Each pair of bytes is either a count and a pixel to repeat, or a 0
+   followed by an escape: 0 ends the row, 1 ends the picture, 2 moves
+   right and down by the next two bytes, and 3 or more is a count of
+   pixels given one by one, padded to an even number of bytes. Pixels
+   the file moves past, or never reaches, are colour 0 of the palette.
+
+   RETURNS
+   Nothing. in fails if the data stops before the end of the row.
+-------------------------------------------------------------*/
+void Bitmap_Decoder::Decode_RLE_Row(istream &in, byte_t *grey, RLE_Position &position) const {
+
+   streambuf *data = in.rdbuf();
+   int column;
+
+   memset(grey, grey_of[0], width);
+
+   // A move down, or the end of the picture, leaves rows untouched
+   if (position.skip_rows > 0 && --position.skip_rows > 0)
+      return;
+
+   column = position.column;
+   position.column = 0;
+
+   while (true) {
+      int count = data->sbumpc();
+      int value = data->sbumpc();
+
+      if (value == EOF) {
+         in.setstate(ios::failbit);
+         return;
+      }
+
+      if (count > 0) {
+         int end = min(column + count, width);
+
+         if (column < end)
+            memset(grey + column, grey_of[value], end - column);
+         column += count;
+      }
+      else if (value == 0) {
+         return;
+      }
+      else if (value == 1) {
+         position.skip_rows = INT_MAX;
+         return;
+      }
+      else if (value == 2) {
+         int right = data->sbumpc();
+         int down  = data->sbumpc();
+
+         if (down == EOF) {
+            in.setstate(ios::failbit);
+            return;
+         }
+
+         column += right;
+
+         if (down > 0) {
+            position.skip_rows = down;
+            position.column    = column;
+            return;
+         }
+      }
+      else {
+         for (int k = 0; k < value; k++) {
+            int pixel = data->sbumpc();
+
+            if (pixel == EOF) {
+               in.setstate(ios::failbit);
+               return;
+            }
+            if (column < width)
+               grey[column] = grey_of[pixel];
+            column++;
+         }
+
+         if (value & 1)
+            data->sbumpc();
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Bitmap_Decoder::Read_Rows
+
+   INPUTS
+   in    - The stream the headers were read from
+   image - An image with the size of Format()
+
+   DESCRIPTION
+   Reads the rows of the file into image, the bottom row first as
+   Load_Bitmap_File always has, whichever way the file is stored. Grey
+   rows with no padding are read straight into the image in one go,
+   and turned over in place if the file is stored top down. Other rows
+   are read one at a time and converted while they are still in the
+   cache, rather than in a separate pass over the whole image.
+
+   The program stops if the rows are cut short. The version with error
+   sets it and returns false instead.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Bitmap_Decoder::Read_Rows(istream &in, bmpBITMAP_FILE &image) const {
+
+   string error;
+
+   if (!Read_Rows(in, image, error)) {
+      cerr << "Error: " << error << "\n";
+      exit(107);
+   }
+}
+
+bool Bitmap_Decoder::Read_Rows(istream &in, bmpBITMAP_FILE &image, string &error) const {
+
+   in.clear();
+   in.seekg(data); // Moves cursor to beginning of the image data
+
+   if (compressed) {
+      RLE_Position position = {0, 0};
+
+      for (int i = 0; i < height && in; i++) {
+         Decode_RLE_Row(in, image.image_ptr[top_down ? height - 1 - i : i], position);
+      }
+   }
+   else if (verbatim && row_stride == width) {
+      in.read((char *) image.image_ptr[0], (streamsize)height * width);
+
+      for (int i = 0; top_down && i < height / 2; i++) {
+         swap_ranges(image.image_ptr[i], image.image_ptr[i] + width, image.image_ptr[height - 1 - i]);
+      }
+   }
+   else {
+      vector<byte_t> stored(verbatim ? 0 : row_bytes);
+
+      for (int i = 0; i < height && in; i++) {
+         byte_t *row = image.image_ptr[top_down ? height - 1 - i : i];
+
+         // The padding is skipped before each row rather than after it,
+         // so the last row need not be padded
+         if (i > 0)
+            in.ignore(row_stride - row_bytes);
+
+         if (verbatim) {
+            in.read((char *) row, width);
+         }
+         else {
+            in.read((char *) stored.data(), row_bytes);
+            Convert_Row(stored.data(), row);
+         }
+      }
+   }
+
+   if (!in) {
+      error = "the rows of the bitmap are cut short";
+      return false;
+   }
+
+   return true;
+}
+
+/*------------------------------------------------------------
+   Display_Bitmap_File
+
+   INPUTS
+   image - Pointer to a bitmap image
+
+   DESCRIPTION
+   Displays a bitmap image
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Display_Bitmap_File(bmpBITMAP_FILE &image) {
+
+   int bitmap_width;
+   int bitmap_height;
+
+   Display_FileHeader(image.file_header);
+   Display_InfoHeader(image.info_header);
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      for (int j = 0; j < bitmap_width; j++) {
+         cout << setw(4) << int(image.image_ptr[i][j]);
+      }
+   }
+}
+
+/*-----------------------------------------------------------
+   Allocate_Image
+
+   INPUTS
+   image - Pointer to an image whose headers have been filled in
+
+   DESCRIPTION
+   Allocates the pixels for the size given in the info header. The
+   rows are stored back to back in one block, image_ptr[0], and
+   image_ptr[i] points at row i. The pixels are not initialized.
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Allocate_Image(bmpBITMAP_FILE &image) {
+
+   int height;
+   int width;
+   byte_t *pixels;
+
+   height = Assemble_Integer(image.info_header.biHeight);
+   width  = Assemble_Integer(image.info_header.biWidth);
+
+   pixels = new byte_t[(size_t)height * width];
+   image.image_ptr = new byte_t*[height > 0 ? height : 1];
+   image.image_ptr[0] = pixels;
+
+   for (int i = 0; i < height; i++) {
+      image.image_ptr[i] = pixels + (size_t)i * width;
+   }
+}
+
+/*-----------------------------------------------------------
+   Copy_Image
+
+   INPUTS
+   image_copy - Pointer to the destination image
+   image_orig - Pointer to the original image
+
+   DESCRIPTION
+   Copies imag_orig to image_copy
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Copy_Image(bmpBITMAP_FILE &image_orig,
+                bmpBITMAP_FILE &image_copy) {
+
+   int height;
+   int width;
+
+   image_copy.file_header = image_orig.file_header;
+   image_copy.info_header = image_orig.info_header;
+   image_copy.palette    = image_orig.palette;
+
+   height = Assemble_Integer(image_copy.info_header.biHeight);
+   width  = Assemble_Integer(image_copy.info_header.biWidth);
+
+   Allocate_Image(image_copy);
+
+   // Load the bytes into the new array one line at a time
+   for (int i = 0; i < height; i++) {
+      memcpy(image_copy.image_ptr[i], image_orig.image_ptr[i], width);
+   }
+}
+
+/*-----------------------------------------------------------
+   Copy_Rows
+
+   INPUTS
+   source - Pointer to an image
+   target - Pointer to an image of the same size
+
+   DESCRIPTION
+   Copies the pixels of source into the rows target already has. Unlike
+   Copy_Image, nothing is allocated and the rows stay where they are,
+   so target may be a view, or any rows owned elsewhere.
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Copy_Rows(bmpBITMAP_FILE &source, bmpBITMAP_FILE &target) {
+
+   int height = Assemble_Integer(source.info_header.biHeight);
+   int width  = Assemble_Integer(source.info_header.biWidth);
+
+   for (int i = 0; i < height; i++) {
+      memcpy(target.image_ptr[i], source.image_ptr[i], width);
+   }
+}
+
+/*-----------------------------------------------------------
+   Remove_Image
+
+   INPUTS
+   image - Pointer to an image,
+           image.byte_t contains pointers to a 2-dim array
+
+   DESCRIPTION
+   Memory that **byte_t points to in the image is freed, and
+   image.bfType[] is set to "XX".
+
+   RETURNS
+   Nothing
+-----------------------------------------------------------*/
+void Remove_Image(bmpBITMAP_FILE &image) {
+
+   // Delete the dynamic memory
+   if (image.image_ptr != 0) {
+      delete [] image.image_ptr[0];
+      delete [] image.image_ptr;
+      image.image_ptr = 0;
+   }
+
+   image.file_header.bfType[0] = 'X';  // just to mark it as
+   image.file_header.bfType[1] = 'X';  // unused.
+
+   // Also, we may wish to initialize all the header
+   // info to zero.
+}
+
+// ----------------------------------------------------------
+// Image
+
+Image::Image() {
+   Reset();
+}
+
+Image::Image(int width, int height) {
+   Init_Bitmap_Header(bitmap, width, height);
+   Allocate_Image(bitmap);
+}
+
+Image::Image(const char *file_name) {
+   Load_Bitmap_File(bitmap, file_name);
+}
+
+Image::Image(Image &&other) {
+   bitmap = other.bitmap;
+   other.Reset();
+}
+
+Image &Image::operator=(Image &&other) {
+   if (this != &other) {
+      Remove_Image(bitmap);
+      bitmap = other.bitmap;
+      other.Reset();
+   }
+   return *this;
+}
+
+Image::~Image() {
+   Remove_Image(bitmap);
+}
+
+Image Image::Same_Format(const bmpBITMAP_FILE &format) {
+   Image image;
+
+   image.bitmap.file_header = format.file_header;
+   image.bitmap.info_header = format.info_header;
+   image.bitmap.palette     = format.palette;
+   Allocate_Image(image.bitmap);
+
+   return image;
+}
+
+Image Image::Copy_Of(bmpBITMAP_FILE &image) {
+   Image copy;
+
+   Copy_Image(image, copy.bitmap);
+
+   return copy;
+}
+
+Image Image::Clone() {
+   return Copy_Of(bitmap);
+}
+
+// Leaves the image empty. Does not free the pixels.
+void Image::Reset() {
+   memset(&bitmap, 0, sizeof(bitmap));
+}
+
+// ----------------------------------------------------------
+// Image_View
+
+Image_View::Image_View(byte_t *pixels, int width, int height, int stride)
+   : rows(height > 0 ? height : 1, pixels), width(width), height(height) {
+
+   Init_Bitmap_Header(bitmap, width, height);
+
+   for (int i = 0; i < height; i++) {
+      rows[i] = pixels + (ptrdiff_t)i * stride;
+   }
+   bitmap.image_ptr = &rows[0];
+}
+
+Image_View::Image_View(bmpBITMAP_FILE &image, int row, int col, int width, int height)
+   : rows(height > 0 ? height : 1, (byte_t *)0), width(width), height(height) {
+
+   bitmap = image;
+   Disassemble_Integer(width, bitmap.info_header.biWidth);
+   Disassemble_Integer(height, bitmap.info_header.biHeight);
+   Disassemble_Integer((width + Calc_Padding(width)) * height, bitmap.info_header.biSizeImage);
+
+   for (int i = 0; i < height; i++) {
+      rows[i] = image.image_ptr[row + i] + col;
+   }
+   bitmap.image_ptr = &rows[0];
+}
+
+//================= Save_Bitmap_File =======================
+//
+void Save_Bitmap_File(bmpBITMAP_FILE &image) {
+
+   char out_file_name[80];
+
+   cout << "Save file as: ";
+   cin >> out_file_name;
+
+   Save_Bitmap_File(image, out_file_name);
+}
+
+//================= Save_Bitmap_File =======================
+// Same as above, but writes to the named file without prompting. A
+// name ending in .pgm, .raw or .rle is written in that format instead.
+//
+void Save_Bitmap_File(bmpBITMAP_FILE &image, const char *file_name) {
+
+   ofstream fs_data;
+
+   Open_Output_File(fs_data, file_name);
+   Write_Image(fs_data, image, File_Type(file_name));
+   fs_data.close();
+}
+
+//================= Write_Bitmap_File ======================
+//
+void Write_Bitmap_File(ostream &fs_data, bmpBITMAP_FILE &image) {
+
+   int width;
+   int height;
+
+   height = Assemble_Integer(image.info_header.biHeight);
+   width  = Assemble_Integer(image.info_header.biWidth);
+
+   fs_data.write ((char *) &image.file_header, sizeof(bmpFILEHEADER));
+
+   if (!fs_data.good()) {
+      cout << "\aError 101 writing bitmapfile_header";
+      cout << " to file.\n";
+      exit (101);
+   }
+
+   fs_data.write ((char *) &image.info_header, sizeof(bmpINFOHEADER));
+
+   if (!fs_data.good()) {
+      cout << "\aError 102 writing bitmap";
+      cout << " info_header to file.\n";
+      exit (102);
+   }
+
+   fs_data.write ((char *) &image.palette, sizeof(bmpPALLETTE));
+
+   if (!fs_data.good()) {
+      cout << "\aError 103 writing bitmap palette to";
+      cout << "file.\n";
+      exit (103);
+   }
+
+   // This loop writes the image data, a row and its padding at a time
+   static const char zeros[4] = {0};
+   int padding = Calc_Padding(width);
+
+   for (int i = 0; i < height; i++) {
+      fs_data.write((char *) image.image_ptr[i], width);
+      fs_data.write(zeros, padding);
+
+      if (!fs_data.good()) {
+         cout << "\aError 104 writing bitmap data";
+         cout << "to file.\n";
+         exit (104);
+      }
+   }
+}
+
+// Appends one row of pixels to an RLE8 encoding. Runs of 3 or more
+// pixels are stored as a count and the pixel. The pixels between them
+// are stored one by one, which takes 3 or more of them, so a shorter
+// gap is stored as runs of 1 or 2.
+void RLE8_Row(const byte_t *row, int width, vector<byte_t> &out) {
+
+   int j = 0;
+
+   while (j < width) {
+      int run = 1;
+
+      while (j + run < width && run < 255 && row[j + run] == row[j]) {
+         run++;
+      }
+
+      if (run >= 3) {
+         out.push_back(run);
+         out.push_back(row[j]);
+         j += run;
+         continue;
+      }
+
+      // The pixels up to the next run of 3
+      int end = j;
+
+      while (end < width && end - j < 255 &&
+             !(end + 2 < width && row[end] == row[end + 1] && row[end] == row[end + 2])) {
+         end++;
+      }
+
+      if (end - j < 3) {
+         for (; j < end; j++) {
+            out.push_back(1);
+            out.push_back(row[j]);
+         }
+         continue;
+      }
+
+      out.push_back(0);
+      out.push_back(end - j);
+      out.insert(out.end(), row + j, row + end);
+      if ((end - j) & 1)
+         out.push_back(0);
+      j = end;
+   }
+}
+
+/*------------------------------------------------------------
+   Write_RLE8_File
+
+   INPUTS
+   out   - Stream to write to
+   image - The image to write
+
+   DESCRIPTION
+   Writes image as a bitmap compressed with RLE8. Each row is a list of
+   runs of one level, with the pixels between runs stored as they are,
+   and ends with an end of line. Edge maps, which are nearly all white,
+   take a small part of the space they take uncompressed. The whole
+   encoding is built in memory first, as its size goes in the headers.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Write_RLE8_File(ostream &out, bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<byte_t> encoded;
+
+   encoded.reserve((size_t)height * 4);
+
+   for (int i = 0; i < height; i++) {
+      RLE8_Row(image.image_ptr[i], width, encoded);
+
+      // The last row ends the picture rather than the line
+      encoded.push_back(0);
+      encoded.push_back(i == height - 1 ? 1 : 0);
+   }
+
+   Write_RLE8_Data(out, image, encoded);
+}
+
+// Writes the headers and palette of format for the RLE8 rows in encoded,
+// then the rows. The rows must be stored from the bottom up.
+void Write_RLE8_Data(ostream &out, const bmpBITMAP_FILE &format, const vector<byte_t> &encoded) {
+
+   int offset = sizeof(bmpFILEHEADER) + sizeof(bmpINFOHEADER) + sizeof(bmpPALLETTE);
+   bmpFILEHEADER file_header = format.file_header;
+   bmpINFOHEADER info_header = format.info_header;
+
+   Disassemble_Integer(offset + encoded.size(), file_header.bfSize);
+   Disassemble_Integer(offset, file_header.bfOffbits);
+   Disassemble_Integer(sizeof(bmpINFOHEADER), info_header.biSize);
+   Disassemble_Integer(1, info_header.biCompression);
+   Disassemble_Integer(encoded.size(), info_header.biSizeImage);
+
+   out.write((const char *) &file_header, sizeof(bmpFILEHEADER));
+   out.write((const char *) &info_header, sizeof(bmpINFOHEADER));
+   out.write((const char *) &format.palette, sizeof(bmpPALLETTE));
+   out.write((const char *) encoded.data(), encoded.size());
+
+   if (!out) {
+      cout << "\aError 104 writing bitmap data to file.\n";
+      exit(104);
+   }
+}
+
+/*------------------------------------------------------------
+   Write_PGM_File
+
+   INPUTS
+   out   - Stream to write to
+   image - The image to write
+
+   DESCRIPTION
+   Writes image as a binary PGM, P5, with levels up to 255. The header
+   is a line of text, and there is no palette or padding.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Write_PGM_File(ostream &out, bmpBITMAP_FILE &image) {
+
+   out << "P5\n" << Assemble_Integer(image.info_header.biWidth) << " "
+       << Assemble_Integer(image.info_header.biHeight) << "\n255\n";
+
+   Write_Raw_File(out, image);
+}
+
+/*------------------------------------------------------------
+   Write_Raw_File
+
+   INPUTS
+   out   - Stream to write to
+   image - The image to write
+
+   DESCRIPTION
+   Writes the pixels of image back to back, the top row first, with
+   nothing before them. The rows are held bottom up, so they are handed
+   to the stream one at a time, and its buffer makes large writes of
+   them.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Write_Raw_File(ostream &out, bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = height - 1; i >= 0; i--) {
+      out.write((const char *) image.image_ptr[i], width);
+   }
+
+   if (!out) {
+      cout << "\aError 104 writing image data to file.\n";
+      exit(104);
+   }
+}
+
+// ----------------------------------------------------------
+// Images in memory and on pipes
+
+// A stream buffer that reads a block of memory. It can seek, as
+// Bitmap_Decoder needs to.
+class Memory_Input : public streambuf {
+public:
+   Memory_Input(const byte_t *data, size_t size) {
+      char *begin = (char *) data;
+
+      setg(begin, begin, begin + size);
+   }
+
+protected:
+   pos_type seekoff(off_type offset, ios_base::seekdir from, ios_base::openmode) {
+      char *base = from == ios_base::beg ? eback() : from == ios_base::cur ? gptr() : egptr();
+
+      if (offset < eback() - base || offset > egptr() - base)
+         return pos_type(off_type(-1));
+
+      setg(eback(), base + offset, egptr());
+      return pos_type(gptr() - eback());
+   }
+
+   pos_type seekpos(pos_type position, ios_base::openmode which) {
+      return seekoff(off_type(position), ios_base::beg, which);
+   }
+};
+
+// A stream buffer that appends what is written to a vector
+class Vector_Output : public streambuf {
+public:
+   explicit Vector_Output(vector<byte_t> &data) : data(data) {
+   }
+
+protected:
+   int_type overflow(int_type c) {
+      if (c != traits_type::eof())
+         data.push_back(c);
+      return traits_type::not_eof(c);
+   }
+
+   streamsize xsputn(const char *bytes, streamsize count) {
+      data.insert(data.end(), bytes, bytes + count);
+      return count;
+   }
+
+private:
+   vector<byte_t> &data;
+};
+
+/*------------------------------------------------------------
+   Decode_Image
+
+   INPUTS
+   data, size - An image file held in memory
+   image      - A bitmap image, allocated here
+   type       - The format of the file
+   raw_width, raw_height - The size of a raw image
+
+   DESCRIPTION
+   Does what Load_Bitmap_File does, from memory rather than a file.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Decode_Image(const byte_t *data, size_t size, bmpBITMAP_FILE &image,
+                  Image_File_Type type, int raw_width, int raw_height) {
+
+   Memory_Input buffer(data, size);
+   istream in(&buffer);
+   Bitmap_Decoder decoder(in, type, raw_width, raw_height);
+
+   image.file_header = decoder.Format().file_header;
+   image.info_header = decoder.Format().info_header;
+   image.palette     = decoder.Format().palette;
+
+   Allocate_Image(image);
+
+   decoder.Read_Rows(in, image);
+}
+
+/*------------------------------------------------------------
+   Encode_Image
+
+   INPUTS
+   image - The image to encode
+   data  - The file is appended to it
+   type  - The format of the file
+
+   DESCRIPTION
+   Does what Save_Bitmap_File does, into memory rather than a file.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Encode_Image(bmpBITMAP_FILE &image, vector<byte_t> &data, Image_File_Type type) {
+
+   Vector_Output buffer(data);
+   ostream out(&buffer);
+
+   Write_Image(out, image, type);
+}
+
+// The bytes of the next image on in, which is read straight through
+// without seeking, so it may be a pipe. Returns false if in is already
+// at its end.
+static bool Read_Frame(istream &in, Image_File_Type type, size_t raw_size, vector<byte_t> &frame) {
+
+   size_t header = 0;
+   size_t size;
+
+   if (in.peek() == EOF)
+      return false;
+
+   switch (type) {
+      case FILE_PGM: {
+         // The header is read a number at a time and written back out
+         // without its comments
+         char magic[2];
+
+         in.read(magic, sizeof(magic));
+
+         if (!in || magic[0] != 'P' || magic[1] != '5') {
+            cerr << "Error: the stream is not a binary PGM\n";
+            exit(105);
+         }
+
+         int width     = PGM_Number(in);
+         int height    = PGM_Number(in);
+         int max_value = PGM_Number(in);
+         string text = "P5\n" + to_string(width) + " " + to_string(height) + "\n" +
+                       to_string(max_value) + "\n";
+
+         if (width <= 0 || height <= 0 || max_value <= 0 || max_value > 255) {
+            cerr << "Error: only PGM files of 8 bits per pixel can be read\n";
+            exit(106);
+         }
+
+         if ((long long)width * height > MAX_IMAGE_PIXELS) {
+            cerr << "Error: the PGM image is too large\n";
+            exit(106);
+         }
+
+         frame.assign(text.begin(), text.end());
+         header = frame.size();
+         size   = header + (size_t)width * height;
+         break;
+      }
+
+      case FILE_RAW:
+         size = raw_size;
+         break;
+
+      default: {
+         bmpBITMAP_FILE format;
+
+         header = sizeof(bmpFILEHEADER) + sizeof(bmpINFOHEADER);
+         frame.resize(header);
+         in.read((char *) frame.data(), header);
+
+         memcpy(&format.file_header, frame.data(), sizeof(bmpFILEHEADER));
+         memcpy(&format.info_header, frame.data() + sizeof(bmpFILEHEADER), sizeof(bmpINFOHEADER));
+
+         // bfSize is often wrong, so the size of the rows is worked out
+         // from the layout. Only compressed rows rely on biSizeImage,
+         // which can be no more than 4 bytes a pixel. The rows start after
+         // the largest info header, its masks and a full palette at most.
+         long long width  = Assemble_Integer(format.info_header.biWidth);
+         long long height = llabs((long long)Assemble_Integer(format.info_header.biHeight));
+         long long offset = Assemble_Integer(format.file_header.bfOffbits);
+         long long rows   = Assemble_Integer(format.info_header.biSizeImage);
+         long long most_offset = sizeof(bmpFILEHEADER) + 124 + 12 + sizeof(bmpPALLETTE);
+         int bits = int(format.info_header.biBitCount[0]) + int(format.info_header.biBitCount[1]) * 256;
+         bool sized = in && width > 0 && height > 0 && width * height <= MAX_IMAGE_PIXELS &&
+                      bits > 0 && bits <= 32;
+
+         if (sized && Assemble_Integer(format.info_header.biCompression) != 1)
+            rows = (width * bits + 31) / 32 * 4 * height;
+
+         if (!sized || offset < (long long)header || offset > most_offset || rows <= 0 ||
+             rows > 4 * (width + 1) * height + 2) {
+            cerr << "Error: the stream does not hold a bitmap\n";
+            exit(105);
+         }
+
+         size = offset + rows;
+         break;
+      }
+   }
+
+   frame.resize(size);
+   in.read((char *) frame.data() + header, size - header);
+
+   if (!in) {
+      cerr << "Error: the stream ended part way through an image\n";
+      exit(107);
+   }
+
+   return true;
+}
+
+/*------------------------------------------------------------
+   Read_Image
+
+   INPUTS
+   in    - Stream holding one image after another, such as cin
+   image - A bitmap image, allocated here
+   type  - The format of the images
+   raw_width, raw_height - The size of raw images
+
+   DESCRIPTION
+   Reads the next image from in. The stream is only read forwards, and
+   only as far as the end of the image, so a pipe can carry frame after
+   frame. The image is read into memory and then decoded as
+   Decode_Image does.
+
+   RETURNS
+   false, with image untouched, if there are no more images
+-------------------------------------------------------------*/
+bool Read_Image(istream &in, bmpBITMAP_FILE &image, Image_File_Type type,
+                int raw_width, int raw_height) {
+
+   vector<byte_t> frame;
+
+   if (!Read_Frame(in, type, (size_t)raw_width * raw_height, frame))
+      return false;
+
+   Decode_Image(frame.data(), frame.size(), image, type, raw_width, raw_height);
+   return true;
+}
+
+/*------------------------------------------------------------
+   Write_Image
+
+   INPUTS
+   out   - Stream to write to, such as cout
+   image - The image to write
+   type  - The format to write it in
+
+   DESCRIPTION
+   Writes image to out in the given format. Images written one after
+   another can be read back with Read_Image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Write_Image(ostream &out, bmpBITMAP_FILE &image, Image_File_Type type) {
+
+   switch (type) {
+      case FILE_PGM:
+         Write_PGM_File(out, image);
+         break;
+
+      case FILE_RAW:
+         Write_Raw_File(out, image);
+         break;
+
+      case FILE_RLE:
+         Write_RLE8_File(out, image);
+         break;
+
+      default:
+         Write_Bitmap_File(out, image);
+         break;
+   }
+}
+
+/*------------------------------------------------------------
+   File_Type
+
+   INPUTS
+   file_name - Name of an image file
+
+   DESCRIPTION
+   Tells the format of the file from its extension, ignoring case.
+   Anything but .pgm, .raw and .rle is taken to be a bitmap.
+
+   RETURNS
+   FILE_BMP, FILE_PGM, FILE_RAW or FILE_RLE
+-------------------------------------------------------------*/
+Image_File_Type File_Type(const char *file_name) {
+
+   const char *extension = strrchr(file_name, '.');
+
+   if (extension == 0 || strchr(extension, '/') != 0)
+      return FILE_BMP;
+
+   string lower(extension);
+   for (size_t c = 0; c < lower.size(); c++) {
+      lower[c] = tolower(lower[c]);
+   }
+
+   if (lower == ".pgm")
+      return FILE_PGM;
+   if (lower == ".raw")
+      return FILE_RAW;
+   if (lower == ".rle")
+      return FILE_RLE;
+   return FILE_BMP;
+}
+
+/*------------------------------------------------------------
+   Raw_File_Size
+
+   INPUTS
+   file_name     - Name of a raw file, as in name.1024x768.raw
+   width, height - Set to the size the name gives
+
+   DESCRIPTION
+   Reads the size of a raw image from the part of its name before the
+   extension.
+
+   RETURNS
+   true if the name gives a size
+-------------------------------------------------------------*/
+bool Raw_File_Size(const char *file_name, int &width, int &height) {
+
+   string name(file_name);
+   size_t extension = name.rfind('.');
+   size_t size;
+   char rest;
+
+   if (extension == string::npos || extension == 0)
+      return false;
+
+   size = name.rfind('.', extension - 1);
+   if (size == string::npos)
+      return false;
+
+   string dimensions = name.substr(size + 1, extension - size - 1);
+
+   return sscanf(dimensions.c_str(), "%dx%d%c", &width, &height, &rest) == 2 &&
+          width > 0 && height > 0;
+}
+
+//=================== Open_Output_File =====================
+//
+void Open_Output_File(ofstream &out_file) {
+   char out_file_name[80];
+
+   cout << "Save file as: ";
+   cin >> out_file_name;
+
+   Open_Output_File(out_file, out_file_name);
+}
+
+//=================== Open_Output_File =====================
+//
+void Open_Output_File(ofstream &out_file, const char *out_file_name) {
 
    out_file.open(out_file_name, ios::out | ios::binary);
 
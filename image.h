@@ -0,0 +1,306 @@
+// image.h
+// Declarations for the code that handles bitmap images.
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+typedef unsigned char byte_t;
+
+struct bmpFILEHEADER {
+   byte_t bfType[2]; // Bitmap identifier, Must be "BM"
+   byte_t bfSize[4];
+   byte_t bfReserved[4];
+
+   // Specifies the location (in bytes) in the file of the image data.
+   // Should be equal to sizeof(bmpFileHeader) + sizeof(bmpInfoHeader) + sizeof(Palette)
+   byte_t bfOffbits[4];
+};
+
+struct bmpINFOHEADER {
+
+   // Size of the bmpInfoHeader
+   byte_t biSize[4];
+
+   // Width of bitmap, in pixels.
+   // Change this if size of image is changed.
+   byte_t biWidth[4];
+
+   // Height of bitmap, in pixels.
+   // Change this if size of image is changed.
+   byte_t biHeight[4];
+
+   byte_t biPlanes[2];
+   byte_t biBitCount[2];
+   byte_t biCompression[4]; // Should be 0 for uncomressed bitmaps
+   byte_t biSizeImage[4]; // The size of the padded image, in bytes
+   byte_t biXPelsPerMeter[4];
+   byte_t biYPelsPermeter[4];
+   byte_t biClrUsed[4];
+   byte_t biClrImportant[4];
+};
+
+struct bmpPALLETTE {
+
+   // The 256 shades of grey of the images in memory. Files with other
+   // palettes, or none, are converted by Bitmap_Decoder.
+   byte_t palPalette[1024];
+};
+
+// Note: This structure may not be written to file all at once.
+//       The two headers may be written normally, but the image
+//       requires a write for each line followed by a possilbe
+//       1-3 padding bytes.
+struct bmpBITMAP_FILE {
+   bmpFILEHEADER file_header;
+   bmpINFOHEADER info_header;
+   bmpPALLETTE   palette;
+
+   // Fixed at 256 shades of grey. Bitmap_Decoder converts other files
+   // as they are read.
+
+   // This points to the image. Allows the allocation of a two
+   // dimensional array dynamically. The rows are stored back to back
+   // in a single block that starts at image_ptr[0].
+   byte_t **image_ptr;
+};
+
+// The kinds of file images are loaded from and saved to, chosen by the
+// extension of the file name. A raw file is the grey pixels alone, the
+// top row first, and its name gives its size, as in name.1024x768.raw.
+// A .rle file is a bitmap saved with RLE8 compression; any bitmap that
+// is compressed that way can be loaded.
+enum Image_File_Type {
+   FILE_BMP,
+   FILE_PGM,
+   FILE_RAW,
+   FILE_RLE
+};
+
+// The most pixels an image read from a stream may have, so a bad header
+// cannot ask for more memory than any real frame needs
+const long long MAX_IMAGE_PIXELS = 1LL << 28;
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void open_input_file(std::ifstream &in_file);
+void open_input_file(std::ifstream &in_file, const char *in_file_name);
+int Assemble_Integer(const unsigned char bytes[]);
+void Disassemble_Integer(int value, unsigned char bytes[]);
+void Init_Bitmap_Header(bmpBITMAP_FILE &image, int width, int height);
+void Display_FileHeader(bmpFILEHEADER &file_header);
+void Display_InfoHeader(bmpINFOHEADER &info_header);
+int Calc_Padding(int pixel_width);
+void Load_Bitmap_File(bmpBITMAP_FILE &image);
+void Load_Bitmap_File(bmpBITMAP_FILE &image, const char *file_name);
+void Read_Bitmap_File(std::istream &fs_data, bmpBITMAP_FILE &image);
+void Display_Bitmap_File(bmpBITMAP_FILE &image);
+void Allocate_Image(bmpBITMAP_FILE &image);
+void Copy_Image(bmpBITMAP_FILE &image_orig, bmpBITMAP_FILE &image_copy);
+void Copy_Rows(bmpBITMAP_FILE &source, bmpBITMAP_FILE &target);
+void Remove_Image(bmpBITMAP_FILE &image);
+void Save_Bitmap_File(bmpBITMAP_FILE &image);
+void Save_Bitmap_File(bmpBITMAP_FILE &image, const char *file_name);
+void Write_Bitmap_File(std::ostream &fs_data, bmpBITMAP_FILE &image);
+void Write_RLE8_File(std::ostream &out, bmpBITMAP_FILE &image);
+void Write_RLE8_Data(std::ostream &out, const bmpBITMAP_FILE &format,
+                     const std::vector<byte_t> &encoded);
+void RLE8_Row(const byte_t *row, int width, std::vector<byte_t> &out);
+void Write_PGM_File(std::ostream &out, bmpBITMAP_FILE &image);
+void Write_Raw_File(std::ostream &out, bmpBITMAP_FILE &image);
+void Decode_Image(const byte_t *data, size_t size, bmpBITMAP_FILE &image,
+                  Image_File_Type type = FILE_BMP, int raw_width = 0, int raw_height = 0);
+void Encode_Image(bmpBITMAP_FILE &image, std::vector<byte_t> &data, Image_File_Type type = FILE_BMP);
+bool Read_Image(std::istream &in, bmpBITMAP_FILE &image, Image_File_Type type = FILE_BMP,
+                int raw_width = 0, int raw_height = 0);
+void Write_Image(std::ostream &out, bmpBITMAP_FILE &image, Image_File_Type type = FILE_BMP);
+Image_File_Type File_Type(const char *file_name);
+bool Raw_File_Size(const char *file_name, int &width, int &height);
+void Open_Output_File(std::ofstream &out_file);
+void Open_Output_File(std::ofstream &out_file, const char *out_file_name);
+// ----------------------------------------------------------
+
+/*-----------------------------------------------------------
+   Image
+
+   DESCRIPTION
+   Owns a bitmap and its pixel storage, which is released when the
+   Image goes out of scope. An Image converts to bmpBITMAP_FILE & so
+   it can be handed to any of the processing functions. Images can be
+   moved but not copied; use Clone() for a deep copy.
+------------------------------------------------------------*/
+class Image {
+public:
+   Image();
+   Image(int width, int height);
+   explicit Image(const char *file_name);
+   Image(Image &&other);
+   Image &operator=(Image &&other);
+   ~Image();
+
+   Image(const Image &) = delete;
+   Image &operator=(const Image &) = delete;
+
+   // A new image with the headers and palette of format. The pixels
+   // are left uninitialized.
+   static Image Same_Format(const bmpBITMAP_FILE &format);
+
+   // A deep copy of image
+   static Image Copy_Of(bmpBITMAP_FILE &image);
+   Image Clone();
+
+   int Width() const { return Assemble_Integer(bitmap.info_header.biWidth); }
+   int Height() const { return Assemble_Integer(bitmap.info_header.biHeight); }
+   bool Empty() const { return bitmap.image_ptr == 0; }
+
+   byte_t *operator[](int row) { return bitmap.image_ptr[row]; }
+   const byte_t *operator[](int row) const { return bitmap.image_ptr[row]; }
+
+   bmpBITMAP_FILE &Bitmap() { return bitmap; }
+   operator bmpBITMAP_FILE &() { return bitmap; }
+
+private:
+   void Reset();
+
+   bmpBITMAP_FILE bitmap;
+};
+
+/*-----------------------------------------------------------
+   Image_View
+
+   DESCRIPTION
+   A non-owning bitmap over pixels that belong to someone else, either
+   a block of memory or a rectangle of another image. Only the table of
+   row pointers belongs to the view. Writes through a view change the
+   underlying pixels.
+
+   The rows of a block of memory are stride bytes apart. A negative
+   stride, starting from the last row, views pixels stored top row
+   first the way the program holds them, bottom row first.
+------------------------------------------------------------*/
+class Image_View {
+public:
+   Image_View(byte_t *pixels, int width, int height, int stride);
+   Image_View(bmpBITMAP_FILE &image, int row, int col, int width, int height);
+   Image_View(Image_View &&other) = default;
+   Image_View &operator=(Image_View &&other) = default;
+
+   Image_View(const Image_View &) = delete;
+   Image_View &operator=(const Image_View &) = delete;
+
+   int Width() const { return width; }
+   int Height() const { return height; }
+
+   byte_t *operator[](int row) { return rows[row]; }
+
+   bmpBITMAP_FILE &Bitmap() { return bitmap; }
+   operator bmpBITMAP_FILE &() { return bitmap; }
+
+private:
+   bmpBITMAP_FILE bitmap;
+   std::vector<byte_t *> rows;
+   int width;
+   int height;
+};
+
+/*-----------------------------------------------------------
+   Bitmap_Decoder
+
+   DESCRIPTION
+   Reads the headers of a bitmap file and converts its stored rows to
+   the 8 bit grey rows the program works on. Uncompressed files of 1,
+   4 and 8 bits with a palette of any size, 8 bit files compressed with
+   RLE8, and 24 and 32 bit BGR(A) files are understood, with any size
+   of info header and stored top down or bottom up. Given the name of the file, binary PGM and raw
+   files are read as well, see File_Type().
+
+   Format() is the grey bitmap the file is read into. An 8 bit file
+   with the usual headers and a grey palette keeps its own headers and
+   its rows are used as they are stored. Any other file gets the headers
+   of Init_Bitmap_Header, and Convert_Row() maps each pixel to its
+   luminance.
+------------------------------------------------------------*/
+class Bitmap_Decoder {
+public:
+   // Reads the headers and palette from the start of in. The file is
+   // taken to be a .bmp unless its name says otherwise.
+   explicit Bitmap_Decoder(std::istream &in, const char *file_name = 0);
+
+   // The same, but a file that cannot be read sets error rather than
+   // stopping the program, and the decoder must not be used. error is
+   // empty if the file can be read.
+   Bitmap_Decoder(std::istream &in, const char *file_name, std::string &error);
+
+   // The same for a file of the given type. A raw file has no header,
+   // so its size is given.
+   Bitmap_Decoder(std::istream &in, Image_File_Type type, int raw_width = 0, int raw_height = 0);
+
+   int Width() const { return width; }
+   int Height() const { return height; }
+   bool Top_Down() const { return top_down; }
+
+   // True when the stored rows are already grey and need no conversion
+   bool Verbatim() const { return verbatim; }
+
+   // True for RLE8 files, whose rows are read with Decode_RLE_Row()
+   // rather than Convert_Row()
+   bool Compressed() const { return compressed; }
+
+   // Where the rows start, the bytes of pixels in a stored row, and the
+   // bytes from one stored row to the next
+   long Data_Offset() const { return data; }
+   int Row_Bytes() const { return row_bytes; }
+   int Row_Stride() const { return row_stride; }
+
+   // The headers and palette of the grey bitmap, with no pixels. The
+   // height is positive whichever way the file is stored.
+   const bmpBITMAP_FILE &Format() const { return format; }
+
+   // Converts one stored row of Row_Bytes() bytes to Width() grey pixels
+   void Convert_Row(const byte_t *stored, byte_t *grey) const;
+
+   // Where an RLE8 file is up to between rows. A move down the picture
+   // can skip whole rows, and part of the row after them.
+   struct RLE_Position {
+      int skip_rows;
+      int column;
+   };
+
+   // Decodes the next row of an RLE8 file from in to Width() grey
+   // pixels. position starts out all 0.
+   void Decode_RLE_Row(std::istream &in, byte_t *grey, RLE_Position &position) const;
+
+   // Reads every row from in, which is left anywhere, into image, which
+   // has been allocated with the size of Format()
+   void Read_Rows(std::istream &in, bmpBITMAP_FILE &image) const;
+   bool Read_Rows(std::istream &in, bmpBITMAP_FILE &image, std::string &error) const;
+
+private:
+   int Open(std::istream &in, const char *file_name, std::string &error);
+   int Read_Headers(std::istream &in, Image_File_Type type, int raw_width, int raw_height,
+                    std::string &error);
+   int Read_BMP_Headers(std::istream &in, std::string &error);
+   int Read_PGM_Header(std::istream &in, std::string &error);
+   void Grey_Layout(int max_value);
+
+   bmpBITMAP_FILE format;
+   long data;
+   int width;
+   int height;
+   int bits;
+   int row_bytes;
+   int row_stride;
+   bool top_down;
+   bool verbatim;
+   bool compressed;
+   byte_t grey_of[256];
+};
+
+#endif
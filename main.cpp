@@ -3,30 +3,25 @@
 // Micah Most
 
 // Standard header files
-#include <algorithm>
-#include <cmath>
-#include <dirent.h>
-#include <fstream>
-#include <iomanip>
 #include <iostream>
-#include <map>
-#include <math.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <string>
-#include <unistd.h>
-#include <vector>
 
 using namespace std;
 
 // Classes
-#include "image.cpp"
-#include "preprocess.cpp"
-#include "process.cpp"
+#include "image.h"
+#include "preprocess.h"
+#include "process.h"
+#include "components.h"
+#include "pipeline.h"
+#include "stream.h"
+#include "batch.h"
+#include "server.h"
+#include "ring.h"
 
 // Main function
-int main() {
+int main(int argc, char *argv[]) {
 
    /* Main outline for the program.
 
@@ -42,76 +37,173 @@ int main() {
       a. Hough Transformation
    */
 
+   // main --serve [socket] [workers] [cache] keeps running and answers
+   // requests on a Unix domain socket, see Run_Server. The results are
+   // cached in memory, and in the file cache if it is given.
+   if (argc >= 2 && argc <= 5 && strcmp(argv[1], "--serve") == 0) {
+      Run_Server(argc > 2 ? argv[2] : SERVER_SOCKET_PATH, argc > 3 ? atoi(argv[3]) : 0,
+                 argc > 4 ? argv[4] : 0);
+      return 0;
+   }
+
+   // main --ring name finds the boxes and lines in each frame a capture
+   // process writes to the shared memory ring name, see Frame_Ring, and
+   // writes them to stdout as the server would. The messages of the
+   // stages go to stderr instead.
+   if (argc == 3 && strcmp(argv[1], "--ring") == 0) {
+      ostream results(cout.rdbuf());
+      Frame_Ring ring(argv[2]);
+
+      cout.rdbuf(cerr.rdbuf());
+
+      Consume_Frame_Ring(ring, Detection_Request(), [&results](const Detection_Result &result) {
+         results << Format_Result(result);
+         results.flush();
+      });
+
+      cout.rdbuf(results.rdbuf());
+      return 0;
+   }
+
+   // main - - reads bitmaps from stdin one after another, and writes
+   // each result to stdout as soon as it is done. The messages of the
+   // stages go to stderr instead.
+   if (argc == 3 && strcmp(argv[1], "-") == 0 && strcmp(argv[2], "-") == 0) {
+      ios::sync_with_stdio(false);
+
+      ostream results(cout.rdbuf());
+      Frame_Buffers frames;
+      Image frame;
+
+      cout.rdbuf(cerr.rdbuf());
+
+      while (Read_Image(cin, frame)) {
+         frames.Load(frame);
+         frame = Image();
+
+         Preprocess_Tiles(frames, 4, 2, 7, 550);
+         Thin_Edges(frames.Front());
+         Magic_eraser(frames.Front(), 60, 31);
+
+         Write_Image(results, frames.Front());
+         results.flush();
+      }
+
+      cout.rdbuf(results.rdbuf());
+      return 0;
+   }
+
+   // main --stream in.bmp out.bmp preprocesses an image too large to
+   // hold in memory a band of rows at a time, see Stream_Preprocess.
+   // Either file may be a .pgm, .raw or .rle as well, as for batches.
+   // Thinning is done with Zhang-Suen, which gives the same result in
+   // bands. Magic_eraser is skipped, as a group of edges can reach
+   // across any number of bands, so the result keeps the small groups
+   // the other modes erase.
+   if (argc == 4 && strcmp(argv[1], "--stream") == 0) {
+      Stream_Preprocess(argv[2], argv[3], 4, 2, 7, 550, THIN_ZHANG_SUEN);
+      return 0;
+   }
+
+   // main in1.bmp out1.bmp [in2.bmp out2.bmp ...] runs the program over
+   // each pair, reading and writing the files in the background, see
+   // Run_Batch. A single pair is a batch of one.
+   if (argc >= 3 && argc % 2 == 1) {
+      vector<Batch_Job> jobs;
+
+      for (int a = 1; a < argc; a += 2) {
+         Batch_Job job;
+
+         job.in_file_name  = argv[a];
+         job.out_file_name = argv[a + 1];
+         jobs.push_back(job);
+      }
+
+      Run_Batch(jobs, [](Frame_Buffers &frames) {
+         Preprocess_Tiles(frames, 4, 2, 7, 550);
+         Thin_Edges(frames.Front());
+         Magic_eraser(frames.Front(), 60, 31);
+      });
+      return 0;
+   }
+
    // Global variables
-   bmpBITMAP_FILE orig_image;
-   bmpBITMAP_FILE copy1;
+   Image orig_image;
 
    Load_Bitmap_File(orig_image);
 
-   Display_FileHeader(orig_image.file_header);
-   Display_InfoHeader(orig_image.info_header);
-   //copies from orig_image to copy1
+   Display_FileHeader(orig_image.Bitmap().file_header);
+   Display_InfoHeader(orig_image.Bitmap().info_header);
+   //copies from orig_image to the front frame. The frames are
+   //reused by every stage, so none of them allocate an image.
 
-   Copy_Image(orig_image, copy1);
+   Frame_Buffers frames(orig_image);
    cout << "A copy of the file has been "
         << "made in main memory." << endl;
 
-   Remove_Image(orig_image); // frees dynamic memory too
+   orig_image = Image(); // frees dynamic memory too
 
    cout << "The original image has been "
         << "removed from main memory." << endl << endl
         << "Begin image processing..." << endl;
 
-   // Change_Brightness(copy1, -50);
+   // Change_Brightness(frames.Front(), -50);
+
+   // The four stages below run fused, a cache-sized tile of rows at a
+   // time. Comment this out and the stages back in to try others between.
+   Preprocess_Tiles(frames, 4, 2, 7, 550);
+
+   // Average(frames.Front(), 4);
 
-   Average(copy1, 4);
+   // Histogram_Equalization(frames.Front());
 
-   Histogram_Equalization(copy1);
+   // Change_Contrast(frames.Front(), 2.5);
 
-   Change_Contrast(copy1, 2.5);
+   // Median_Filter(frames, 1);
 
-   // Reduce_Noise(copy1);
+   // Gaussian_Blur(frames, 1.5);
 
-   // Simple_detect_egdes(copy1, 40);
+   // Simple_detect_egdes(frames.Front(), 40);
 
-   Kirsh_detect_egdes(copy1, 7, 550);
+   // Canny_detect_egdes(frames, 100, 250);
+
+   // Kirsh_detect_egdes(frames, 7, 550);
 
    cout << "Begin thinning the image" << endl;
-   Thin_Edges(copy1);
+   Thin_Edges(frames.Front());
+   // Thin_Edges(frames.Front(), THIN_ZHANG_SUEN);
 
-   // outsource_Hough_Transform(copy1, 170);
+   // outsource_Hough_Transform(frames, 170);
 
-   Magic_eraser(copy1, 60, 31);
+   Magic_eraser(frames.Front(), 60, 31);
 
-   // Thin_Edges(copy1);
+   // Thin_Edges(frames.Front());
 
-   // Hough_transform(copy1, 20, 46, 0, false);
+   // Hough_transform(frames, 20, 46, 0, false);
 
-   // Hough_transform(copy1, 50, 10, false);
-   // Hough_transform(copy1, 4, 10, 4, false);
+   // Hough_transform(frames, 50, 10, false);
+   // Hough_transform(frames, 4, 10, 4, false);
 
-   // Thin_Edges(copy1);
+   // Thin_Edges(frames.Front());
    //
-   // Hough_transform(copy1, 50, 100);
-   // Hough_transform(copy1, 20, 200);
+   // Hough_transform(frames, 50, 100);
+   // Hough_transform(frames, 20, 200);
 
 
-   // Thin_Edges(copy1);
+   // Thin_Edges(frames.Front());
    //
-   // Hough_transform(copy1, 700);
+   // Hough_transform(frames, 700);
    //
-   // Thin_Edges(copy1);
+   // Thin_Edges(frames.Front());
    //
-   // Hough_transform(copy1, 700);
+   // Hough_transform(frames, 700);
 
 
    cout << endl << "To show that the copy starts as " <<
       "an exact copy of the original,";
 
    cout << endl << "Save the copy as a bitmap." << endl;
-   Save_Bitmap_File(copy1);
-
-   Remove_Image(copy1);
+   Save_Bitmap_File(frames.Front());
 
    return 0;
 
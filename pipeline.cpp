@@ -0,0 +1,435 @@
+// pipeline.cpp
+// Runs the stages of the box finding program over a pair of preallocated
+// frame buffers, so that a frame can be processed without allocating or
+// copying whole images between stages.
+
+// Standard header files
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string.h>
+#include <utility>
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+#include "process.h"
+#include "thread_pool.h"
+#include "pipeline.h"
+
+using namespace std;
+
+// ----------------------------------------------------------
+// Frame_Buffers
+
+Frame_Buffers::Frame_Buffers(Image_Pool *pool) : front(0), pool(pool) {
+}
+
+Frame_Buffers::Frame_Buffers(bmpBITMAP_FILE &image) : front(0), pool(0) {
+   Load(image);
+}
+
+void Frame_Buffers::Prepare(const bmpBITMAP_FILE &format) {
+
+   for (int f = 0; f < 2; f++) {
+      if (frames[f].Empty() ||
+          frames[f].Width()  != Assemble_Integer(format.info_header.biWidth) ||
+          frames[f].Height() != Assemble_Integer(format.info_header.biHeight)) {
+         if (pool) {
+            pool->Release(std::move(frames[f]));
+            frames[f] = pool->Acquire(format);
+         }
+         else {
+            frames[f] = Image::Same_Format(format);
+         }
+      }
+      else {
+         frames[f].Bitmap().file_header = format.file_header;
+         frames[f].Bitmap().info_header = format.info_header;
+         frames[f].Bitmap().palette     = format.palette;
+      }
+   }
+}
+
+void Frame_Buffers::Load(bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   Prepare(image);
+   Thread_Arena().Reset();
+
+   for (int i = 0; i < height; i++) {
+      memcpy(Front().image_ptr[i], image.image_ptr[i], width);
+   }
+}
+
+/*------------------------------------------------------------
+   Box_Blur
+
+   INPUTS
+   frames - The frame buffers, the front frame is blurred
+   radius - Each pixel is averaged over a (2*radius+1) square window
+
+   DESCRIPTION
+   Writes the blurred front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Box_Blur(Frame_Buffers &frames, int radius) {
+
+   Box_Blur(frames.Front(), frames.Back(), radius);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   Gaussian_Blur
+
+   INPUTS
+   frames - The frame buffers, the front frame is blurred
+   sigma  - Standard deviation of the Gaussian, in pixels
+
+   DESCRIPTION
+   Writes the blurred front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Gaussian_Blur(Frame_Buffers &frames, float sigma) {
+
+   Gaussian_Blur(frames.Front(), frames.Back(), sigma);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   Median_Filter
+
+   INPUTS
+   frames - The frame buffers, the front frame is filtered
+   radius - Each pixel is replaced by the median of a (2*radius+1)
+            square window
+
+   DESCRIPTION
+   Writes the median filtered front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Median_Filter(Frame_Buffers &frames, int radius) {
+
+   Median_Filter(frames.Front(), frames.Back(), radius);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   Kirsh_detect_egdes
+
+   INPUTS
+   frames - The frame buffers, the edges are found in the front frame
+   int - Size of the operator, 3, 5 or 7
+   int - Level of difference between pixels
+
+   DESCRIPTION
+   Writes the edges of the front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Kirsh_detect_egdes(Frame_Buffers &frames, int op_size, int threshold) {
+
+   Kirsh_detect_egdes(frames.Front(), frames.Back(), op_size, threshold);
+   frames.Flip();
+}
+
+// Adds to histogram the levels Average_Blocks would leave in rows
+// first .. last-1 of image, without changing image. first must be the
+// top of a row of blocks.
+static void Average_Histogram(bmpBITMAP_FILE &image, int size, int first, int last,
+                              long long histogram[256]) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   int i = first;
+
+   while (i < last) {
+      if (size <= 1 || i >= height - size) {
+         for (int b = 0; b < width; b++) {
+            histogram[image.image_ptr[i][b]]++;
+         }
+         i++;
+         continue;
+      }
+
+      int j = 0;
+
+      for (; j < width - size; j += size) {
+         int average = 0;
+
+         for (int a = i; a < i + size; a++) {
+            for (int b = j; b < j + size; b++) {
+               average += image.image_ptr[a][b];
+            }
+         }
+         histogram[average / (size*size)] += size*size;
+      }
+
+      // The last partial block of the rows is left alone
+      for (int a = i; a < i + size; a++) {
+         for (int b = j; b < width; b++) {
+            histogram[image.image_ptr[a][b]]++;
+         }
+      }
+      i += size;
+   }
+}
+
+// Runs the chain of Preprocess_Tiles on rows top .. bottom-1 of edges.
+// The rows the Kirsch operator reads are smoothed and mapped through
+// levels in a scratch copy, widened to whole rows of blocks so they are
+// averaged as they would be in the whole image. Returns the number of
+// edge elements found.
+static long Preprocess_Tile(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int top, int bottom,
+                            int average_size, const byte_t levels[256], int op_size,
+                            int threshold, Frame_Arena &arena) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   int size   = max(average_size, 1);
+   long edge_elnt = 0;
+
+   Arena_Scope scratch(arena);
+
+   // Kirsh_Edge_Row reads rows row-1 .. row+op_size-2
+   int first = max(top - 1, 0);
+   int last  = min(bottom + max(op_size - 2, 0), height);
+
+   first -= first % size;
+   last   = min((last + size - 1) / size * size, height);
+
+   // The smoothed rows, reached with the row numbers of the whole image
+   bmpBITMAP_FILE smoothed = image;
+   byte_t *pixels = arena.Allocate_Array<byte_t>((size_t)(last - first) * width);
+
+   smoothed.image_ptr = arena.Allocate_Array<byte_t *>(height);
+
+   for (int i = first; i < last; i++) {
+      smoothed.image_ptr[i] = pixels + (size_t)(i - first) * width;
+      memcpy(smoothed.image_ptr[i], image.image_ptr[i], width);
+   }
+
+   for (int i = first; size > 1 && i < last && i < height - size; i += size) {
+      Average_Block_Row(smoothed, i, size);
+   }
+
+   for (int i = first; i < last; i++) {
+      byte_t *row = smoothed.image_ptr[i];
+
+      for (int j = 0; j < width; j++) {
+         row[j] = levels[row[j]];
+      }
+   }
+
+   for (int row = top; row < bottom; row++) {
+      edge_elnt += Kirsh_Edge_Row(smoothed, edges, row, op_size, threshold);
+   }
+
+   return edge_elnt;
+}
+
+/*------------------------------------------------------------
+   Preprocess_Tiles
+
+   INPUTS
+   image          - Pointer to a bitmap image, which is left alone
+   edges          - Pointer to an image of the same size that receives the edges
+   average_size   - Size of the blocks for Average
+   contrast_level - Level for Change_Contrast
+   op_size        - Size of the Kirsch operator, 3, 5 or 7
+   threshold      - Threshold for Kirsh_detect_egdes
+   tile_rows      - Rows in each tile, or 0 to fit a tile in
+                    PREPROCESS_TILE_BYTES
+
+   DESCRIPTION
+   Gives the same edges as running Average, Histogram_Equalization,
+   Change_Contrast and Kirsh_detect_egdes one after the other, but
+   without sweeping the whole frame for each of them.
+
+   Equalization needs the histogram of the whole smoothed image, so a
+   first pass counts it from the block averages without writing them.
+   Equalization and contrast are then one table. The second pass runs
+   the rest of the chain on one tile of rows at a time, from smoothing
+   to edges, while the tile is in the cache. Each tile smooths the few
+   rows above and below it that the Kirsch operator reaches, so the
+   tiles do not depend on each other. Both passes are split over the
+   shared thread pool.
+
+   Tiles are whole rows, since a row is contiguous and a band of them
+   fits in the cache for any width the program sees.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Preprocess_Tiles(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int average_size,
+                      int contrast_level, int op_size, int threshold, int tile_rows) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   int size   = max(average_size, 1);
+
+   if (tile_rows <= 0)
+      tile_rows = max(PREPROCESS_TILE_BYTES / max(width, 1), 1);
+
+   // Tiles start on a row of blocks
+   tile_rows = (tile_rows + size - 1) / size * size;
+
+   int tiles = (height + tile_rows - 1) / tile_rows;
+
+   Thread_Pool &pool = Shared_Thread_Pool();
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   // Pass 1: the histogram of the smoothed image, a part for each tile
+   long long *histograms = arena.Allocate_Array<long long>((size_t)tiles * 256);
+   long long histogram[256] = {0};
+
+   memset(histograms, 0, (size_t)tiles * 256 * sizeof(long long));
+
+   pool.Parallel_For(0, tiles, [&](int begin, int end) {
+      for (int t = begin; t < end; t++) {
+         Average_Histogram(image, average_size, t * tile_rows, min((t + 1) * tile_rows, height),
+                           histograms + (size_t)t * 256);
+      }
+   });
+
+   for (int t = 0; t < tiles; t++) {
+      for (int v = 0; v < 256; v++) {
+         histogram[v] += histograms[(size_t)t * 256 + v];
+      }
+   }
+
+   byte_t equalized[256];
+   byte_t contrast[256];
+   byte_t levels[256];
+
+   Equalization_Table(histogram, equalized);
+   Contrast_Table(contrast_level, contrast);
+   for (int v = 0; v < 256; v++) {
+      levels[v] = contrast[equalized[v]];
+   }
+
+   // Pass 2: smoothing, levels and edges, a tile at a time
+   atomic<long> edge_elnt(0);
+
+   pool.Parallel_For(0, tiles, [&](int begin, int end) {
+      Frame_Arena &tile_arena = Thread_Arena();
+      long found = 0;
+
+      for (int t = begin; t < end; t++) {
+         found += Preprocess_Tile(image, edges, t * tile_rows, min((t + 1) * tile_rows, height),
+                                  average_size, levels, op_size, threshold, tile_arena);
+      }
+      edge_elnt += found;
+   });
+
+   cout << "there were: " << edge_elnt << " edge elements detected!" << endl;
+}
+
+/*------------------------------------------------------------
+   Preprocess_Tiles
+
+   INPUTS
+   frames - The frame buffers, the edges are found in the front frame
+   The rest are the same as above
+
+   DESCRIPTION
+   Writes the edges of the front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Preprocess_Tiles(Frame_Buffers &frames, int average_size, int contrast_level,
+                      int op_size, int threshold, int tile_rows) {
+
+   Preprocess_Tiles(frames.Front(), frames.Back(), average_size, contrast_level,
+                    op_size, threshold, tile_rows);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   Canny_detect_egdes
+
+   INPUTS
+   frames         - The frame buffers, the edges are found in the front frame
+   low_threshold  - Gradient needed to continue an edge
+   high_threshold - Gradient needed to start an edge
+
+   DESCRIPTION
+   Writes the edges of the front frame to the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Canny_detect_egdes(Frame_Buffers &frames, int low_threshold, int high_threshold) {
+
+   Canny_detect_egdes(frames.Front(), frames.Back(), low_threshold, high_threshold);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   Hough_transform
+
+   INPUTS
+   frames - The frame buffers, the lines are found in the front frame
+   The rest are the same as Hough_transform in preprocess.cpp
+
+   DESCRIPTION
+   Draws the lines of the front frame into the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Hough_transform(Frame_Buffers &frames, int reduction, int window,
+                     int std_dev_threshold, int presence_threshold, int outline,
+                     int directions, Hough_Tiling tiling) {
+
+   Hough_transform(frames.Front(), frames.Back(), reduction, window,
+                   std_dev_threshold, presence_threshold, outline, directions, tiling);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   dustin_Hough_Transform
+
+   INPUTS
+   frames - The frame buffers, the lines are found in the front frame
+   threshold - votes needed for a line to be drawn
+
+   DESCRIPTION
+   Draws the lines of the front frame into the back frame and flips.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void dustin_Hough_Transform(Frame_Buffers &frames, int threshold) {
+
+   dustin_Hough_Transform(frames.Front(), frames.Back(), threshold);
+   frames.Flip();
+}
+
+/*------------------------------------------------------------
+   outsource_Hough_Transform
+
+   INPUTS
+   frames - The frame buffers, the lines are found in the front frame
+   threshold - votes needed for a line to be drawn
+
+   DESCRIPTION
+   The lines are drawn on top of the front frame once voting is done,
+   so neither a second frame nor a flip is needed.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void outsource_Hough_Transform(Frame_Buffers &frames, int threshold) {
+
+   outsource_Hough_Transform(frames.Front(), threshold);
+}
@@ -0,0 +1,74 @@
+// pipeline.h
+// Declarations for running the stages of the box finding program over a
+// pair of preallocated frame buffers.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+
+// Preprocess_Tiles sizes its tiles so the rows of one take about this
+// many bytes, which leaves room in the L2 cache for the edges it writes
+const int PREPROCESS_TILE_BYTES = 128 * 1024;
+
+/*-----------------------------------------------------------
+   Frame_Buffers
+
+   DESCRIPTION
+   Two frames of the same size. The current frame is Front(). A stage
+   that cannot work in place reads Front(), writes every pixel of
+   Back() and then calls Flip(), so the result becomes the current frame
+   without allocating or copying anything. The frames are only
+   reallocated when Load() is given an image of a different size, and
+   then come from the pool, if there is one.
+------------------------------------------------------------*/
+class Frame_Buffers {
+public:
+   explicit Frame_Buffers(Image_Pool *pool = 0);
+   explicit Frame_Buffers(bmpBITMAP_FILE &image);
+
+   // Makes sure both frames have the format of image, then copies the
+   // pixels of image into the front frame. Loading a frame starts a new
+   // frame for the calling thread's arena.
+   void Load(bmpBITMAP_FILE &image);
+
+   // Makes sure both frames have the format of image. The contents of
+   // the frames are undefined afterwards.
+   void Prepare(const bmpBITMAP_FILE &format);
+
+   bmpBITMAP_FILE &Front() { return frames[front]; }
+   bmpBITMAP_FILE &Back() { return frames[1 - front]; }
+   void Flip() { front = 1 - front; }
+
+private:
+   Image frames[2];
+   int front;
+   Image_Pool *pool;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+//
+// These run a stage on frames.Front() and leave the result there.
+
+void Box_Blur(Frame_Buffers &frames, int radius);
+void Gaussian_Blur(Frame_Buffers &frames, float sigma);
+void Median_Filter(Frame_Buffers &frames, int radius);
+void Kirsh_detect_egdes(Frame_Buffers &frames, int op_size, int threshold);
+void Preprocess_Tiles(Frame_Buffers &frames, int average_size, int contrast_level,
+                      int op_size, int threshold, int tile_rows = 0);
+void Canny_detect_egdes(Frame_Buffers &frames, int low_threshold, int high_threshold);
+void Hough_transform(Frame_Buffers &frames, int reduction, int window,
+                     int std_dev_threshold, int presence_threshold, int outline,
+                     int directions = 16, Hough_Tiling tiling = HOUGH_SEPARATE);
+void dustin_Hough_Transform(Frame_Buffers &frames, int threshold);
+void outsource_Hough_Transform(Frame_Buffers &frames, int threshold);
+
+// This one reads image and writes every pixel of edges
+void Preprocess_Tiles(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int average_size,
+                      int contrast_level, int op_size, int threshold, int tile_rows = 0);
+// ----------------------------------------------------------
+
+#endif
@@ -2,51 +2,545 @@
 // This will be used to define various functions to perform preprocessing on
 // an image before moving forward to detect a box.
 
+// Standard header files
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "arena.h"
+#include "runs.h"
+#include "preprocess.h"
+#include "thread_pool.h"
+
+using namespace std;
+
 int BLACK = 0;
 int WHITE = 255;
 
+bool hough_trace = false;
+
 /*------------------------------------------------------------
    Average
 
    INPUTS
    image - Pointer to a bitmap image
+   size  - Width and height of the blocks
 
    DESCRIPTION
-   Changes the brightness of the image
+   Smooths the image by replacing each block with its average, see
+   Average_Blocks. Use Box_Blur for smoothing that keeps the resolution.
 
    RETURNS
    Nothing
 -------------------------------------------------------------*/
 void Average(bmpBITMAP_FILE &image, int size) {
 
-   int bitmap_width;
-   int bitmap_height;
-   int average = 0;
+   Average_Blocks(image, size);
+}
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+/*------------------------------------------------------------
+   Average_Blocks
+
+   INPUTS
+   image - Pointer to a bitmap image
+   size  - Width and height of the blocks
+
+   DESCRIPTION
+   Downsamples the image in place. Each size x size block is replaced
+   by its average, which pixelates the image. The last partial block
+   of each row and column is left alone.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Average_Blocks(bmpBITMAP_FILE &image, int size) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
 
    for (int i = 0; i < bitmap_height-size; i += size) {
-      for (int j = 0; j < bitmap_width-size; j += size) {
-         average = 0;
+      Average_Block_Row(image, i, size);
+   }
+}
 
-         for (int a = i; a < i + size; a++) {
-            for (int b = j; b < j + size; b++) {
-               average += int(image.image_ptr[a][b]);
-            }
+/*------------------------------------------------------------
+   Average_Block_Row
+
+   INPUTS
+   image - Pointer to a bitmap image
+   top   - First of the size rows of blocks
+   size  - Width and height of the blocks
+
+   DESCRIPTION
+   Replaces each size x size block of rows top .. top+size-1 with its
+   average, leaving the last partial block of the rows alone. Only
+   those rows are read, so the rows may be a band of a larger image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Average_Block_Row(bmpBITMAP_FILE &image, int top, int size) {
+
+   int bitmap_width = Assemble_Integer(image.info_header.biWidth);
+   int average;
+
+   for (int j = 0; j < bitmap_width-size; j += size) {
+      average = 0;
+
+      for (int a = top; a < top + size; a++) {
+         for (int b = j; b < j + size; b++) {
+            average += int(image.image_ptr[a][b]);
+         }
+      }
+
+      average = average / (size*size);
+
+      for (int a = top; a < top + size; a++) {
+         for (int b = j; b < j + size; b++) {
+            image.image_ptr[a][b] = average;
+         }
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Box_Blur
+
+   INPUTS
+   image   - Pointer to a bitmap image
+   blurred - Pointer to an image of the same size that receives the result
+   radius  - Each pixel is averaged over a (2*radius+1) square window
+
+   DESCRIPTION
+   Replaces every pixel with the rounded average of the window around it.
+   Near the border the window is cut off by the image and the average
+   is taken over the pixels that remain.
+
+   Separable running sums are used: each row is summed horizontally into
+   a scratch array, then a running sum of those down each column gives
+   the window sums. Both sums are updated by adding the value that
+   enters the window and subtracting the one that leaves, so the cost
+   per pixel does not depend on the radius.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Box_Blur(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, int radius) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   // Horizontal window sums of every row, and the running column sums
+   unsigned int *row_sums    = arena.Allocate_Array<unsigned int>((size_t)bitmap_height * bitmap_width);
+   unsigned int *column_sums = arena.Allocate_Array<unsigned int>(bitmap_width);
+   int *column_count         = arena.Allocate_Array<int>(bitmap_width);
+
+   if (radius < 0)
+      radius = 0;
+
+   for (int j = 0; j < bitmap_width; j++) {
+      column_count[j] = min(j + radius, bitmap_width - 1) - max(j - radius, 0) + 1;
+   }
+
+   // Horizontal pass
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *row = image.image_ptr[i];
+      unsigned int *sums = row_sums + (size_t)i * bitmap_width;
+      unsigned int sum = 0;
+
+      for (int j = 0; j < radius && j < bitmap_width; j++) {
+         sum += row[j];
+      }
+
+      for (int j = 0; j < bitmap_width; j++) {
+         if (j + radius < bitmap_width)
+            sum += row[j + radius];
+         if (j - radius - 1 >= 0)
+            sum -= row[j - radius - 1];
+         sums[j] = sum;
+      }
+   }
+
+   // Vertical pass, a whole row at a time
+   memset(column_sums, 0, bitmap_width * sizeof(unsigned int));
+
+   for (int i = 0; i < radius && i < bitmap_height; i++) {
+      unsigned int *sums = row_sums + (size_t)i * bitmap_width;
+
+      for (int j = 0; j < bitmap_width; j++) {
+         column_sums[j] += sums[j];
+      }
+   }
+
+   for (int i = 0; i < bitmap_height; i++) {
+      int row_count = min(i + radius, bitmap_height - 1) - max(i - radius, 0) + 1;
+      byte_t *out = blurred.image_ptr[i];
+
+      if (i + radius < bitmap_height) {
+         unsigned int *entering = row_sums + (size_t)(i + radius) * bitmap_width;
+
+         for (int j = 0; j < bitmap_width; j++) {
+            column_sums[j] += entering[j];
+         }
+      }
+
+      if (i - radius - 1 >= 0) {
+         unsigned int *leaving = row_sums + (size_t)(i - radius - 1) * bitmap_width;
+
+         for (int j = 0; j < bitmap_width; j++) {
+            column_sums[j] -= leaving[j];
+         }
+      }
+
+      for (int j = 0; j < bitmap_width; j++) {
+         unsigned int count = row_count * column_count[j];
+
+         out[j] = (column_sums[j] + count / 2) / count;
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Box_Blur
+
+   INPUTS
+   image  - Pointer to a bitmap image
+   radius - Each pixel is averaged over a (2*radius+1) square window
+
+   DESCRIPTION
+   Same as above, but replaces the image with the result.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Box_Blur(bmpBITMAP_FILE &image, int radius) {
+
+   Image blurred = Image::Same_Format(image);
+
+   Box_Blur(image, blurred, radius);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(blurred, image);
+}
+
+/*------------------------------------------------------------
+   Gaussian_Blur
+
+   INPUTS
+   image - Pointer to a bitmap image
+   sigma - Standard deviation of the Gaussian, in pixels
+
+   DESCRIPTION
+   Same as below, but replaces the image with the result.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Gaussian_Blur(bmpBITMAP_FILE &image, float sigma) {
+
+   Image blurred = Image::Same_Format(image);
+
+   Gaussian_Blur(image, blurred, sigma);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(blurred, image);
+}
+
+/*------------------------------------------------------------
+   Gaussian_Blur
+
+   INPUTS
+   image   - Pointer to a bitmap image
+   blurred - Pointer to an image of the same size that receives the result
+   sigma   - Standard deviation of the Gaussian, in pixels
+
+   DESCRIPTION
+   Smooths the image with a Gaussian. Near the border the edge pixels
+   are repeated to fill the window.
+
+   Below GAUSSIAN_RECURSIVE_SIGMA the blur is a fixed point convolution,
+   whose cost grows with sigma. Above it the recursive filter is used,
+   whose cost per pixel is constant but which only approximates the
+   Gaussian. It can be off by a few levels next to sharp steps, by
+   about 2% of the height of the step.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Gaussian_Blur(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma) {
+
+   if (sigma < GAUSSIAN_RECURSIVE_SIGMA)
+      Gaussian_Blur_Kernel(image, blurred, sigma);
+   else
+      Gaussian_Blur_Recursive(image, blurred, sigma);
+}
+
+/*------------------------------------------------------------
+   Gaussian_Blur_Kernel
+
+   INPUTS
+   image   - Pointer to a bitmap image
+   blurred - Pointer to an image of the same size that receives the result
+   sigma   - Standard deviation of the Gaussian, in pixels
+
+   DESCRIPTION
+   Convolves the rows and then the columns with a Gaussian kernel cut
+   off at 3 sigma. The weights are integers that add up to 4096. The
+   rows are kept with 4 extra bits between the passes, and both passes
+   work on whole rows at a time so the inner loops vectorize.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Gaussian_Blur_Kernel(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   if (sigma <= 0) {
+      for (int i = 0; i < bitmap_height; i++) {
+         memcpy(blurred.image_ptr[i], image.image_ptr[i], bitmap_width);
+      }
+      return;
+   }
+
+   int radius = int(ceil(3 * sigma));
+   int size   = 2 * radius + 1;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   int *weights          = arena.Allocate_Array<int>(size);
+   byte_t *padded        = arena.Allocate_Array<byte_t>(bitmap_width + 2 * radius);
+   unsigned int *sums    = arena.Allocate_Array<unsigned int>(bitmap_width);
+   unsigned short *rows  = arena.Allocate_Array<unsigned short>((size_t)bitmap_height * bitmap_width);
+
+   // Round the weights, then give what rounding lost or gained to the
+   // middle so they add up to exactly 4096
+   double total = 0;
+   int weight_sum = 0;
+
+   for (int k = 0; k < size; k++) {
+      total += exp(-0.5 * (k - radius) * (k - radius) / (double(sigma) * sigma));
+   }
+   for (int k = 0; k < size; k++) {
+      weights[k] = int(4096 * exp(-0.5 * (k - radius) * (k - radius) / (double(sigma) * sigma)) / total + 0.5);
+      weight_sum += weights[k];
+   }
+   weights[radius] += 4096 - weight_sum;
+
+   // Horizontal pass, into rows with 4 extra bits
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *row = image.image_ptr[i];
+      unsigned short *out = rows + (size_t)i * bitmap_width;
+
+      memset(padded, row[0], radius);
+      memcpy(padded + radius, row, bitmap_width);
+      memset(padded + radius + bitmap_width, row[bitmap_width - 1], radius);
+
+      memset(sums, 0, bitmap_width * sizeof(unsigned int));
+      for (int k = 0; k < size; k++) {
+         unsigned int weight = weights[k];
+         byte_t *in = padded + k;
+
+         for (int j = 0; j < bitmap_width; j++) {
+            sums[j] += weight * in[j];
          }
+      }
 
-         average = average / (size*size);
+      for (int j = 0; j < bitmap_width; j++) {
+         out[j] = (sums[j] + 128) >> 8;
+      }
+   }
+
+   // Vertical pass, a whole row at a time
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *out = blurred.image_ptr[i];
+
+      memset(sums, 0, bitmap_width * sizeof(unsigned int));
+      for (int k = 0; k < size; k++) {
+         unsigned int weight = weights[k];
+         int row = min(max(i + k - radius, 0), bitmap_height - 1);
+         unsigned short *in = rows + (size_t)row * bitmap_width;
+
+         for (int j = 0; j < bitmap_width; j++) {
+            sums[j] += weight * in[j];
+         }
+      }
+
+      for (int j = 0; j < bitmap_width; j++) {
+         out[j] = (sums[j] + 32768) >> 16;
+      }
+   }
+}
+
+// Number of sigmas of repeated edge pixels that the recursive filter
+// runs over past the end of a row or column
+const float GAUSSIAN_SETTLE = 6.0f;
+
+// Coefficients of the Young-van Vliet recursive Gaussian. Each pass is
+//    out[n] = b * in[n] + a1 * out[n-1] + a2 * out[n-2] + a3 * out[n-3]
+struct Recursive_Gaussian {
+   float b;
+   float a1;
+   float a2;
+   float a3;
+};
+
+static Recursive_Gaussian Recursive_Gaussian_Coefficients(float sigma) {
+   Recursive_Gaussian coefficients;
+   double q;
+
+   if (sigma >= 2.5)
+      q = 0.98711 * sigma - 0.96330;
+   else
+      q = 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+
+   double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+   double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+   double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+   double b3 = 0.422205 * q * q * q;
+
+   coefficients.a1 = b1 / b0;
+   coefficients.a2 = b2 / b0;
+   coefficients.a3 = b3 / b0;
+   coefficients.b  = 1 - (b1 + b2 + b3) / b0;
+
+   return coefficients;
+}
+
+// Runs the recursive filter forwards and then backwards down every column
+// of a rows x columns array, one row of the array at a time. Before the
+// first row the edge row is taken to continue forever, which starts the
+// forward pass in its steady state. The caller repeats the last row
+// enough times that the backward pass can start from it.
+static void Recursive_Gaussian_Columns(float *data, int rows, int columns,
+                                       const Recursive_Gaussian &c) {
+
+   for (int i = 1; i < rows; i++) {
+      float *out = data + (size_t)i * columns;
+      float *p1  = data + (size_t)(i - 1) * columns;
+      float *p2  = data + (size_t)max(i - 2, 0) * columns;
+      float *p3  = data + (size_t)max(i - 3, 0) * columns;
+
+      for (int j = 0; j < columns; j++) {
+         out[j] = c.b * out[j] + c.a1 * p1[j] + c.a2 * p2[j] + c.a3 * p3[j];
+      }
+   }
+
+   for (int i = rows - 2; i >= 0; i--) {
+      float *out = data + (size_t)i * columns;
+      float *p1  = data + (size_t)(i + 1) * columns;
+      float *p2  = data + (size_t)min(i + 2, rows - 1) * columns;
+      float *p3  = data + (size_t)min(i + 3, rows - 1) * columns;
+
+      for (int j = 0; j < columns; j++) {
+         out[j] = c.b * out[j] + c.a1 * p1[j] + c.a2 * p2[j] + c.a3 * p3[j];
+      }
+   }
+}
+
+// Copies the last of the rows of a rows x columns array into the
+// following extra rows
+static void Repeat_Last_Row(float *data, int rows, int columns, int extra) {
+   float *last = data + (size_t)(rows - 1) * columns;
+
+   for (int i = 1; i <= extra; i++) {
+      memcpy(last + (size_t)i * columns, last, columns * sizeof(float));
+   }
+}
+
+// Copies a rows x columns array into a columns x rows array, in tiles
+// so that both sides are read and written a cache line at a time
+static void Transpose(const float *in, float *out, int rows, int columns) {
+   const int TILE = 32;
 
-         for (int a = i; a < i + size; a++) {
-            for (int b = j; b < j + size; b++) {
-               image.image_ptr[a][b] = average;
+   for (int i0 = 0; i0 < rows; i0 += TILE) {
+      for (int j0 = 0; j0 < columns; j0 += TILE) {
+         for (int i = i0; i < min(i0 + TILE, rows); i++) {
+            for (int j = j0; j < min(j0 + TILE, columns); j++) {
+               out[(size_t)j * rows + i] = in[(size_t)i * columns + j];
             }
          }
       }
    }
 }
 
+/*------------------------------------------------------------
+   Gaussian_Blur_Recursive
+
+   INPUTS
+   image   - Pointer to a bitmap image
+   blurred - Pointer to an image of the same size that receives the result
+   sigma   - Standard deviation of the Gaussian, at least 0.5
+
+   DESCRIPTION
+   Approximates the Gaussian with the recursive filter of Young and
+   van Vliet, run forwards and backwards in each direction. The cost per
+   pixel does not depend on sigma.
+
+   Each output depends on the previous ones in the same column, so the
+   recursion is run down the columns for a whole row at a time, which
+   vectorizes. The rows are filtered the same way after transposing.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Gaussian_Blur_Recursive(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   if (sigma < 0.5) {
+      Gaussian_Blur_Kernel(image, blurred, sigma);
+      return;
+   }
+
+   Recursive_Gaussian coefficients = Recursive_Gaussian_Coefficients(sigma);
+
+   // Edge pixels past the end of each column, so both passes have
+   // settled by the time the backward pass reaches the image
+   int extra = int(ceil(GAUSSIAN_SETTLE * sigma));
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   float *data       = arena.Allocate_Array<float>((size_t)(bitmap_height + extra) * bitmap_width);
+   float *transposed = arena.Allocate_Array<float>((size_t)(bitmap_width + extra) * bitmap_height);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *row = image.image_ptr[i];
+      float *out = data + (size_t)i * bitmap_width;
+
+      for (int j = 0; j < bitmap_width; j++) {
+         out[j] = row[j];
+      }
+   }
+
+   Repeat_Last_Row(data, bitmap_height, bitmap_width, extra);
+   Recursive_Gaussian_Columns(data, bitmap_height + extra, bitmap_width, coefficients);
+   Transpose(data, transposed, bitmap_height, bitmap_width);
+   Repeat_Last_Row(transposed, bitmap_width, bitmap_height, extra);
+   Recursive_Gaussian_Columns(transposed, bitmap_width + extra, bitmap_height, coefficients);
+   Transpose(transposed, data, bitmap_width, bitmap_height);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      float *in = data + (size_t)i * bitmap_width;
+      byte_t *out = blurred.image_ptr[i];
+
+      for (int j = 0; j < bitmap_width; j++) {
+         out[j] = byte_t(min(max(in[j] + 0.5f, 0.0f), 255.0f));
+      }
+   }
+}
+
 /*------------------------------------------------------------
    Change_Brightness
 
@@ -100,148 +594,505 @@ void Change_Contrast(bmpBITMAP_FILE &image, int level) {
 
    int bitmap_width;
    int bitmap_height;
+   byte_t contrast[256];
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   Contrast_Table(level, contrast);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      for (int j = 0; j < bitmap_width; j++) {
+         image.image_ptr[i][j] = contrast[image.image_ptr[i][j]];
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Contrast_Table
+
+   INPUTS
+   level - Level of contrast change
+   table - Receives the new value of each of the 256 levels
+
+   DESCRIPTION
+   The mapping Change_Contrast applies to every pixel.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Contrast_Table(int level, byte_t table[256]) {
+
    int change_level;
 
+   for (int v = 0; v < 256; v++) {
+      change_level = 127 + level * (v - 127);
+
+      if(change_level < 0)
+         table[v] = 0;
+      else if(change_level > 255)
+         table[v] = 255;
+      else
+         table[v] = change_level;
+   }
+}
+
+/*------------------------------------------------------------
+   Histogram_Equalization
+
+   INPUTS
+   image - Pointer to a bitmap image
+
+   DESCRIPTION
+   Changes the contrast in the image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Histogram_Equalization(bmpBITMAP_FILE &image) {
+
+   int bitmap_width;
+   int bitmap_height;
+   long long histogram[256] = {0};
+   byte_t cumlative_histogram[256];
+
    bitmap_height = Assemble_Integer(image.info_header.biHeight);
    bitmap_width  = Assemble_Integer(image.info_header.biWidth);
 
-   for (int i = 0; i < bitmap_height; i++) {
-      for (int j = 0; j < bitmap_width; j++) {
-         change_level = 127 + level * (int(image.image_ptr[i][j]) - 127);
+   // Populate histogram
+   for (int i = 0; i < bitmap_height; i++) {
+      for (int j = 0; j < bitmap_width; j++) {
+         histogram[image.image_ptr[i][j]]++;
+      }
+   }
+
+   Equalization_Table(histogram, cumlative_histogram);
+
+   // Write the equalized values back to the image
+   for(int i = 0; i < bitmap_height; i++) {
+      for (int j = 0; j < bitmap_width; j++) {
+         image.image_ptr[i][j] = cumlative_histogram[image.image_ptr[i][j]];
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Equalization_Table
+
+   INPUTS
+   histogram - Number of pixels at each of the 256 levels
+   table     - Receives the new value of each level
+
+   DESCRIPTION
+   The mapping Histogram_Equalization applies to every pixel of an
+   image with the given histogram: the cumulative histogram, scaled
+   so the brightest level present keeps its value. The counts are
+   long long so the histogram may come from an image too large to
+   hold in memory.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Equalization_Table(const long long histogram[256], byte_t table[256]) {
+
+   long long sum = 0;
+   long long pixel_count = 0;
+   int max = 0;
+
+   for (int i = 0; i < 256; i++) {
+      pixel_count += histogram[i];
+      if (histogram[i] > 0)
+         max = i;
+   }
+
+   // Populate and normalize the cumlative histogram
+   for (int i = 0; i < 256; i++) {
+      sum += histogram[i];
+      table[i] = pixel_count > 0 ? sum * max / pixel_count : 0;
+   }
+}
+
+/*------------------------------------------------------
+   Reduce Noise
+
+   INPUTS
+   image - Pointer to a bitmap image
+
+   DESCRIPTION
+   This function will take image and look at a 3x3 block of
+   the image, and find the median in all of the pixels. It will
+   then assign the median value of the pixels to the entire range.
+
+   RETURNS
+   Nothing
+
+   NOTE: Due to the nature of for loops, the outer edge of the
+         pixels won't be affected. However, with the implementation
+         of the Hough Transformation later, anything that happens
+         along the outside edge will likely be omitted.
+----------------------------------------------------------*/
+
+void Reduce_Noise(bmpBITMAP_FILE &image) {
+   int bitmap_width;
+   int bitmap_height;
+   int median;
+   int count;
+   int h_edge;
+   int w_edge;
+
+   int pixel_values[9] = {0};
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   h_edge = bitmap_height % 3;
+   w_edge = bitmap_width % 3;
+
+   // These 2 outside for loops will scan through the entire image
+   for(int i = 0; i < bitmap_height - h_edge; i += 3) {
+      for (int j = 0; j < bitmap_width - w_edge; j += 3) {
+         median = 0;
+         count  = 0;
+
+         // Loop through the specified 3x3 block to find the median
+         for(int a = i; a < (i + 3); a++) {
+            for(int b = j; b < (j + 3); b++) {
+               pixel_values[count] = int(image.image_ptr[a][b]);
+               count++;
+            }
+         }
+
+         // Sort the array, sort built into <algorithm>
+         sort(pixel_values, pixel_values + 9);
+
+         // Determine the median
+         median = pixel_values[4];
+
+         // Reduce noise in the 3x3 space.
+         for(int a = i; ((a < (i + 3)) && (a < bitmap_height)); a++) {
+            for(int b = j; ((b < (j + 3)) && (b < bitmap_width)); b++) {
+               image.image_ptr[a][b] = ((int(image.image_ptr[a][b]) + median) / 2);
+               // image.image_ptr[a][b] = median;
+            }
+         }
+
+         // Done
+      }
+   }
+
+   // Out of all for loops.
+}
+
+/*------------------------------------------------------------
+   Median_Filter
+
+   INPUTS
+   image  - Pointer to a bitmap image
+   radius - Each pixel is replaced by the median of a (2*radius+1)
+            square window
+
+   DESCRIPTION
+   Same as below, but replaces the image with the result.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Median_Filter(bmpBITMAP_FILE &image, int radius) {
+
+   Image filtered = Image::Same_Format(image);
+
+   Median_Filter(image, filtered, radius);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(filtered, image);
+}
+
+/*------------------------------------------------------------
+   Median_Filter
+
+   INPUTS
+   image    - Pointer to a bitmap image
+   filtered - Pointer to an image of the same size that receives the result
+   radius   - Each pixel is replaced by the median of a (2*radius+1)
+              square window
+
+   DESCRIPTION
+   Unlike Reduce_Noise, every pixel gets the median of its own window.
+   Near the border the edge pixels are repeated to fill the window, so
+   every window holds the same number of pixels.
+
+   The 3x3 and 5x5 windows use sorting networks, larger windows use
+   column histograms. Both give the same result.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Median_Filter(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius) {
+
+   if (radius == 1 || radius == 2)
+      Median_Filter_Network(image, filtered, radius);
+   else
+      Median_Filter_Histogram(image, filtered, radius);
+}
+
+// Copies the pixels of image into a buffer from the arena, with radius
+// copies of the first and last pixel added to each end of every row.
+// Returns the buffer; rows are stride = width + 2*radius bytes apart.
+static byte_t *Pad_Rows(Frame_Arena &arena, bmpBITMAP_FILE &image, int radius) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   int stride = bitmap_width + 2 * radius;
+   byte_t *padded = arena.Allocate_Array<byte_t>((size_t)bitmap_height * stride);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *row = image.image_ptr[i];
+      byte_t *out = padded + (size_t)i * stride;
+
+      memset(out, row[0], radius);
+      memcpy(out + radius, row, bitmap_width);
+      memset(out + radius + bitmap_width, row[bitmap_width - 1], radius);
+   }
+
+   return padded;
+}
+
+// Compare-exchange networks that leave the median of 9 and 25 values in
+// element 4 and 12. They are Batcher's odd-even merge sort with every
+// comparator that cannot reach the middle element removed.
+static const unsigned char median9_network[][2] = {
+   {0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7},
+   {1, 2}, {5, 6}, {0, 4}, {1, 5}, {2, 6}, {3, 7}, {2, 4}, {3, 5},
+   {1, 2}, {3, 4}, {5, 6}, {0, 8}, {4, 8}, {2, 4}, {3, 5}, {3, 4}
+};
+
+static const unsigned char median25_network[][2] = {
+   {0, 1}, {2, 3}, {4, 5}, {6, 7}, {8, 9}, {10, 11}, {12, 13}, {14, 15},
+   {16, 17}, {18, 19}, {20, 21}, {22, 23}, {0, 2}, {1, 3}, {4, 6}, {5, 7},
+   {8, 10}, {9, 11}, {12, 14}, {13, 15}, {16, 18}, {17, 19}, {20, 22}, {21, 23},
+   {1, 2}, {5, 6}, {9, 10}, {13, 14}, {17, 18}, {21, 22}, {0, 4}, {1, 5},
+   {2, 6}, {3, 7}, {8, 12}, {9, 13}, {10, 14}, {11, 15}, {16, 20}, {17, 21},
+   {18, 22}, {19, 23}, {2, 4}, {3, 5}, {10, 12}, {11, 13}, {18, 20}, {19, 21},
+   {1, 2}, {3, 4}, {5, 6}, {9, 10}, {11, 12}, {13, 14}, {17, 18}, {19, 20},
+   {21, 22}, {0, 8}, {1, 9}, {2, 10}, {3, 11}, {4, 12}, {5, 13}, {6, 14},
+   {7, 15}, {16, 24}, {4, 8}, {5, 9}, {6, 10}, {7, 11}, {20, 24}, {2, 4},
+   {3, 5}, {6, 8}, {7, 9}, {10, 12}, {11, 13}, {18, 20}, {19, 21}, {22, 24},
+   {1, 2}, {3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12}, {13, 14}, {17, 18},
+   {19, 20}, {21, 22}, {23, 24}, {0, 16}, {1, 17}, {2, 18}, {3, 19}, {4, 20},
+   {5, 21}, {6, 22}, {7, 23}, {8, 24}, {8, 16}, {9, 17}, {10, 18}, {11, 19},
+   {12, 20}, {13, 21}, {6, 10}, {7, 11}, {12, 16}, {13, 17}, {10, 12}, {11, 13},
+   {11, 12}
+};
+
+// Number of pixels of a row that go through the network together
+const int MEDIAN_LANES = 64;
+
+/*------------------------------------------------------------
+   Median_Filter_Network
+
+   INPUTS
+   image    - Pointer to a bitmap image
+   filtered - Pointer to an image of the same size that receives the result
+   radius   - 1 for a 3x3 window or 2 for a 5x5 window. Other radii are
+              passed on to Median_Filter_Histogram.
+
+   DESCRIPTION
+   Finds the medians with a fixed sequence of min/max exchanges instead
+   of sorting, so there are no data dependent branches. Each element of
+   the network holds one window position for MEDIAN_LANES neighbouring
+   pixels, so every exchange is a loop over a row of pixels that the
+   compiler turns into vector min/max instructions.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Median_Filter_Network(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   if (radius != 1 && radius != 2) {
+      Median_Filter_Histogram(image, filtered, radius);
+      return;
+   }
+
+   const unsigned char (*network)[2] = radius == 1 ? median9_network : median25_network;
+   int exchanges = radius == 1 ? sizeof(median9_network) / sizeof(median9_network[0])
+                               : sizeof(median25_network) / sizeof(median25_network[0]);
+   int size   = 2 * radius + 1;
+   int middle = size * size / 2;
+   int stride = bitmap_width + 2 * radius;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   byte_t *padded = Pad_Rows(arena, image, radius);
+   byte_t lanes[25][MEDIAN_LANES];
+
+   // The lanes past the end of a row are sorted along with the rest
+   memset(lanes, 0, sizeof(lanes));
+
+   for (int i = 0; i < bitmap_height; i++) {
+      const byte_t *rows[5];
+
+      for (int a = 0; a < size; a++) {
+         int row = min(max(i + a - radius, 0), bitmap_height - 1);
+         rows[a] = padded + (size_t)row * stride;
+      }
+
+      for (int j = 0; j < bitmap_width; j += MEDIAN_LANES) {
+         int count = min(MEDIAN_LANES, bitmap_width - j);
+
+         for (int a = 0; a < size; a++) {
+            for (int b = 0; b < size; b++) {
+               memcpy(lanes[a * size + b], rows[a] + j + b, count);
+            }
+         }
+
+         for (int e = 0; e < exchanges; e++) {
+            byte_t *low  = lanes[network[e][0]];
+            byte_t *high = lanes[network[e][1]];
 
-         if(change_level < 0)
-            image.image_ptr[i][j] = 0;
-         else if(change_level > 255)
-            image.image_ptr[i][j] = 255;
-         else
-            image.image_ptr[i][j] = change_level;
+            for (int x = 0; x < MEDIAN_LANES; x++) {
+               byte_t l = min(low[x], high[x]);
+               byte_t h = max(low[x], high[x]);
+               low[x]  = l;
+               high[x] = h;
+            }
+         }
+
+         memcpy(filtered.image_ptr[i] + j, lanes[middle], count);
       }
    }
 }
 
 /*------------------------------------------------------------
-   Histogram_Equalization
+   Median_Filter_Histogram
 
    INPUTS
-   image - Pointer to a bitmap image
+   image    - Pointer to a bitmap image
+   filtered - Pointer to an image of the same size that receives the result
+   radius   - Each pixel is replaced by the median of a (2*radius+1)
+              square window
 
    DESCRIPTION
-   Changes the contrast in the image.
+   Uses the constant time algorithm of Perreault and Hebert. A histogram
+   of the 2*radius+1 pixels above and below the current row is kept for
+   every column; moving down a row only removes one pixel from each and
+   adds another. The histogram of a window is the sum of the column
+   histograms it covers, and moving right along the row adds the column
+   that enters the window and subtracts the one that leaves.
+
+   Each histogram also has 16 coarse bins counting 16 levels each, so
+   the median is found by scanning at most 16 coarse and 16 fine bins.
+   None of the costs per pixel depend on the radius.
 
    RETURNS
    Nothing
 -------------------------------------------------------------*/
-void Histogram_Equalization(bmpBITMAP_FILE &image) {
-
-   int bitmap_width;
-   int bitmap_height;
-   int current_level;
-   int sum = 0;
-   int max = 0;
-   int pixel_count;
-   int cumlative_histogram[256];
-   int histogram[256] = {0};
-
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
-   pixel_count   = bitmap_height * bitmap_width;
+void Median_Filter_Histogram(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius) {
 
-   // Populate histogram
-   for (int i = 0; i < bitmap_height; i++) {
-      for (int j = 0; j < bitmap_width; j++) {
-         current_level = int(image.image_ptr[i][j]);
-         histogram[current_level]++;
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
 
-         if(current_level > max)
-            max = current_level;
+   if (radius <= 0) {
+      for (int i = 0; i < bitmap_height; i++) {
+         memcpy(filtered.image_ptr[i], image.image_ptr[i], bitmap_width);
       }
+      return;
    }
 
-   // Populate and normalize the cumlative histogram
-   cumlative_histogram[0] = histogram[0];
-   for(int i = 0; i < 256; i++) {
-      sum += histogram[i];
-      cumlative_histogram[i] = sum * max / pixel_count;
-   }
+   int size = 2 * radius + 1;
+   unsigned int middle = (unsigned int)size * size / 2;
 
-   // Write the equalized values back to the image
-   for(int i = 0; i < bitmap_height; i++) {
-      for (int j = 0; j < bitmap_width; j++) {
-         current_level = image.image_ptr[i][j];
-         image.image_ptr[i][j] = cumlative_histogram[current_level];
-      }
-   }
-}
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
 
-/*------------------------------------------------------
-   Reduce Noise
+   // Column histograms, fine and coarse, and those of the window
+   unsigned short *column_fine   = arena.Allocate_Array<unsigned short>((size_t)bitmap_width * 256);
+   unsigned short *column_coarse = arena.Allocate_Array<unsigned short>((size_t)bitmap_width * 16);
+   unsigned int fine[256];
+   unsigned int coarse[16];
 
-   INPUTS
-   image - Pointer to a bitmap image
+   memset(column_fine, 0, (size_t)bitmap_width * 256 * sizeof(unsigned short));
+   memset(column_coarse, 0, (size_t)bitmap_width * 16 * sizeof(unsigned short));
 
-   DESCRIPTION
-   This function will take image and look at a 3x3 block of
-   the image, and find the median in all of the pixels. It will
-   then assign the median value of the pixels to the entire range.
+   for (int a = -radius; a <= radius; a++) {
+      byte_t *row = image.image_ptr[min(max(a, 0), bitmap_height - 1)];
 
-   RETURNS
-   Nothing
+      for (int j = 0; j < bitmap_width; j++) {
+         column_fine[j * 256 + row[j]]++;
+         column_coarse[j * 16 + (row[j] >> 4)]++;
+      }
+   }
 
-   NOTE: Due to the nature of for loops, the outer edge of the
-         pixels won't be affected. However, with the implementation
-         of the Hough Transformation later, anything that happens
-         along the outside edge will likely be omitted.
-----------------------------------------------------------*/
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *out = filtered.image_ptr[i];
 
-void Reduce_Noise(bmpBITMAP_FILE &image) {
-   int bitmap_width;
-   int bitmap_height;
-   int median;
-   int count;
-   int h_edge;
-   int w_edge;
+      if (i > 0) {
+         byte_t *leaving  = image.image_ptr[max(i - radius - 1, 0)];
+         byte_t *entering = image.image_ptr[min(i + radius, bitmap_height - 1)];
 
-   int pixel_values[9] = {0};
+         for (int j = 0; j < bitmap_width; j++) {
+            column_fine[j * 256 + leaving[j]]--;
+            column_coarse[j * 16 + (leaving[j] >> 4)]--;
+            column_fine[j * 256 + entering[j]]++;
+            column_coarse[j * 16 + (entering[j] >> 4)]++;
+         }
+      }
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+      memset(fine, 0, sizeof(fine));
+      memset(coarse, 0, sizeof(coarse));
 
-   h_edge = bitmap_height % 3;
-   w_edge = bitmap_width % 3;
+      for (int b = -radius; b <= radius; b++) {
+         int column = min(max(b, 0), bitmap_width - 1);
+         unsigned short *column_f = column_fine + column * 256;
+         unsigned short *column_c = column_coarse + column * 16;
 
-   // These 2 outside for loops will scan through the entire image
-   for(int i = 0; i < bitmap_height - h_edge; i += 3) {
-      for (int j = 0; j < bitmap_width - w_edge; j += 3) {
-         median = 0;
-         count  = 0;
+         for (int v = 0; v < 256; v++) {
+            fine[v] += column_f[v];
+         }
+         for (int v = 0; v < 16; v++) {
+            coarse[v] += column_c[v];
+         }
+      }
 
-         // Loop through the specified 3x3 block to find the median
-         for(int a = i; a < (i + 3); a++) {
-            for(int b = j; b < (j + 3); b++) {
-               pixel_values[count] = int(image.image_ptr[a][b]);
-               count++;
+      for (int j = 0; j < bitmap_width; j++) {
+         if (j > 0) {
+            int leaving  = max(j - radius - 1, 0);
+            int entering = min(j + radius, bitmap_width - 1);
+            unsigned short *leaving_f  = column_fine + leaving * 256;
+            unsigned short *entering_f = column_fine + entering * 256;
+            unsigned short *leaving_c  = column_coarse + leaving * 16;
+            unsigned short *entering_c = column_coarse + entering * 16;
+
+            for (int v = 0; v < 256; v++) {
+               fine[v] += entering_f[v] - leaving_f[v];
+            }
+            for (int v = 0; v < 16; v++) {
+               coarse[v] += entering_c[v] - leaving_c[v];
             }
          }
 
-         // Sort the array, sort built into <algorithm>
-         sort(pixel_values, pixel_values + 9);
+         // The median is the first level with more than middle pixels
+         // at or below it
+         unsigned int count = 0;
+         int level = 0;
 
-         // Determine the median
-         median = pixel_values[4];
+         while (count + coarse[level] <= middle) {
+            count += coarse[level];
+            level++;
+         }
 
-         // Reduce noise in the 3x3 space.
-         for(int a = i; ((a < (i + 3)) && (a < bitmap_height)); a++) {
-            for(int b = j; ((b < (j + 3)) && (b < bitmap_width)); b++) {
-               image.image_ptr[a][b] = ((int(image.image_ptr[a][b]) + median) / 2);
-               // image.image_ptr[a][b] = median;
-            }
+         level *= 16;
+         while (count + fine[level] <= middle) {
+            count += fine[level];
+            level++;
          }
 
-         // Done
+         out[j] = level;
       }
    }
-
-   // Out of all for loops.
 }
 
 /*------------------------------------------------------------
@@ -306,6 +1157,62 @@ void Simple_detect_egdes(bmpBITMAP_FILE &image, int threshold) {
 -------------------------------------------------------------*/
 void Kirsh_detect_egdes(bmpBITMAP_FILE &image, int op_size, int threshold) {
 
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   bmpBITMAP_FILE edges;
+
+   Arena_Image(arena, image, edges);
+   Kirsh_detect_egdes(image, edges, op_size, threshold);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(edges, image);
+}
+
+/*------------------------------------------------------------
+   Kirsh_Edges
+
+   INPUTS
+   image - Pointer to a bitmap image
+   int - Size of the operator, 3, 5 or 7
+   int - Level of difference between pixels
+
+   DESCRIPTION
+   Same as Kirsh_detect_egdes, but leaves image alone.
+
+   RETURNS
+   A new image holding the edges
+-------------------------------------------------------------*/
+Image Kirsh_Edges(bmpBITMAP_FILE &image, int op_size, int threshold) {
+
+   Image edges = Image::Same_Format(image);
+
+   Kirsh_detect_egdes(image, edges, op_size, threshold);
+
+   return edges;
+}
+
+/*------------------------------------------------------------
+   Kirsh_Edge_Row
+
+   INPUTS
+   image - Pointer to a bitmap image
+   edges - Pointer to an image of the same size that receives the edges
+   row   - Row of edges to write
+   int - Size of the operator, 3, 5 or 7
+   int - Level of difference between pixels
+
+   DESCRIPTION
+   Writes one row of the edges found by Kirsh_detect_egdes. The
+   operator for row is placed on rows row-1 .. row+op_size-2 of image,
+   and no others are read, so the rows of image may be a rolling band
+   of a larger image. Pixels of the row the operator does not reach
+   are copied from image.
+
+   RETURNS
+   The number of edge elements in the row
+-------------------------------------------------------------*/
+int Kirsh_Edge_Row(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int row, int op_size, int threshold) {
+
    int bitmap_width;
    int bitmap_height;
    int count;
@@ -318,10 +1225,7 @@ void Kirsh_detect_egdes(bmpBITMAP_FILE &image, int op_size, int threshold) {
    int k_three[9] = {0};
    int k_five[25] = {0};
    int k_seven[49] = {0};
-
-   bmpBITMAP_FILE edges;
-
-   Copy_Image(image, edges);
+   int edge_elnt = 0;
 
    bitmap_height = Assemble_Integer(image.info_header.biHeight);
    bitmap_width  = Assemble_Integer(image.info_header.biWidth);
@@ -329,124 +1233,402 @@ void Kirsh_detect_egdes(bmpBITMAP_FILE &image, int op_size, int threshold) {
    h_edge = bitmap_height % op_size;
    w_edge = bitmap_width % op_size;
 
-   int edge_elnt = 0;
+   // Only the pixels in rows/columns 1 .. last_row/last_col are written below
+   int last_row = min(bitmap_height - h_edge - 1, bitmap_height - op_size + 1);
+   int last_col = min(bitmap_width - w_edge - 1, bitmap_width - op_size + 1);
 
-   for(int i = 0; i < bitmap_height - (h_edge+1); i++) {
-      for (int j = 0; j < bitmap_width - (w_edge+1); j++) {
-         count = 0;
+   if ((op_size != 3 && op_size != 5 && op_size != 7) || row < 1 || row > last_row || last_col < 1) {
+      memcpy(edges.image_ptr[row], image.image_ptr[row], bitmap_width);
+      return 0;
+   }
 
-         if(op_size == 3) {
-            for(int a = i; a < (i + 3); a++) {
-               for(int b = j; b < (j + 3); b++) {
-                  k_three[count] = int(image.image_ptr[a][b]);
-                  count++;
-               }
-            }
+   edges.image_ptr[row][0] = image.image_ptr[row][0];
+   memcpy(edges.image_ptr[row] + last_col + 1, image.image_ptr[row] + last_col + 1,
+          bitmap_width - last_col - 1);
+
+   // Top row of the operator
+   int i = row - 1;
 
-            horizontal    = abs((k_three[0] + k_three[1] + k_three[2]) - (k_three[6] + k_three[7] + k_three[8]));
-            positive_diag = abs((k_three[0] + k_three[1] + k_three[3]) - (k_three[5] + k_three[7] + k_three[8]));
-            vertical      = abs((k_three[0] + k_three[3] + k_three[6]) - (k_three[2] + k_three[5] + k_three[8]));
-            negative_diag = abs((k_three[1] + k_three[2] + k_three[5]) - (k_three[3] + k_three[6] + k_three[7]));
+   // The operator window must stay inside the image
+   for (int j = 0; j < bitmap_width - (w_edge+1) && j + op_size <= bitmap_width; j++) {
+      count = 0;
 
-            if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
-               edge_elnt++;
-               edges.image_ptr[i+1][j+1] = 0;
+      if(op_size == 3) {
+         for(int a = i; a < (i + 3); a++) {
+            for(int b = j; b < (j + 3); b++) {
+               k_three[count] = int(image.image_ptr[a][b]);
+               count++;
             }
-            else
-               edges.image_ptr[i+1][j+1] = 255;
+         }
+
+         horizontal    = abs((k_three[0] + k_three[1] + k_three[2]) - (k_three[6] + k_three[7] + k_three[8]));
+         positive_diag = abs((k_three[0] + k_three[1] + k_three[3]) - (k_three[5] + k_three[7] + k_three[8]));
+         vertical      = abs((k_three[0] + k_three[3] + k_three[6]) - (k_three[2] + k_three[5] + k_three[8]));
+         negative_diag = abs((k_three[1] + k_three[2] + k_three[5]) - (k_three[3] + k_three[6] + k_three[7]));
 
+         if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
+            edge_elnt++;
+            edges.image_ptr[i+1][j+1] = 0;
          }
-         else if(op_size == 5) {
-            for(int a = i; a < (i + 5); a++) {
-               for(int b = j; b < (j + 5); b++) {
-                  k_five[count] = int(image.image_ptr[a][b]);
-                  count++;
-               }
-            }
+         else
+            edges.image_ptr[i+1][j+1] = 255;
 
-            horizontal    = abs((k_five[0] + k_five[1] + k_five[2] + k_five[3] + k_five[4] +
-                                 k_five[5] + k_five[6] + k_five[7] + k_five[8] + k_five[9]) -
-                                (k_five[15] + k_five[16] + k_five[17] + k_five[18] + k_five[19] +
-                                 k_five[20] + k_five[21] + k_five[22] + k_five[23] + k_five[24]));
-
-            vertical      = abs((k_five[0] + k_five[5] + k_five[10] + k_five[15] + k_five[20] +
-                                 k_five[1] + k_five[6] + k_five[11] + k_five[16] + k_five[21]) -
-                                (k_five[3] + k_five[8] + k_five[13] + k_five[18] + k_five[23] +
-                                 k_five[4] + k_five[9] + k_five[14] + k_five[19] + k_five[24]));
-
-            positive_diag = abs((k_five[0] + k_five[1] + k_five[2] + k_five[3] + k_five[5] +
-                                 k_five[6] + k_five[7] + k_five[10] + k_five[11] + k_five[15]) -
-                                (k_five[9] + k_five[13] + k_five[14] + k_five[17] + k_five[18] +
-                                 k_five[19] + k_five[21] + k_five[22] + k_five[23] + k_five[24]));
-
-            negative_diag = abs((k_five[1] + k_five[2] + k_five[3] + k_five[4] + k_five[7] +
-                                 k_five[8] + k_five[9] + k_five[13] + k_five[14] + k_five[19]) -
-                                (k_five[5] + k_five[10] + k_five[11] + k_five[15] + k_five[16] +
-                                 k_five[19] + k_five[20] + k_five[21] + k_five[22] + k_five[23]));
-
-            if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
-               edge_elnt++;
-               edges.image_ptr[i+1][j+1] = 0;
+      }
+      else if(op_size == 5) {
+         for(int a = i; a < (i + 5); a++) {
+            for(int b = j; b < (j + 5); b++) {
+               k_five[count] = int(image.image_ptr[a][b]);
+               count++;
             }
-            else
-               edges.image_ptr[i+1][j+1] = 255;
          }
-         else if(op_size == 7) {
-            for(int a = i; a < (i + 7); a++) {
-               for(int b = j; b < (j + 7); b++) {
-                  k_seven[count] = int(image.image_ptr[a][b]);
-                  count++;
-               }
+
+         horizontal    = abs((k_five[0] + k_five[1] + k_five[2] + k_five[3] + k_five[4] +
+                              k_five[5] + k_five[6] + k_five[7] + k_five[8] + k_five[9]) -
+                             (k_five[15] + k_five[16] + k_five[17] + k_five[18] + k_five[19] +
+                              k_five[20] + k_five[21] + k_five[22] + k_five[23] + k_five[24]));
+
+         vertical      = abs((k_five[0] + k_five[5] + k_five[10] + k_five[15] + k_five[20] +
+                              k_five[1] + k_five[6] + k_five[11] + k_five[16] + k_five[21]) -
+                             (k_five[3] + k_five[8] + k_five[13] + k_five[18] + k_five[23] +
+                              k_five[4] + k_five[9] + k_five[14] + k_five[19] + k_five[24]));
+
+         positive_diag = abs((k_five[0] + k_five[1] + k_five[2] + k_five[3] + k_five[5] +
+                              k_five[6] + k_five[7] + k_five[10] + k_five[11] + k_five[15]) -
+                             (k_five[9] + k_five[13] + k_five[14] + k_five[17] + k_five[18] +
+                              k_five[19] + k_five[21] + k_five[22] + k_five[23] + k_five[24]));
+
+         negative_diag = abs((k_five[1] + k_five[2] + k_five[3] + k_five[4] + k_five[7] +
+                              k_five[8] + k_five[9] + k_five[13] + k_five[14] + k_five[19]) -
+                             (k_five[5] + k_five[10] + k_five[11] + k_five[15] + k_five[16] +
+                              k_five[19] + k_five[20] + k_five[21] + k_five[22] + k_five[23]));
+
+         if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
+            edge_elnt++;
+            edges.image_ptr[i+1][j+1] = 0;
+         }
+         else
+            edges.image_ptr[i+1][j+1] = 255;
+      }
+      else if(op_size == 7) {
+         for(int a = i; a < (i + 7); a++) {
+            for(int b = j; b < (j + 7); b++) {
+               k_seven[count] = int(image.image_ptr[a][b]);
+               count++;
             }
+         }
+
+         horizontal    = abs((k_seven[0] + k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[6] +
+                              k_seven[7] + k_seven[8] + k_seven[9] + k_seven[10] + k_seven[11] + k_seven[12] + k_seven[13] +
+                              k_seven[14] + k_seven[15] + k_seven[16] + k_seven[17] + k_seven[18] + k_seven[19] + k_seven[20]) -
+                             (k_seven[28] + k_seven[29] + k_seven[30] + k_seven[31] + k_seven[32] + k_seven[33] + k_seven[34] +
+                              k_seven[35] + k_seven[36] + k_seven[37] + k_seven[38] + k_seven[39] + k_seven[40] + k_seven[41] +
+                              k_seven[42] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47] + k_seven[48]));
+
+         vertical      = abs((k_seven[0] + k_seven[7] + k_seven[14] + k_seven[21] + k_seven[28] + k_seven[35] + k_seven[42] +
+                              k_seven[1] + k_seven[8] + k_seven[15] + k_seven[22] + k_seven[29] + k_seven[36] + k_seven[43] +
+                              k_seven[2] + k_seven[9] + k_seven[16] + k_seven[23] + k_seven[30] + k_seven[37] + k_seven[44]) -
+                             (k_seven[4] + k_seven[11] + k_seven[18] + k_seven[25] + k_seven[32] + k_seven[39] + k_seven[46] +
+                              k_seven[5] + k_seven[12] + k_seven[19] + k_seven[26] + k_seven[33] + k_seven[40] + k_seven[47] +
+                              k_seven[6] + k_seven[13] + k_seven[20] + k_seven[27] + k_seven[34] + k_seven[41] + k_seven[48]));
+
+         positive_diag = abs((k_seven[0] + k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[7] +
+                              k_seven[8] + k_seven[9] + k_seven[10] + k_seven[11] + k_seven[14] + k_seven[15] + k_seven[16] +
+                              k_seven[17] + k_seven[21] + k_seven[22] + k_seven[23] + k_seven[28] + k_seven[29] + k_seven[35]) -
+                             (k_seven[13] + k_seven[19] + k_seven[20] + k_seven[25] + k_seven[26] + k_seven[27] + k_seven[31] +
+                              k_seven[32] + k_seven[33] + k_seven[34] + k_seven[37] + k_seven[38] + k_seven[39] + k_seven[40] +
+                              k_seven[41] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47] + k_seven[48]));
+
+         negative_diag = abs((k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[6] + k_seven[9] +
+                              k_seven[10] + k_seven[11] + k_seven[12] + k_seven[13] + k_seven[17] + k_seven[18] + k_seven[19] +
+                              k_seven[20] + k_seven[25] + k_seven[26] + k_seven[27] + k_seven[33] + k_seven[34] + k_seven[41]) -
+                             (k_seven[7] + k_seven[14] + k_seven[15] + k_seven[21] + k_seven[22] + k_seven[23] + k_seven[28] +
+                              k_seven[29] + k_seven[30] + k_seven[31] + k_seven[35] + k_seven[36] + k_seven[37] + k_seven[38] +
+                              k_seven[39] + k_seven[42] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47]));
+
+         if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
+            edge_elnt++;
+            edges.image_ptr[i+1][j+1] = 0;
+         }
+         else
+            edges.image_ptr[i+1][j+1] = 255;
+      }
+   }
+
+   return edge_elnt;
+}
+
+/*------------------------------------------------------------
+   Kirsh_detect_egdes
+
+   INPUTS
+   image - Pointer to a bitmap image
+   edges - Pointer to an image of the same size that receives the edges
+   int - Size of the operator, 3, 5 or 7
+   int - Level of difference between pixels
+
+   DESCRIPTION
+   Same as above, but the edges are written to a separate image instead
+   of replacing the input. Pixels the operator does not reach are copied
+   from image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Kirsh_detect_egdes(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int op_size, int threshold) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int edge_elnt = 0;
+
+   for (int row = 0; row < bitmap_height; row++) {
+      edge_elnt += Kirsh_Edge_Row(image, edges, row, op_size, threshold);
+   }
+   cout << "there were: " << edge_elnt << " edge elements detected!" << endl;
+}
+
+
+/*------------------------------------------------------------
+   Canny_detect_egdes
+
+   INPUTS
+   image          - Pointer to a bitmap image
+   low_threshold  - Gradient needed to continue an edge
+   high_threshold - Gradient needed to start an edge
+
+   DESCRIPTION
+   Marks the edges of the image in black on white, one pixel wide, so
+   they do not need Thin_Edges afterwards.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Canny_detect_egdes(bmpBITMAP_FILE &image, int low_threshold, int high_threshold) {
+
+   Image edges = Canny_Edges(image, low_threshold, high_threshold);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(edges, image);
+}
+
+/*------------------------------------------------------------
+   Canny_Edges
+
+   INPUTS
+   image          - Pointer to a bitmap image
+   low_threshold  - Gradient needed to continue an edge
+   high_threshold - Gradient needed to start an edge
+
+   DESCRIPTION
+   Same as Canny_detect_egdes, but leaves image alone.
+
+   RETURNS
+   A new image holding the edges
+-------------------------------------------------------------*/
+Image Canny_Edges(bmpBITMAP_FILE &image, int low_threshold, int high_threshold) {
+
+   Image edges = Image::Same_Format(image);
+
+   Canny_detect_egdes(image, edges, low_threshold, high_threshold);
+
+   return edges;
+}
+
+// Direction of the gradient, rounded to the nearest 45 degrees. The
+// diagonals are named after the neighbours the gradient points between.
+enum Canny_Direction {
+   CANNY_HORIZONTAL,
+   CANNY_VERTICAL,
+   CANNY_DOWN_RIGHT,
+   CANNY_DOWN_LEFT
+};
+
+// States of a pixel after non-maximum suppression
+enum Canny_State {
+   CANNY_NONE,
+   CANNY_WEAK,
+   CANNY_EDGE
+};
+
+// Finds the Canny edges of image and leaves CANNY_EDGE in state, an array
+// of width * height bytes, for every edge element
+static void Canny_States(bmpBITMAP_FILE &image, int low_threshold, int high_threshold,
+                         byte_t *state) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   size_t pixels = (size_t)bitmap_height * bitmap_width;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   unsigned short *magnitude = arena.Allocate_Array<unsigned short>(pixels);
+   byte_t *direction = arena.Allocate_Array<byte_t>(pixels);
+   int *stack        = arena.Allocate_Array<int>(pixels);
+   int top = 0;
+
+   if (low_threshold < 1)
+      low_threshold = 1;
+
+   memset(magnitude, 0, pixels * sizeof(unsigned short));
+   memset(direction, 0, pixels);
+   memset(state, CANNY_NONE, pixels);
+
+   // Sobel gradient of the pixels with all 8 neighbours
+   for (int i = 1; i < bitmap_height - 1; i++) {
+      byte_t *above = image.image_ptr[i - 1];
+      byte_t *row   = image.image_ptr[i];
+      byte_t *below = image.image_ptr[i + 1];
+      unsigned short *m = magnitude + (size_t)i * bitmap_width;
+      byte_t *d = direction + (size_t)i * bitmap_width;
+
+      for (int j = 1; j < bitmap_width - 1; j++) {
+         int gx = (above[j + 1] + 2 * row[j + 1] + below[j + 1]) -
+                  (above[j - 1] + 2 * row[j - 1] + below[j - 1]);
+         int gy = (below[j - 1] + 2 * below[j] + below[j + 1]) -
+                  (above[j - 1] + 2 * above[j] + above[j + 1]);
+         int ax = abs(gx);
+         int ay = abs(gy);
+
+         m[j] = ax + ay;
+
+         // 29/70 is tan(22.5 degrees) to four places
+         if (ay * 70 < ax * 29)
+            d[j] = CANNY_HORIZONTAL;
+         else if (ax * 70 < ay * 29)
+            d[j] = CANNY_VERTICAL;
+         else if ((gx > 0) == (gy > 0))
+            d[j] = CANNY_DOWN_RIGHT;
+         else
+            d[j] = CANNY_DOWN_LEFT;
+      }
+   }
+
+   // Non-maximum suppression. On a plateau the first pixel along the
+   // gradient is kept.
+   for (int i = 1; i < bitmap_height - 1; i++) {
+      for (int j = 1; j < bitmap_width - 1; j++) {
+         size_t p = (size_t)i * bitmap_width + j;
+         int m = magnitude[p];
+         size_t step;
+
+         if (m < low_threshold)
+            continue;
+
+         switch (direction[p]) {
+         case CANNY_HORIZONTAL: step = 1; break;
+         case CANNY_VERTICAL:   step = bitmap_width; break;
+         case CANNY_DOWN_RIGHT: step = bitmap_width + 1; break;
+         default:               step = bitmap_width - 1; break;
+         }
 
-            horizontal    = abs((k_seven[0] + k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[6] +
-                                 k_seven[7] + k_seven[8] + k_seven[9] + k_seven[10] + k_seven[11] + k_seven[12] + k_seven[13] +
-                                 k_seven[14] + k_seven[15] + k_seven[16] + k_seven[17] + k_seven[18] + k_seven[19] + k_seven[20]) -
-                                (k_seven[28] + k_seven[29] + k_seven[30] + k_seven[31] + k_seven[32] + k_seven[33] + k_seven[34] +
-                                 k_seven[35] + k_seven[36] + k_seven[37] + k_seven[38] + k_seven[39] + k_seven[40] + k_seven[41] +
-                                 k_seven[42] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47] + k_seven[48]));
-
-            vertical      = abs((k_seven[0] + k_seven[7] + k_seven[14] + k_seven[21] + k_seven[28] + k_seven[35] + k_seven[42] +
-                                 k_seven[1] + k_seven[8] + k_seven[15] + k_seven[22] + k_seven[29] + k_seven[36] + k_seven[43] +
-                                 k_seven[2] + k_seven[9] + k_seven[16] + k_seven[23] + k_seven[30] + k_seven[37] + k_seven[44]) -
-                                (k_seven[4] + k_seven[11] + k_seven[18] + k_seven[25] + k_seven[32] + k_seven[39] + k_seven[46] +
-                                 k_seven[5] + k_seven[12] + k_seven[19] + k_seven[26] + k_seven[33] + k_seven[40] + k_seven[47] +
-                                 k_seven[6] + k_seven[13] + k_seven[20] + k_seven[27] + k_seven[34] + k_seven[41] + k_seven[48]));
-
-            positive_diag = abs((k_seven[0] + k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[7] +
-                                 k_seven[8] + k_seven[9] + k_seven[10] + k_seven[11] + k_seven[14] + k_seven[15] + k_seven[16] +
-                                 k_seven[17] + k_seven[21] + k_seven[22] + k_seven[23] + k_seven[28] + k_seven[29] + k_seven[35]) -
-                                (k_seven[13] + k_seven[19] + k_seven[20] + k_seven[25] + k_seven[26] + k_seven[27] + k_seven[31] +
-                                 k_seven[32] + k_seven[33] + k_seven[34] + k_seven[37] + k_seven[38] + k_seven[39] + k_seven[40] +
-                                 k_seven[41] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47] + k_seven[48]));
-
-            negative_diag = abs((k_seven[1] + k_seven[2] + k_seven[3] + k_seven[4] + k_seven[5] + k_seven[6] + k_seven[9] +
-                                 k_seven[10] + k_seven[11] + k_seven[12] + k_seven[13] + k_seven[17] + k_seven[18] + k_seven[19] +
-                                 k_seven[20] + k_seven[25] + k_seven[26] + k_seven[27] + k_seven[33] + k_seven[34] + k_seven[41]) -
-                                (k_seven[7] + k_seven[14] + k_seven[15] + k_seven[21] + k_seven[22] + k_seven[23] + k_seven[28] +
-                                 k_seven[29] + k_seven[30] + k_seven[31] + k_seven[35] + k_seven[36] + k_seven[37] + k_seven[38] +
-                                 k_seven[39] + k_seven[42] + k_seven[43] + k_seven[44] + k_seven[45] + k_seven[46] + k_seven[47]));
-
-            if(horizontal > threshold || vertical > threshold || positive_diag > threshold || negative_diag > threshold) {
-               edge_elnt++;
-               edges.image_ptr[i+1][j+1] = 0;
+         if (m > magnitude[p - step] && m >= magnitude[p + step]) {
+            if (m >= high_threshold) {
+               state[p] = CANNY_EDGE;
+               stack[top++] = p;
             }
             else
-               edges.image_ptr[i+1][j+1] = 255;
+               state[p] = CANNY_WEAK;
          }
       }
    }
-   cout << "there were: " << edge_elnt << " edge elements detected!" << endl;
 
-   Copy_Image(edges, image);
+   // Hysteresis: follow the edges through the weak pixels. The outer
+   // row and column are never weak, so the neighbours are always inside.
+   while (top > 0) {
+      int p = stack[--top];
+      int neighbours[8] = {
+         p - bitmap_width - 1, p - bitmap_width, p - bitmap_width + 1,
+         p - 1, p + 1,
+         p + bitmap_width - 1, p + bitmap_width, p + bitmap_width + 1
+      };
+
+      for (int n = 0; n < 8; n++) {
+         if (state[neighbours[n]] == CANNY_WEAK) {
+            state[neighbours[n]] = CANNY_EDGE;
+            stack[top++] = neighbours[n];
+         }
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Canny_detect_egdes
+
+   INPUTS
+   image          - Pointer to a bitmap image
+   edges          - Pointer to an image of the same size that receives the edges
+   low_threshold  - Gradient needed to continue an edge
+   high_threshold - Gradient needed to start an edge
+
+   DESCRIPTION
+   Finds the Sobel gradient of every pixel, as |gx| + |gy|, and keeps
+   only the pixels whose gradient is at least low_threshold and is a
+   maximum along the gradient direction. Those reaching high_threshold
+   start edges, which are followed through the remaining pixels that
+   touch them, including diagonally, using an explicit stack.
+
+   Edge pixels are set to BLACK and all others, including the outer
+   row and column, to WHITE.
 
-   Remove_Image(edges);
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Canny_detect_egdes(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges,
+                        int low_threshold, int high_threshold) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   byte_t *state = arena.Allocate_Array<byte_t>((size_t)bitmap_height * bitmap_width);
+
+   Canny_States(image, low_threshold, high_threshold, state);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      byte_t *s = state + (size_t)i * bitmap_width;
+      byte_t *out = edges.image_ptr[i];
+
+      for (int j = 0; j < bitmap_width; j++) {
+         out[j] = s[j] == CANNY_EDGE ? BLACK : WHITE;
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Canny_Edge_Runs
+
+   INPUTS
+   image          - Pointer to a bitmap image
+   low_threshold  - Gradient needed to continue an edge
+   high_threshold - Gradient needed to start an edge
+   runs           - Receives the runs of edge elements
+
+   DESCRIPTION
+   Same as Canny_detect_egdes, but hands the edges on as runs instead
+   of an edge map.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Canny_Edge_Runs(bmpBITMAP_FILE &image, int low_threshold, int high_threshold, Edge_Runs &runs) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   byte_t *state = arena.Allocate_Array<byte_t>((size_t)bitmap_height * bitmap_width);
+
+   Canny_States(image, low_threshold, high_threshold, state);
+   Encode_Runs(state, bitmap_width, bitmap_height, CANNY_EDGE, runs);
 }
 
 
 // The following are helper functions for Thin_Edges.
 // Thus, they should be thought of as "private".
-bool Identical (bmpBITMAP_FILE &a, bmpBITMAP_FILE &b) {
+static bool Identical (bmpBITMAP_FILE &a, bmpBITMAP_FILE &b) {
    int height = Assemble_Integer(a.info_header.biHeight);
    int width  = Assemble_Integer(b.info_header.biWidth);
    height--;
@@ -462,35 +1644,35 @@ bool Identical (bmpBITMAP_FILE &a, bmpBITMAP_FILE &b) {
    return true;
 }
 
-bool Lower (bmpBITMAP_FILE &im, int i, int j) {
+static bool Lower (bmpBITMAP_FILE &im, int i, int j) {
    if ((im.image_ptr[i][j] == BLACK) && (im.image_ptr[i][j-1] == WHITE)) {
       return true;
    }
    return false;
 }
 
-bool Upper (bmpBITMAP_FILE &im, int i, int j) {
+static bool Upper (bmpBITMAP_FILE &im, int i, int j) {
    if ((im.image_ptr[i][j] == BLACK) && (im.image_ptr[i][j+1] == WHITE)) {
       return true;
    }
    return false;
 }
 
-bool Left (bmpBITMAP_FILE &im, int i, int j) {
+static bool Left (bmpBITMAP_FILE &im, int i, int j) {
    if ((im.image_ptr[i][j] == BLACK) && (im.image_ptr[i-1][j] == WHITE)) {
       return true;
    }
    return false;
 }
 
-bool Right (bmpBITMAP_FILE &im, int i, int j) {
+static bool Right (bmpBITMAP_FILE &im, int i, int j) {
    if ((im.image_ptr[i][j] == BLACK) && (im.image_ptr[i+1][j] == WHITE)) {
       return true;
    }
    return false;
 }
 
-bool a1 (bmpBITMAP_FILE &im, int i, int j) {
+static bool a1 (bmpBITMAP_FILE &im, int i, int j) {
    bool above;
    bool with;
    bool below;
@@ -507,7 +1689,7 @@ bool a1 (bmpBITMAP_FILE &im, int i, int j) {
    return (above && with && below);
 }
 
-bool a2 (bmpBITMAP_FILE &im, int i, int j) {
+static bool a2 (bmpBITMAP_FILE &im, int i, int j) {
    bool left;
    bool with;
    bool right;
@@ -524,7 +1706,7 @@ bool a2 (bmpBITMAP_FILE &im, int i, int j) {
    return (left && with && right);
 }
 
-bool a3 (bmpBITMAP_FILE &im, int i, int j) {
+static bool a3 (bmpBITMAP_FILE &im, int i, int j) {
    bool ll;
    bool with;
    bool ur;
@@ -540,7 +1722,7 @@ bool a3 (bmpBITMAP_FILE &im, int i, int j) {
    return (ll && with && ur);
 }
 
-bool a4 (bmpBITMAP_FILE &im, int i, int j) {
+static bool a4 (bmpBITMAP_FILE &im, int i, int j) {
    bool ul;
    bool with;
    bool lr;
@@ -556,11 +1738,11 @@ bool a4 (bmpBITMAP_FILE &im, int i, int j) {
    return (ul && with && lr);
 }
 
-bool IsAnA (bmpBITMAP_FILE &im, int i, int j) {
+static bool IsAnA (bmpBITMAP_FILE &im, int i, int j) {
    return ( a1(im,i,j) || a2(im,i,j) || a3(im,i,j) || a4(im,i,j));
 }
 
-bool b1 (bmpBITMAP_FILE &im, int i, int j) {
+static bool b1 (bmpBITMAP_FILE &im, int i, int j) {
    bool above;
    bool with;
    above = ((im.image_ptr[i-1][j+1] == BLACK) ||
@@ -573,7 +1755,7 @@ bool b1 (bmpBITMAP_FILE &im, int i, int j) {
    return (above && with);
 }
 
-bool b2 (bmpBITMAP_FILE &im, int i, int j) {
+static bool b2 (bmpBITMAP_FILE &im, int i, int j) {
    bool left;
    bool with;
    left = ((im.image_ptr[i-1][j-1] == BLACK) ||
@@ -586,7 +1768,7 @@ bool b2 (bmpBITMAP_FILE &im, int i, int j) {
    return (left && with);
 }
 
-bool b3 (bmpBITMAP_FILE &im, int i, int j) {
+static bool b3 (bmpBITMAP_FILE &im, int i, int j) {
    bool below;
    bool with;
    below = ((im.image_ptr[i-1][j-1] == BLACK) ||
@@ -599,7 +1781,7 @@ bool b3 (bmpBITMAP_FILE &im, int i, int j) {
    return (below && with);
 }
 
-bool b4 (bmpBITMAP_FILE &im, int i, int j) {
+static bool b4 (bmpBITMAP_FILE &im, int i, int j) {
    bool right;
    bool with;
    right = ((im.image_ptr[i+1][j-1] == BLACK) ||
@@ -635,22 +1817,29 @@ void Thin_Edges (bmpBITMAP_FILE &image) {
    int counter = 0;
    int cycle = 0;
 
-   // Readjust height and width so they stay within bounds
-   height--;
-   width--;
+   // The scratch images come from the arena and are released on return
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
 
    // Initialize the images
-   Copy_Image(image, contour_points);
-   Copy_Image(image, final_points);
+   Arena_Image(arena, image, check_image);
+   Arena_Image(arena, image, contour_points);
+   Arena_Image(arena, image, final_points);
 
    // Set the final_points and contour_points image to all white
-   Change_Brightness(final_points, WHITE);
-   Change_Brightness(contour_points, WHITE);
+   memset(final_points.image_ptr[0], WHITE, (size_t)height * width);
+   memset(contour_points.image_ptr[0], WHITE, (size_t)height * width);
+
+   // Readjust height and width so they stay within bounds
+   height--;
+   width--;
 
    // Start the thin loop
    do {
       if (cycle == 0) {
-         Copy_Image(image, check_image);
+         for (int i = 0; i <= height; i++) {
+            memcpy(check_image.image_ptr[i], image.image_ptr[i], width + 1);
+         }
       }
 
       // Find final points in the image
@@ -717,9 +1906,176 @@ void Thin_Edges (bmpBITMAP_FILE &image) {
    cout << "Thinning went through " << counter << " iterations" << endl;
 
    // At this point, the original image has been thinned. return.
-   Remove_Image(final_points);
-   Remove_Image(contour_points);
-   Remove_Image(check_image);
+}
+
+/*------------------------------------------------------------
+   Thin_Edges
+
+   INPUTS
+   image     - Pointer to an image object
+   algorithm - THIN_STEINFELD_ROSENFELD or THIN_ZHANG_SUEN
+
+   DESCRIPTION
+   Thins the lines in the image with the chosen algorithm, so that
+   their results and speed can be compared.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Thin_Edges (bmpBITMAP_FILE &image, Thinning_Algorithm algorithm) {
+
+   if (algorithm == THIN_ZHANG_SUEN)
+      Zhang_Suen_Thin_Edges(image);
+   else
+      Thin_Edges(image);
+}
+
+// One subiteration of Zhang-Suen over rows [begin, end) of a 0/1 image.
+// Reads from src only and writes dst, so rows can be done in any order.
+// The first subiteration removes south-east boundary and north-west
+// corner points, the second north-west boundary and south-east corner
+// points. Returns the number of pixels removed.
+static long Zhang_Suen_Rows(const byte_t *src, byte_t *dst, int width,
+                            int begin, int end, int subiteration) {
+   long removed = 0;
+
+   for (int i = begin; i < end; i++) {
+      const byte_t *up   = src + (size_t)(i - 1) * width;
+      const byte_t *row  = src + (size_t)i * width;
+      const byte_t *down = src + (size_t)(i + 1) * width;
+      byte_t *out = dst + (size_t)i * width;
+      int row_removed = 0;
+
+      // No branches on the pixels, so the loop vectorizes
+      for (int j = 1; j < width - 1; j++) {
+         int p2 = up[j],     p3 = up[j + 1],   p4 = row[j + 1], p5 = down[j + 1];
+         int p6 = down[j],   p7 = down[j - 1], p8 = row[j - 1], p9 = up[j - 1];
+
+         int black = p2 + p3 + p4 + p5 + p6 + p7 + p8 + p9;
+         int transitions = ((p2 ^ 1) & p3) + ((p3 ^ 1) & p4) + ((p4 ^ 1) & p5) +
+                           ((p5 ^ 1) & p6) + ((p6 ^ 1) & p7) + ((p7 ^ 1) & p8) +
+                           ((p8 ^ 1) & p9) + ((p9 ^ 1) & p2);
+         int first  = subiteration == 0 ? p2 & p4 & p6 : p2 & p4 & p8;
+         int second = subiteration == 0 ? p4 & p6 & p8 : p2 & p6 & p8;
+
+         int remove = row[j] & (black >= 2) & (black <= 6) & (transitions == 1) &
+                      (first ^ 1) & (second ^ 1);
+
+         out[j] = row[j] & (remove ^ 1);
+         row_removed += remove;
+      }
+      removed += row_removed;
+   }
+
+   return removed;
+}
+
+// Thins the BLACK lines of image with Zhang-Suen, see below. Returns a
+// width * height array from the arena, set to 1 for the edge elements
+// that remain and 0 elsewhere.
+static byte_t *Zhang_Suen_Mask(bmpBITMAP_FILE &image, Frame_Arena &arena) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   size_t pixels = (size_t)height * width;
+
+   // 1 for BLACK and 0 for everything else
+   byte_t *src = arena.Allocate_Array<byte_t>(pixels);
+   byte_t *dst = arena.Allocate_Array<byte_t>(pixels);
+
+   for (int i = 0; i < height; i++) {
+      byte_t *in = image.image_ptr[i];
+      byte_t *out = src + (size_t)i * width;
+
+      for (int j = 0; j < width; j++) {
+         out[j] = in[j] == BLACK;
+      }
+   }
+   memcpy(dst, src, pixels);
+
+   Thread_Pool &pool = Shared_Thread_Pool();
+   long removed;
+
+   do {
+      removed = 0;
+
+      for (int subiteration = 0; subiteration < 2; subiteration++) {
+         atomic<long> count(0);
+
+         pool.Parallel_For(1, height - 1, [&](int begin, int end) {
+            count += Zhang_Suen_Rows(src, dst, width, begin, end, subiteration);
+         }, 16);
+
+         removed += count;
+         swap(src, dst);
+      }
+   } while (removed > 0);
+
+   return src;
+}
+
+/*------------------------------------------------------------
+   Zhang_Suen_Thin_Edges
+
+   INPUTS
+   image - Pointer to an image object
+
+   DESCRIPTION
+   Thins the black lines in the image to one pixel wide with the
+   parallel algorithm of Zhang and Suen. Unlike Thin_Edges, every
+   subiteration decides from the previous one's result only, so the
+   rows are split over the shared thread pool. Pixels that are not
+   BLACK are treated as background and set to WHITE; the outer row
+   and column are only converted.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Zhang_Suen_Thin_Edges (bmpBITMAP_FILE &image) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   byte_t *thinned = Zhang_Suen_Mask(image, arena);
+
+   for (int i = 0; i < height; i++) {
+      byte_t *in = thinned + (size_t)i * width;
+      byte_t *out = image.image_ptr[i];
+
+      for (int j = 0; j < width; j++) {
+         out[j] = in[j] ? BLACK : WHITE;
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Zhang_Suen_Thin_Edges
+
+   INPUTS
+   image - Pointer to an image object
+   runs  - Receives the runs of the thinned edge elements
+
+   DESCRIPTION
+   Same as above, but leaves image alone and hands the thinned edges
+   on as runs.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Zhang_Suen_Thin_Edges (bmpBITMAP_FILE &image, Edge_Runs &runs) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   byte_t *thinned = Zhang_Suen_Mask(image, arena);
+
+   Encode_Runs(thinned, width, height, 1, runs);
 }
 
 
@@ -761,626 +2117,661 @@ int _check_horizontal(bmpBITMAP_FILE &image, int a, int b, int j) {
          This scenario would pass, and the line would be drawn.
 
    bool - Show/hide window outline
+   int - Number of line directions to look for, 8, 16 or 32
+   Hough_Tiling - Separate windows, or overlapping ones whose lines are
+                  joined across the window borders
 
    DESCRIPTION
-   Scans the image looking for large differences in pixel value. if the
-   difference is larger than the threshold (parameter) then an edge element will
-   be marked with black. All other pizels will be colored white.
+   Divides the image into windows and looks for the lines that most of
+   the edge elements of each window lie on, see Hough_Window. Those
+   lines are drawn in black on white.
 
    RETURNS
    Nothing
 -------------------------------------------------------------*/
-void Hough_transform(bmpBITMAP_FILE &image, int reduction, int window, int std_dev_threshold, int presence_threshold, int outline) {
+void Hough_transform(bmpBITMAP_FILE &image, int reduction, int window, int std_dev_threshold, int presence_threshold, int outline, int directions, Hough_Tiling tiling) {
 
-   int bitmap_width;
-   int bitmap_height;
-   int compare_val;
-   int horizontals;
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   bmpBITMAP_FILE final_edges;
+
+   Arena_Image(arena, image, final_edges);
+   Hough_transform(image, final_edges, reduction, window, std_dev_threshold, presence_threshold, outline, directions, tiling);
+
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(final_edges, image);
+}
+
+/*------------------------------------------------------------
+   Hough_Edges
+
+   INPUTS
+   Same as Hough_transform
+
+   DESCRIPTION
+   Same as Hough_transform, but leaves image alone.
+
+   RETURNS
+   A new image holding the lines that were found
+-------------------------------------------------------------*/
+Image Hough_Edges(bmpBITMAP_FILE &image, int reduction, int window, int std_dev_threshold, int presence_threshold, int outline, int directions, Hough_Tiling tiling) {
+
+   Image final_edges = Image::Same_Format(image);
+
+   Hough_transform(image, final_edges, reduction, window, std_dev_threshold, presence_threshold, outline, directions, tiling);
+
+   return final_edges;
+}
+
+// The 16 directions, in the order of the histogram drawn in Hough_Window.
+// Lines are only followed from pixels at least min_rows below the top
+// of the window; that only limits the vertical direction, the others
+// run out of window first.
+static const Hough_Direction hough_directions_16[16] = {
+   {-2, 0, 0},   // 0 degrees
+   {-4, 1, 1},   // ~11.25 degrees
+   {-3, 1, 1},   // ~22.5 degrees
+   {-2, 1, 1},   // ~33.75 degrees
+   {-2, 2, 1},   // 45 degrees
+   {-1, 2, 2},   // ~56.25 degrees
+   {-1, 3, 3},   // ~67.5 degrees
+   {-1, 4, 4},   // ~78.75 degrees
+   { 0, 2, 4},   // 90 degrees
+   { 1, 4, 4},   // ~101.25 degrees
+   { 1, 3, 3},   // ~112.5 degrees
+   { 1, 2, 2},   // ~123.75 degrees
+   { 2, 2, 1},   // 135 degrees
+   { 2, 1, 1},   // ~146.25 degrees
+   { 3, 1, 1},   // ~157.5 degrees
+   { 4, 1, 1}    // ~168.75 degrees
+};
+
+/*------------------------------------------------------------
+   Hough_Direction_Table
+
+   INPUTS
+   directions - Number of directions wanted, 8, 16 or 32. Other
+                counts are rounded up to one of those.
+   table      - Receives the directions, from 0 degrees up to 180
+
+   DESCRIPTION
+   8 directions are every other one of the 16. The 32 put a direction
+   between each pair of the 16 whose step is the sum of theirs, which
+   always lies between them, and after the last one a step between it
+   and 180 degrees.
+
+   RETURNS
+   The number of directions in the table
+-------------------------------------------------------------*/
+int Hough_Direction_Table(int directions, Hough_Direction *table) {
+
+   if (directions <= 8) {
+      for (int d = 0; d < 8; d++) {
+         table[d] = hough_directions_16[2 * d];
+      }
+      return 8;
+   }
+
+   if (directions <= 16) {
+      for (int d = 0; d < 16; d++) {
+         table[d] = hough_directions_16[d];
+      }
+      return 16;
+   }
+
+   for (int d = 0; d < 16; d++) {
+      const Hough_Direction &here = hough_directions_16[d];
+      Hough_Direction next = hough_directions_16[(d + 1) % 16];
+      Hough_Direction between;
+
+      // 180 degrees is 0 degrees looking the other way
+      if (d == 15)
+         next.dx = -next.dx;
+
+      between.dx       = here.dx + next.dx;
+      between.dy       = here.dy + next.dy;
+      between.min_rows = max(here.min_rows, next.min_rows);
+
+      table[2 * d]     = here;
+      table[2 * d + 1] = between;
+   }
+   return 32;
+}
+
+// Number of steps along direction from (a, b) that stay inside the
+// window width columns wide whose top left corner is (i, j). Every
+// direction steps towards row i, never away from it, so the height of
+// the window does not limit them.
+static int Hough_Steps(const Hough_Direction &direction, int a, int b, int i, int j, int width) {
+   int steps = width;
+
+   if (direction.dx < 0)
+      steps = (b - j - 1) / -direction.dx;
+   else if (direction.dx > 0)
+      steps = (j + width - 1 - b) / direction.dx;
+
+   if (direction.dy > 0)
+      steps = min(steps, (a - i - 1) / direction.dy);
+
+   return steps;
+}
+
+// Marks a direction that was not followed from a pixel
+const unsigned short HOUGH_NOT_FOLLOWED = 0xFFFF;
+
+// The measurements of one window's histogram, kept for the trace
+struct Hough_Window_Stats {
+   int histogram[HOUGH_MAX_DIRECTIONS];
+   int threshold;
+   long std_dev;
+};
+
+// Measures a window's hough_histogram. Returns the threshold that a
+// direction's count has to pass to be drawn, and sets std_dev to the
+// standard deviation of the counts.
+static int Hough_Threshold(const int *hough_histogram, int count, int reduction, long &std_dev) {
+   long average = 0;
+   long intermediate;
    int threshold;
-   int x_inc;
-   int y_inc;
-   int hough_histogram[16] = {0};
 
-   bmpBITMAP_FILE final_edges;
+   for (int d = 0; d < count; d++) {
+      average += hough_histogram[d];
+   }
+   average = average/count;
 
-   Copy_Image(image, final_edges);
+   std_dev = 0;
+   for (int d = 0; d < count; d++) {
+      intermediate = hough_histogram[d] - average;
+      std_dev += intermediate * intermediate;
+   }
+   std_dev = sqrt(std_dev/count);
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   threshold = hough_histogram[0];
+   for (int d = 1; d < count; d++) {
+      if (hough_histogram[d] > threshold) {
+         threshold = hough_histogram[d];
+      }
+   }
 
-   for (int i = 0; i < bitmap_height; i++) {
-      for (int j = 0; j < bitmap_width; j++) {
-         final_edges.image_ptr[i][j] = 255;
-      }
-   }
-
-   // Create Hough Histogram
-   // It is setup currently to check for 16 different degrees of angles:
-   // We are checking for lines that would be drawn from + to *
-   //
-   //                      * | *
-   //                      * | *
-   //                    * * * * *
-   //                * * *   |   * * *
-   //          - - - - - - - + - * - - - - -
-   //                        |
-   //
-   // The histogram is represented correspondingly:
-   // hough_histogram[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15]
-   //
-   //                      9 | 7
-   //                     10 | 6
-   //                   1211 8 5 4
-   //               151413   |   3 2 1
-   //          - - - - - - - + - 0 - - - - -
-   //                        |
-
-   for (int i = 0; i < bitmap_height-window; i += window) {
-      for (int j = 0; j < bitmap_width-window; j += window) {
-
-         for(int a = i; a < i+window; a++) {
-            for(int b = j; b < j+window; b++) {
-               if(int(image.image_ptr[a][b]) == 0) {
-
-                  // Check for horizontal (0 degree) lines
-                  x_inc = 2;
-                  while(b-x_inc > j) {
-                     if(int(image.image_ptr[a][b-x_inc]) == 0) { hough_histogram[0]++; }
-                     x_inc += 2;
-                  }
-
-                  if(a-1 >= i){
-
-                     // Check for (~11.25 degree) lines
-                     x_inc = 4;
-                     y_inc = 1;
-                     while(b-x_inc > j && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[1]++; }
-                        x_inc += 4;
-                        y_inc++;
-                     }
-
-                     // Check for (~22.5 degree) lines
-                     x_inc = 3;
-                     y_inc = 1;
-                     while(b-x_inc > j && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[2]++; }
-                        x_inc += 3;
-                        y_inc++;
-                     }
-
-                     // Check for (~33.75 degree) lines
-                     x_inc = 2;
-                     y_inc = 1;
-                     while(b-x_inc > j && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[3]++; }
-                        x_inc += 2;
-                        y_inc++;
-                     }
-
-                     // Check for (45 degree) lines
-                     x_inc = 2;
-                     y_inc = 2;
-                     while(b-x_inc > j && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[4]++; }
-                        x_inc += 2;
-                        y_inc += 2;
-                     }
-
-                     if(a-2 >= i){
-
-                        // Check for (~56.25 degree) lines
-                        x_inc = 1;
-                        y_inc = 2;
-                        while(b-x_inc > j && a-y_inc > i) {
-                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[5]++; }
-                           x_inc++;
-                           y_inc += 2;
-                        }
-
-                        if(a-3 >= i){
-
-                           // Check for (~67.5 degree) lines
-                           x_inc = 1;
-                           y_inc = 3;
-                           while(b-x_inc > j && a-y_inc > i) {
-                              if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[6]++; }
-                              x_inc++;
-                              y_inc += 3;
-                           }
-
-                           if(a-4 >= i){
-
-                              // Check for (~78.75 degree) lines
-                              x_inc = 1;
-                              y_inc = 4;
-                              while(b-x_inc > j && a-y_inc > i) {
-                                 if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[7]++; }
-                                 x_inc++;
-                                 y_inc += 4;
-                              }
-
-                              // Check for (90 degree) lines
-                              y_inc = 2;
-                              while(a-y_inc > i) {
-                                 if(int(image.image_ptr[a-y_inc][b]) == 0) { hough_histogram[8]++; }
-                                 y_inc += 2;
-                              }
-
-                              // Check for (~101.25 degree) lines
-                              x_inc = 1;
-                              y_inc = 4;
-                              while(b+x_inc < j+window && a-y_inc > i) {
-                                 if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[9]++; }
-                                 x_inc++;
-                                 y_inc += 4;
-                              }
-                           }
-
-                           // Check for (~112.5 degree) lines
-                           x_inc = 1;
-                           y_inc = 3;
-                           while(b+x_inc < j+window && a-y_inc > i) {
-                              if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[10]++; }
-                              x_inc++;
-                              y_inc += 3;
-                           }
-                        }
-
-                        // Check for (~123.75 degree) lines
-                        x_inc = 1;
-                        y_inc = 2;
-                        while(b+x_inc < j+window && a-y_inc > i) {
-                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[11]++; }
-                           x_inc++;
-                           y_inc += 2;
-                        }
-                     }
-
-                     // Check for (135 degree) lines
-                     x_inc = 2;
-                     y_inc = 2;
-                     while(b+x_inc < j+window && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[12]++; }
-                        x_inc += 2;
-                        y_inc += 2;
-                     }
-
-                     // Check for (~146.25 degree) lines
-                     x_inc = 2;
-                     y_inc = 1;
-                     while(b+x_inc < j+window && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[13]++; }
-                        x_inc += 2;
-                        y_inc++;
-                     }
-
-                     // Check for (~157.5 degree) lines
-                     x_inc = 3;
-                     y_inc = 1;
-                     while(b+x_inc < j+window && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[14]++; }
-                        x_inc += 3;
-                        y_inc++;
-                     }
-
-                     // Check for (~168.75 degree) lines
-                     x_inc = 4;
-                     y_inc = 1;
-                     while(b+x_inc < j+window && a-y_inc > i) {
-                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[15]++; }
-                        x_inc += 4;
-                        y_inc++;
-                     }
-                  }
+   return threshold - reduction;
+}
+
+// Whether Hough_transform draws the snap shot outline of, and traces,
+// the window at (i, j)
+static bool Hough_Snapshot_Window(int i, int j) {
+   return j > 400 && j < 500 && i > 400 && i < 500;
+}
+
+/*------------------------------------------------------------
+   Hough_Window
+
+   INPUTS
+   image       - Pointer to a bitmap image
+   final_edges - Pointer to the image that receives the lines
+   i, j        - Top left corner of the window
+   window      - Size of the window
+   table       - The directions to look along, and their count
+   arena       - Arena for the window's temporaries
+   stats       - Receives the histogram and its measurements, if not null
+   The rest are the same as Hough_transform
+
+   DESCRIPTION
+   From every edge element in the window, counts the edge elements on
+   the line in each direction back towards the top of the window. The
+   counts of every direction are added up into the window's histogram:
+
+                      9 | 7
+                     10 | 6
+                   1211 8 5 4
+               151413   |   3 2 1
+          - - - - - - - + - 0 - - - - -
+                        |
+
+   If the histogram is uneven enough (its standard deviation is over
+   std_dev_threshold), every line from an edge element whose direction
+   is within reduction of the strongest direction and whose own count
+   is over presence_threshold is drawn. The count of each line is kept
+   from the first pass, so no line is followed twice to find it.
+
+   Only pixels of the window are read or written, so windows may be
+   processed at the same time.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+static void Hough_Window(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges, int i, int j,
+                         int window, int reduction, int std_dev_threshold, int presence_threshold,
+                         int outline, const Hough_Direction *table, int count, Frame_Arena &arena,
+                         Hough_Window_Stats *stats) {
+
+   Arena_Scope scratch(arena);
+
+   // The edge elements of the window and the count of each of their lines
+   int *rows    = arena.Allocate_Array<int>(window * window);
+   int *columns = arena.Allocate_Array<int>(window * window);
+   unsigned short *presence = arena.Allocate_Array<unsigned short>(window * window * count);
+   int elements = 0;
+   int hough_histogram[HOUGH_MAX_DIRECTIONS] = {0};
+
+   for (int a = i; a < i+window; a++) {
+      for (int b = j; b < j+window; b++) {
+         unsigned short *counts = presence + elements * count;
+
+         if (image.image_ptr[a][b] != 0)
+            continue;
+
+         for (int d = 0; d < count; d++) {
+            const Hough_Direction &direction = table[d];
+            int steps = Hough_Steps(direction, a, b, i, j, window);
+            int found = 0;
+
+            if (a - i < direction.min_rows) {
+               counts[d] = HOUGH_NOT_FOLLOWED;
+               continue;
+            }
+
+            for (int k = 1; k <= steps; k++) {
+               found += image.image_ptr[a - k * direction.dy][b + k * direction.dx] == 0;
+            }
+
+            counts[d] = found;
+            hough_histogram[d] += found;
+         }
+
+         rows[elements]    = a;
+         columns[elements] = b;
+         elements++;
+      }
+   }
+
+   // Measurements of the hough_histogram
+   long std_dev;
+   int threshold = Hough_Threshold(hough_histogram, count, reduction, std_dev);
+
+   if (std_dev > std_dev_threshold) {
+      for (int e = 0; e < elements; e++) {
+         unsigned short *counts = presence + e * count;
+         int a = rows[e];
+         int b = columns[e];
+
+         for (int d = 0; d < count; d++) {
+            const Hough_Direction &direction = table[d];
+            int present;
+
+            if (counts[d] == HOUGH_NOT_FOLLOWED)
+               continue;
+
+            // Directions that are not strong enough have no presence
+            present = hough_histogram[d] > threshold ? counts[d] : 0;
+
+            // If presence passes threshold, draw line. (Example in POD)
+            if (present > presence_threshold) {
+               int steps = Hough_Steps(direction, a, b, i, j, window);
+
+               for (int k = 1; k <= steps; k++) {
+                  final_edges.image_ptr[a - k * direction.dy][b + k * direction.dx] = 0;
                }
             }
          }
+      }
 
-         // Measurements of the hough_histogram
-         long average = 0;
-         long std_dev = 0;
-         long intermediate;
+      // Optional parameter allows the outline of the window to be printed out
+      if (outline) {
+         for (int a = i; a < i+window; a++) {
+            for (int b = j; b < j+window; b++) {
+               if (a == i+window-1 || a == i || b == j+window-1 || b == j) {
+                  final_edges.image_ptr[a][b] = 0;
+               }
+            }
+         }
+      }
+   }
 
-         // Find average
-         for(int ic = 0; ic < 16; ic++) {
-            average += hough_histogram[ic];
+   // The snap shot window is outlined again, a little inside the first
+   if (outline && Hough_Snapshot_Window(i, j)) {
+      for (int a = i; a < i+window; a++) {
+         for (int b = j; b < j+window; b++) {
+            if (a == i+window-3 || a == i || b == j+window-3 || b == j) {
+               final_edges.image_ptr[a][b] = 0;
+            }
          }
+      }
+   }
+
+   if (stats) {
+      for (int d = 0; d < count; d++) {
+         stats->histogram[d] = hough_histogram[d];
+      }
+      stats->threshold = threshold;
+      stats->std_dev   = std_dev;
+   }
+}
+
+// The cells of the overlapping mode, see Hough_Overlapping
+struct Hough_Cells {
+   int size;
+   int rows;
+   int columns;
+   int *histograms;          // count directions for each cell
+   unsigned int *accepted;   // Bit d is set where direction d is drawn
+};
+
+// Adds up the histogram of cell (r, c), counting the edge elements on
+// the lines from each of its edge elements that stay inside the cell
+static void Hough_Cell_Histogram(bmpBITMAP_FILE &image, Hough_Cells &cells, int r, int c,
+                                 int height, int width, const Hough_Direction *table, int count) {
+   int top    = r * cells.size;
+   int left   = c * cells.size;
+   int bottom = min(top + cells.size, height);
+   int right  = min(left + cells.size, width);
+   int *hough_histogram = cells.histograms + ((size_t)r * cells.columns + c) * count;
+
+   for (int d = 0; d < count; d++) {
+      hough_histogram[d] = 0;
+   }
 
-         average = average/16;
+   for (int a = top; a < bottom; a++) {
+      for (int b = left; b < right; b++) {
+         if (image.image_ptr[a][b] != 0)
+            continue;
 
-         // Find standard deviation
-         for(int ic = 0; ic < 16; ic++) {
-            intermediate = hough_histogram[ic] - average;
-            std_dev += pow(intermediate,2);
+         for (int d = 0; d < count; d++) {
+            const Hough_Direction &direction = table[d];
+            int steps = Hough_Steps(direction, a, b, top, left, right - left);
+
+            if (a - top < direction.min_rows)
+               continue;
+
+            for (int k = 1; k <= steps; k++) {
+               hough_histogram[d] += image.image_ptr[a - k * direction.dy][b + k * direction.dx] == 0;
+            }
          }
+      }
+   }
+}
+
+// Follows direction from (a, b) through the cells that accept it, at
+// most into the cell row above and the cell columns either side of the
+// one (a, b) is in. Returns the number of steps taken and sets presence
+// to the edge elements met on the way.
+static int Hough_Stitched_Steps(bmpBITMAP_FILE &image, const Hough_Cells &cells,
+                                const Hough_Direction &direction, unsigned int bit,
+                                int a, int b, int width, int &presence) {
+   int r = a / cells.size;
+   int c = b / cells.size;
+   int top   = max(r - 1, 0) * cells.size;
+   int left  = max(c - 1, 0) * cells.size;
+   int right = min((c + 2) * cells.size, width);
+   int steps = 0;
+
+   presence = 0;
+
+   for (int k = 1; ; k++) {
+      int y = a - k * direction.dy;
+      int x = b + k * direction.dx;
+
+      if (y < top || x < left || x >= right)
+         break;
+      if (!(cells.accepted[(y / cells.size) * cells.columns + x / cells.size] & bit))
+         break;
+
+      presence += image.image_ptr[y][x] == 0;
+      steps = k;
+   }
+
+   return steps;
+}
+
+// Draws the stitched lines from the edge elements of cell row r
+static void Hough_Stitch_Row(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges,
+                             const Hough_Cells &cells, int r, int height, int width,
+                             int presence_threshold, const Hough_Direction *table, int count) {
+   int top    = r * cells.size;
+   int bottom = min(top + cells.size, height);
+
+   for (int a = top; a < bottom; a++) {
+      for (int b = 0; b < width; b++) {
+         unsigned int accepted;
+
+         if (image.image_ptr[a][b] != 0)
+            continue;
 
-         std_dev = sqrt(std_dev/16);
+         accepted = cells.accepted[r * cells.columns + b / cells.size];
 
-         threshold = hough_histogram[0];
+         for (int d = 0; accepted && d < count; d++) {
+            const Hough_Direction &direction = table[d];
+            unsigned int bit = 1u << d;
+            int presence;
+            int steps;
 
-         for(int ic = 1; ic < 16; ic++) {
-            if(hough_histogram[ic] > threshold) {
-               threshold = hough_histogram[ic];
+            if (!(accepted & bit))
+               continue;
+
+            steps = Hough_Stitched_Steps(image, cells, direction, bit, a, b, width, presence);
+
+            if (presence > presence_threshold) {
+               for (int k = 1; k <= steps; k++) {
+                  final_edges.image_ptr[a - k * direction.dy][b + k * direction.dx] = 0;
+               }
             }
          }
+      }
+   }
+}
+
+/*------------------------------------------------------------
+   Hough_Overlapping
 
-         threshold -= reduction;
-
-         int presence;
-         if(std_dev > std_dev_threshold) {
-
-            for(int a = i; a < i+window; a++) {
-               for(int b = j; b < j+window; b++) {
-                  if(int(image.image_ptr[a][b]) == 0) {
-
-                     // Write in horizontal (0 degree) lines
-                     x_inc = 2;
-                     presence = 0;
-
-                     // First measure presence
-                     while(b-x_inc > j && hough_histogram[0] > threshold) {
-                        if(int(image.image_ptr[a][b-x_inc]) == 0) { presence++; }
-                        x_inc += 2;
-                     }
-
-                     // If presence passes threshold, draw line. (Example in POD)
-                     if(presence > presence_threshold) {
-                        x_inc = 2;
-                        while(b-x_inc > j) {
-                           final_edges.image_ptr[a][b-x_inc] = 0;
-                           x_inc += 2;
-                        }
-                     }
-
-                     if(a-1 >= i) {
-
-                        // Write in (~11.25 degree) lines
-                        x_inc = 4;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b-x_inc > j && a-y_inc > i && hough_histogram[1] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                           x_inc += 4;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 4;
-                           y_inc = 1;
-                           while(b-x_inc > j && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                              x_inc += 4;
-                              y_inc++;
-                           }
-                        }
-
-                        // Write in (~22.5 degree) lines
-                        x_inc = 3;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b-x_inc > j && a-y_inc > i && hough_histogram[2] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                           x_inc += 3;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 3;
-                           y_inc = 1;
-                           while(b-x_inc > j && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                              x_inc += 3;
-                              y_inc++;
-                           }
-                        }
-
-                        // Write in (~33.75 degree) lines
-                        x_inc = 2;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b-x_inc > j && a-y_inc > i && hough_histogram[3] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                           x_inc += 2;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 2;
-                           y_inc = 1;
-                           while(b-x_inc > j && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                              x_inc += 2;
-                              y_inc++;
-                           }
-                        }
-
-                        // Write in (45 degree) lines
-                        x_inc = 2;
-                        y_inc = 2;
-                        presence = 0;
-                        while(b-x_inc > j && a-y_inc > i && hough_histogram[4] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                           x_inc += 2;
-                           y_inc += 2;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 2;
-                           y_inc = 2;
-                           while(b-x_inc > j && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                              x_inc += 2;
-                              y_inc += 2;
-                           }
-                        }
-
-                        if(a-2 >= i){
-
-                           // Write in (~56.25 degree) lines
-                           x_inc = 1;
-                           y_inc = 2;
-                           presence = 0;
-                           while(b-x_inc > j && a-y_inc > i && hough_histogram[5] > threshold) {
-                              if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                              x_inc++;
-                              y_inc += 2;
-                           }
-
-                           if(presence > presence_threshold) {
-                              x_inc = 1;
-                              y_inc = 2;
-                              while(b-x_inc > j && a-y_inc > i) {
-                                 final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                                 x_inc++;
-                                 y_inc += 2;
-                              }
-                           }
-
-                           if(a-3 >= i){
-
-                              // Write in (~67.5 degree) lines
-                              x_inc = 1;
-                              y_inc = 3;
-                              presence = 0;
-                              while(b-x_inc > j && a-y_inc > i && hough_histogram[6] > threshold) {
-                                 if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                                 x_inc++;
-                                 y_inc += 3;
-                              }
-
-                              if(presence > presence_threshold) {
-                                 x_inc = 1;
-                                 y_inc = 3;
-                                 while(b-x_inc > j && a-y_inc > i) {
-                                    final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                                    x_inc++;
-                                    y_inc += 3;
-                                 }
-                              }
-
-                              if(a-4 >= i){
-
-                                 // Write in (~78.75 degree) lines
-                                 x_inc = 1;
-                                 y_inc = 4;
-                                 presence = 0;
-                                 while(b-x_inc > j && a-y_inc > i && hough_histogram[7] > threshold) {
-                                    if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
-                                    x_inc++;
-                                    y_inc += 4;
-                                 }
-
-                                 if(presence > presence_threshold) {
-                                    x_inc = 1;
-                                    y_inc = 4;
-                                    while(b-x_inc > j && a-y_inc > i) {
-                                       final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
-                                       x_inc++;
-                                       y_inc += 4;
-                                    }
-                                 }
-
-                                 // Write in (90 degree) lines
-                                 y_inc = 2;
-                                 presence = 0;
-                                 while(a-y_inc > i && hough_histogram[8] > threshold) {
-                                    if(int(image.image_ptr[a-y_inc][b]) == 0) { presence++; }
-                                    y_inc += 2;
-                                 }
-
-                                 if(presence > presence_threshold) {
-                                    y_inc = 2;
-                                    while(a-y_inc > i) {
-                                       final_edges.image_ptr[a-y_inc][b] = 0;
-                                       y_inc += 2;
-                                    }
-                                 }
-
-                                 // Write in (~101.25 degree) lines
-                                 x_inc = 1;
-                                 y_inc = 4;
-                                 presence = 0;
-                                 while(b+x_inc < j+window && a-y_inc > i && hough_histogram[9] > threshold) {
-                                    if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                                    x_inc++;
-                                    y_inc += 4;
-                                 }
-
-                                 if(presence > presence_threshold) {
-                                    x_inc = 1;
-                                    y_inc = 4;
-                                    while(b+x_inc < j+window && a-y_inc > i) {
-                                       final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                                       x_inc++;
-                                       y_inc += 4;
-                                    }
-                                 }
-                              }
-
-                              // Write in (~112.5 degree) lines
-                              x_inc = 1;
-                              y_inc = 3;
-                              presence = 0;
-                              while(b+x_inc < j+window && a-y_inc > i && hough_histogram[10] > threshold) {
-                                 if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                                 x_inc++;
-                                 y_inc += 3;
-                              }
-
-                              if(presence > presence_threshold) {
-                                 x_inc = 1;
-                                 y_inc = 3;
-                                 while(b+x_inc < j+window && a-y_inc > i) {
-                                    final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                                    x_inc++;
-                                    y_inc += 3;
-                                 }
-                              }
-                           }
-
-                           // Write in (~123.75 degree) lines
-                           x_inc = 1;
-                           y_inc = 2;
-                           presence = 0;
-                           while(b+x_inc < j+window && a-y_inc > i && hough_histogram[11] > threshold) {
-                              if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                              x_inc++;
-                              y_inc += 2;
-                           }
-
-                           if(presence > presence_threshold) {
-                              x_inc = 1;
-                              y_inc = 2;
-                              while(b+x_inc < j+window && a-y_inc > i) {
-                                 final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                                 x_inc++;
-                                 y_inc += 2;
-                              }
-                           }
-                        }
-
-                        // Write in (135 degree) lines
-                        x_inc = 2;
-                        y_inc = 2;
-                        presence = 0;
-                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[12] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                           x_inc += 2;
-                           y_inc += 2;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 2;
-                           y_inc = 2;
-                           while(b+x_inc < j+window && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                              x_inc += 2;
-                              y_inc += 2;
-                           }
-                        }
-
-                        // Write in (~146.25 degree) lines
-                        x_inc = 2;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[13] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                           x_inc += 2;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 2;
-                           y_inc = 1;
-                           while(b+x_inc < j+window && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                              x_inc += 2;
-                              y_inc++;
-                           }
-                        }
-
-                        // Check for (~157.5 degree) lines
-                        x_inc = 3;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[14] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                           x_inc += 3;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 3;
-                           y_inc = 1;
-                           while(b+x_inc < j+window && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                              x_inc += 3;
-                              y_inc++;
-                           }
-                        }
-
-                        // Check for (~168.75 degree) lines
-                        x_inc = 4;
-                        y_inc = 1;
-                        presence = 0;
-                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[15] > threshold) {
-                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
-                           x_inc += 4;
-                           y_inc++;
-                        }
-
-                        if(presence > presence_threshold) {
-                           x_inc = 4;
-                           y_inc = 1;
-                           while(b+x_inc < j+window && a-y_inc > i) {
-                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
-                              x_inc += 4;
-                              y_inc++;
-                           }
-                        }
-                     }
-                  }
-
-                  // Optional parameter allows the outline of the window to be printed out
-                  if(outline && (a == i+window-1 || a == i || b == j+window-1 || b == j)) {
-                     final_edges.image_ptr[a][b] = 0;
-                  }
+   INPUTS
+   Same as Hough_transform, final_edges must already be WHITE
+
+   DESCRIPTION
+   The image is split into cells half a window wide, the last row and
+   column of which may be smaller, so every pixel is covered. Each
+   window is two by two cells, and the windows step by one cell, so
+   they overlap by half.
+
+   The histogram of every cell is counted once, over the lines that
+   stay inside the cell, and shared by the four windows it is part of:
+   a window's histogram is the sum of its cells'. Each window that
+   passes std_dev_threshold accepts the directions whose count passes
+   its threshold, and a cell accepts every direction that one of the
+   windows it is part of accepts.
+
+   From each edge element, the lines in the directions its cell
+   accepts are followed through neighbouring cells for as long as
+   those accept the direction too, up into the cell row above and into
+   the cell columns either side. So a line that crosses the border of
+   a window is drawn as one piece rather than stopping at the border.
+   min_rows only applies inside a cell, when counting.
+
+   The cell histograms are counted over the shared thread pool. The
+   lines of a cell row only reach the row above, so the even rows are
+   drawn in parallel and then the odd ones.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+static void Hough_Overlapping(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges, int reduction, int window,
+                              int std_dev_threshold, int presence_threshold, int outline,
+                              const Hough_Direction *table, int count) {
+
+   int bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   int bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   Thread_Pool &pool = Shared_Thread_Pool();
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   Hough_Cells cells;
+
+   cells.size    = max(window / 2, 1);
+   cells.rows    = (bitmap_height + cells.size - 1) / cells.size;
+   cells.columns = (bitmap_width + cells.size - 1) / cells.size;
+
+   int total = cells.rows * cells.columns;
+
+   cells.histograms = arena.Allocate_Array<int>((size_t)total * count);
+   cells.accepted   = arena.Allocate_Array<unsigned int>(total);
+   memset(cells.accepted, 0, total * sizeof(unsigned int));
+
+   pool.Parallel_For(0, total, [&](int begin, int end) {
+      for (int n = begin; n < end; n++) {
+         Hough_Cell_Histogram(image, cells, n / cells.columns, n % cells.columns,
+                              bitmap_height, bitmap_width, table, count);
+      }
+   });
+
+   // Windows start at every cell but the last of each row and column,
+   // unless there is only one
+   int window_rows    = max(cells.rows - 1, 1);
+   int window_columns = max(cells.columns - 1, 1);
+
+   for (int r = 0; r < window_rows; r++) {
+      for (int c = 0; c < window_columns; c++) {
+         int last_row    = min(r + 1, cells.rows - 1);
+         int last_column = min(c + 1, cells.columns - 1);
+         int hough_histogram[HOUGH_MAX_DIRECTIONS] = {0};
+         unsigned int accepted = 0;
+         long std_dev;
+         int threshold;
+
+         for (int y = r; y <= last_row; y++) {
+            for (int x = c; x <= last_column; x++) {
+               const int *cell = cells.histograms + ((size_t)y * cells.columns + x) * count;
+
+               for (int d = 0; d < count; d++) {
+                  hough_histogram[d] += cell[d];
                }
             }
+         }
+
+         threshold = Hough_Threshold(hough_histogram, count, reduction, std_dev);
+         if (std_dev <= std_dev_threshold)
+            continue;
 
+         for (int d = 0; d < count; d++) {
+            if (hough_histogram[d] > threshold)
+               accepted |= 1u << d;
          }
 
-         // Prints a snap shot of one window of the image.
-         // The snap shot will include the number of edge elements that voted for each line,
-         // the estabilshed threshold for this window, and the standard deviation of the
-         // hough_histogram for this window.
-         if(j > 400 && j < 500 && i > 400 && i < 500) {
-
-            for(int a = i; a < i+window; a++) {
-               for(int b = j; b < j+window; b++) {
-                  if(outline && (a == i+window-3 || a == i || b == j+window-3 || b == j)) {
-                     final_edges.image_ptr[a][b] = 0;
-                  }
-               }
+         for (int y = r; y <= last_row; y++) {
+            for (int x = c; x <= last_column; x++) {
+               cells.accepted[y * cells.columns + x] |= accepted;
             }
+         }
 
-            cout << "Hough Histogram for first block horizontal lines:" << endl;
-            for(int i = 0; i < 16; i++) {
-               cout << "Angle: " << i << " " << hough_histogram[i] << endl;
+         // Optional parameter allows the outline of the window to be printed out
+         if (outline) {
+            int top    = r * cells.size;
+            int left   = c * cells.size;
+            int bottom = min((last_row + 1) * cells.size, bitmap_height) - 1;
+            int right  = min((last_column + 1) * cells.size, bitmap_width) - 1;
+
+            for (int b = left; b <= right; b++) {
+               final_edges.image_ptr[top][b] = final_edges.image_ptr[bottom][b] = 0;
+            }
+            for (int a = top; a <= bottom; a++) {
+               final_edges.image_ptr[a][left] = final_edges.image_ptr[a][right] = 0;
             }
-            cout << "Threshold: " << threshold << endl;
-            cout << "STDDEV: " << std_dev << endl;
          }
+      }
+   }
 
-         // Reinitilize hough_histogram to zeros.
-         for(int i = 0; i < 16; i++) {
-            hough_histogram[i] = 0;
+   for (int parity = 0; parity < 2; parity++) {
+      pool.Parallel_For(0, (cells.rows + 1 - parity) / 2, [&](int begin, int end) {
+         for (int n = begin; n < end; n++) {
+            Hough_Stitch_Row(image, final_edges, cells, 2 * n + parity, bitmap_height,
+                             bitmap_width, presence_threshold, table, count);
          }
+      });
+   }
+}
 
-      }
+/*------------------------------------------------------------
+   Hough_transform
+
+   INPUTS
+   image       - Pointer to a bitmap image
+   final_edges - Pointer to an image of the same size that receives the lines
+   directions  - Number of line directions to look for, 8, 16 or 32
+   tiling      - HOUGH_SEPARATE or HOUGH_OVERLAPPING windows
+   The rest are the same as above
+
+   DESCRIPTION
+   Same as above, but the lines are drawn into final_edges instead of
+   replacing the input. Every pixel of final_edges is written. The
+   windows are split over the shared thread pool.
+
+   Separate windows leave out the last partial window of each row and
+   column, and lines stop at the borders of the windows. Overlapping
+   windows cover the whole image and join the lines across the
+   borders, see Hough_Overlapping.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Hough_transform(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges, int reduction, int window, int std_dev_threshold, int presence_threshold, int outline, int directions, Hough_Tiling tiling) {
+
+   int bitmap_width;
+   int bitmap_height;
+   Hough_Direction table[HOUGH_MAX_DIRECTIONS];
+   int count = Hough_Direction_Table(directions, table);
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      memset(final_edges.image_ptr[i], 255, bitmap_width);
+   }
+
+   if (tiling == HOUGH_OVERLAPPING) {
+      Hough_Overlapping(image, final_edges, reduction, window, std_dev_threshold,
+                        presence_threshold, outline, table, count);
+      return;
    }
 
-   Copy_Image(final_edges, image);
-   Remove_Image(final_edges);
+   int window_rows    = bitmap_height > window ? (bitmap_height - 1) / window : 0;
+   int window_columns = bitmap_width > window ? (bitmap_width - 1) / window : 0;
+   int windows        = window_rows * window_columns;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   Hough_Window_Stats *stats = 0;
+
+   // The trace is printed once all the windows are done, so the workers
+   // never wait on the console
+   if (hough_trace)
+      stats = arena.Allocate_Array<Hough_Window_Stats>(windows);
+
+   // Each window only reads and writes its own pixels
+   Shared_Thread_Pool().Parallel_For(0, windows, [&](int begin, int end) {
+      Frame_Arena &window_arena = Thread_Arena();
+
+      for (int w = begin; w < end; w++) {
+         int i = (w / window_columns) * window;
+         int j = (w % window_columns) * window;
+
+         Hough_Window(image, final_edges, i, j, window, reduction, std_dev_threshold,
+                      presence_threshold, outline, table, count, window_arena,
+                      stats && Hough_Snapshot_Window(i, j) ? stats + w : 0);
+      }
+   });
+
+   // Prints a snap shot of the windows near the middle of the image.
+   // The snap shot will include the number of edge elements that voted for each line,
+   // the estabilshed threshold for this window, and the standard deviation of the
+   // hough_histogram for this window.
+   for (int w = 0; stats && w < windows; w++) {
+      int i = (w / window_columns) * window;
+      int j = (w % window_columns) * window;
+
+      if (!Hough_Snapshot_Window(i, j))
+         continue;
+
+      cout << "Hough Histogram for first block horizontal lines:" << endl;
+      for (int d = 0; d < count; d++) {
+         cout << "Angle: " << d << " " << stats[w].histogram[d] << endl;
+      }
+      cout << "Threshold: " << stats[w].threshold << endl;
+      cout << "STDDEV: " << stats[w].std_dev << endl;
+   }
 }
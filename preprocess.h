@@ -0,0 +1,95 @@
+// preprocess.h
+// Declarations for the functions that perform preprocessing on an image
+// before moving forward to detect a box.
+
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include "image.h"
+#include "runs.h"
+
+// Pixel values used to mark edge elements (BLACK) and background (WHITE)
+extern int BLACK;
+extern int WHITE;
+
+// Set to have Hough_transform print the histogram of the windows near
+// the middle of the image. Off by default.
+extern bool hough_trace;
+
+// Gaussian_Blur switches from a convolution to the recursive filter,
+// whose cost does not grow with sigma, at this sigma
+const float GAUSSIAN_RECURSIVE_SIGMA = 3.0f;
+
+// A direction that Hough_transform follows lines in from each edge
+// element. Each step moves dx columns (left when negative) and dy rows
+// towards the top of the window. Lines are only followed from pixels at
+// least min_rows below the top of the window.
+struct Hough_Direction {
+   int dx;
+   int dy;
+   int min_rows;
+};
+
+const int HOUGH_MAX_DIRECTIONS = 32;
+
+// How Hough_transform lays out its windows
+enum Hough_Tiling {
+   HOUGH_SEPARATE,
+   HOUGH_OVERLAPPING
+};
+
+// Algorithms that Thin_Edges can use
+enum Thinning_Algorithm {
+   THIN_STEINFELD_ROSENFELD,
+   THIN_ZHANG_SUEN
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Average(bmpBITMAP_FILE &image, int size);
+void Average_Blocks(bmpBITMAP_FILE &image, int size);
+void Average_Block_Row(bmpBITMAP_FILE &image, int top, int size);
+void Box_Blur(bmpBITMAP_FILE &image, int radius);
+void Box_Blur(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, int radius);
+void Gaussian_Blur(bmpBITMAP_FILE &image, float sigma);
+void Gaussian_Blur(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma);
+void Gaussian_Blur_Kernel(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma);
+void Gaussian_Blur_Recursive(bmpBITMAP_FILE &image, bmpBITMAP_FILE &blurred, float sigma);
+void Change_Brightness(bmpBITMAP_FILE &image, int level);
+void Change_Contrast(bmpBITMAP_FILE &image, int level);
+void Contrast_Table(int level, byte_t table[256]);
+void Histogram_Equalization(bmpBITMAP_FILE &image);
+void Equalization_Table(const long long histogram[256], byte_t table[256]);
+void Reduce_Noise(bmpBITMAP_FILE &image);
+void Median_Filter(bmpBITMAP_FILE &image, int radius);
+void Median_Filter(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius);
+void Median_Filter_Network(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius);
+void Median_Filter_Histogram(bmpBITMAP_FILE &image, bmpBITMAP_FILE &filtered, int radius);
+void Simple_detect_egdes(bmpBITMAP_FILE &image, int threshold);
+void Kirsh_detect_egdes(bmpBITMAP_FILE &image, int op_size, int threshold);
+void Kirsh_detect_egdes(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int op_size, int threshold);
+Image Kirsh_Edges(bmpBITMAP_FILE &image, int op_size, int threshold);
+int Kirsh_Edge_Row(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges, int row, int op_size, int threshold);
+void Canny_detect_egdes(bmpBITMAP_FILE &image, int low_threshold, int high_threshold);
+void Canny_detect_egdes(bmpBITMAP_FILE &image, bmpBITMAP_FILE &edges,
+                        int low_threshold, int high_threshold);
+Image Canny_Edges(bmpBITMAP_FILE &image, int low_threshold, int high_threshold);
+void Canny_Edge_Runs(bmpBITMAP_FILE &image, int low_threshold, int high_threshold, Edge_Runs &runs);
+void Thin_Edges(bmpBITMAP_FILE &image);
+void Thin_Edges(bmpBITMAP_FILE &image, Thinning_Algorithm algorithm);
+void Zhang_Suen_Thin_Edges(bmpBITMAP_FILE &image);
+void Zhang_Suen_Thin_Edges(bmpBITMAP_FILE &image, Edge_Runs &runs);
+void Hough_transform(bmpBITMAP_FILE &image, int reduction, int window,
+                     int std_dev_threshold, int presence_threshold, int outline,
+                     int directions = 16, Hough_Tiling tiling = HOUGH_SEPARATE);
+void Hough_transform(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges, int reduction, int window,
+                     int std_dev_threshold, int presence_threshold, int outline,
+                     int directions = 16, Hough_Tiling tiling = HOUGH_SEPARATE);
+Image Hough_Edges(bmpBITMAP_FILE &image, int reduction, int window,
+                  int std_dev_threshold, int presence_threshold, int outline,
+                  int directions = 16, Hough_Tiling tiling = HOUGH_SEPARATE);
+int Hough_Direction_Table(int directions, Hough_Direction *table);
+// ----------------------------------------------------------
+
+#endif
@@ -2,12 +2,32 @@
 // File that contains the processing functions of the box finding program
 //
 
+// Standard header files
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+#include "runs.h"
+#include "process.h"
+
+using namespace std;
+
 // Preprocessor directive to help convert degrees to radians.
 // NOTE: M_PI ought to be defined in the cmath header
 #define DEG2RAD M_PI / 180.0
 
 // Helper function to draw lines found from Hough Trasform
-void _draw_line(bmpBITMAP_FILE, float, float, float, float);
+void _draw_line(bmpBITMAP_FILE &, float, float, float, float);
+
+static void outsource_Draw_Lines(bmpBITMAP_FILE &image, std::vector<hough_line_t> &lines);
 
 /*-----------------------------------------------------------
 Hough_Transform
@@ -23,71 +43,108 @@ RETURNS
    image with the lines that most likely make up the box.
 -----------------------------------------------------------*/
 void dustin_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
-   int bitmap_width;
-   int bitmap_height;
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
    bmpBITMAP_FILE hough_image;
 
-   Copy_Image(image, hough_image);
-   Change_Brightness(hough_image, WHITE);
+   Arena_Image(arena, image, hough_image);
+   dustin_Hough_Transform(image, hough_image, threshold);
 
-   bitmap_height = Assemble_Integer(image.info_header.biHeight);
-   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+   // The result goes back into the rows of image, which may not own them
+   Copy_Rows(hough_image, image);
+}
+
+/*-----------------------------------------------------------
+dustin_Hough_Lines
 
-   // The accumulator is a 2D array,
-   // with one axis containing the degree of the line, and the other containing the radius.
+INPUTS
+   image - pointer to an image object.
+   threshold - votes needed for a line to be drawn
 
-   // NOTE: The maxiumum radius is that which extends through the image diagonally,
-   //       say, from the upper left down to the lower right. Therefore, before the accumulator
-   //       array can be made, we have to know this bound.
+DESCRIPTION
+   Same as dustin_Hough_Transform, but leaves image alone.
 
-   // double radius = sqrt(pow((bitmap_width/2),2) + pow((bitmap_height/2),2));
-   double radius;
-   if (bitmap_height > bitmap_width) {
-      radius = ((sqrt(2.0) * (double)bitmap_height) / 2.0);
-   }
-   else {
-      radius = ((sqrt(2.0) * (double)bitmap_width) / 2.0);
-   }
+RETURNS
+   A new image with the lines that most likely make up the box.
+-----------------------------------------------------------*/
+Image dustin_Hough_Lines(bmpBITMAP_FILE &image, int threshold) {
+
+   Image hough_image = Image::Same_Format(image);
+
+   dustin_Hough_Transform(image, hough_image, threshold);
 
-   // radius is multiplied by 2 so we can account for negative directions.
-   // i.e use the diameter for 180 degrees rather than radius for 360 degrees.
-   int accumulator_height = (int)radius;
-   int accumulator_width  = 180;
+   return hough_image;
+}
 
-   // Create the 2D array.
-   int accumulator[accumulator_width][accumulator_height];
+/*-----------------------------------------------------------
+dustin_Accumulator
 
-   // Initialize the accumulator to 0's
-   for(int w = 0; w < accumulator_width; w++) {
-      for(int h = 0; h < accumulator_height; h++) {
-         accumulator[w][h] = 0;
+DESCRIPTION
+   The votes of dustin_Hough_Transform, taken from the arena. There is
+   one row of height radii per degree, and the cosine and sine of each
+   degree are worked out once instead of for every vote.
+-----------------------------------------------------------*/
+struct dustin_Accumulator {
+   int *votes;
+   int height;
+   int center_x;
+   int center_y;
+   double cosines[180];
+   double sines[180];
+
+   dustin_Accumulator(Frame_Arena &arena, int bitmap_width, int bitmap_height) {
+
+      // NOTE: The maxiumum radius is that which extends through the image diagonally,
+      //       say, from the upper left down to the lower right. Therefore, before the accumulator
+      //       array can be made, we have to know this bound.
+      double radius;
+      if (bitmap_height > bitmap_width) {
+         radius = ((sqrt(2.0) * (double)bitmap_height) / 2.0);
+      }
+      else {
+         radius = ((sqrt(2.0) * (double)bitmap_width) / 2.0);
       }
-   }
 
-   // Use the center of the image as the reference point for degree and radius.
-   int center_x = bitmap_width / 2;
-   int center_y = bitmap_height / 2;
+      height = (int)radius;
+      votes  = arena.Allocate_Array<int>(180 * height);
+      memset(votes, 0, 180 * height * sizeof(int));
 
-   // Process through the entire image.
-   for (int y = 0; y < bitmap_height; y++) {
-      for (int x = 0; x < bitmap_width; x++) {
+      // Use the center of the image as the reference point for degree and radius.
+      center_x = bitmap_width / 2;
+      center_y = bitmap_height / 2;
 
-         // If the pixel is marked as an edge element
-         if (image.image_ptr[y][x] == BLACK) {
+      for (int degree = 0; degree < 180; degree++) {
+         cosines[degree] = cos((double)degree * DEG2RAD);
+         sines[degree]   = sin((double)degree * DEG2RAD);
+      }
+   }
 
-            // Loop through 180 degrees
-            for (int degree = 0; degree < 180; degree++) {
+   // Votes for every line through the edge elements x_begin..x_end-1 of row y
+   void Vote(int y, int x_begin, int x_end) {
 
-               // Determine the radius of the line to the center.
-               // r = (x - center)cos(theta) + (y - center)sin(theta)
-               int r = round(((double)(x - center_x) * cos((double)degree * DEG2RAD)) + ((double)(y - center_y) * sin((double)degree * DEG2RAD)));
+      for (int x = x_begin; x < x_end; x++) {
+         for (int degree = 0; degree < 180; degree++) {
 
-               // Increment the location in the array.
-               accumulator[degree][r]++;
-            }
+            // Determine the radius of the line to the center.
+            // r = (x - center)cos(theta) + (y - center)sin(theta)
+            int r = round(((double)(x - center_x) * cosines[degree]) + ((double)(y - center_y) * sines[degree]));
+
+            // Lines behind the center (negative r) do not fit in the accumulator.
+            if (r >= 0 && r < height)
+               votes[degree * height + r]++;
          }
       }
    }
+};
+
+// Draws the lines of the local maxima of the accumulator that have at
+// least threshold votes into hough_image
+static void dustin_Draw_Lines(int *accumulator, int accumulator_height, int bitmap_width,
+                              int bitmap_height, int threshold, bmpBITMAP_FILE &hough_image) {
+
+   int center_x = bitmap_width / 2;
+   int center_y = bitmap_height / 2;
 
    int low_x;
    int low_y;
@@ -103,18 +160,18 @@ void dustin_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
    // Scan accumulator and draw lines that have more votes than the threshold
    for(int d = 0; d < 180; d++) {
       for(int r = 0; r < accumulator_height; r++) {
-         if(accumulator[d][r] >= threshold) {
+         if(accumulator[d * accumulator_height + r] >= threshold) {
 
             // See if this point is a local maxima. 
             // We only want local maxima in order to only capture the lines with any meaning.
-            int max = accumulator[d][r];
+            int max = accumulator[d * accumulator_height + r];
             for (int check_y = -5; check_y <= 5; check_y++) {
                for (int check_x = -5; check_x <= 5; check_x++) {
 
                   // Make sure our selection is within bounds
                   if( ((check_y + r) >= 0) && ((check_y + r) < accumulator_height) && ((check_x + d) >= 0) && ((check_x + d) < 180)) {
-                     if(accumulator[check_x + d][check_y + r] > max) {
-                        max = accumulator[check_x + d][check_y + r];
+                     if(accumulator[(check_x + d) * accumulator_height + check_y + r] > max) {
+                        max = accumulator[(check_x + d) * accumulator_height + check_y + r];
 
                         // Break outta both loops y'all
                         check_y = 6;
@@ -125,7 +182,7 @@ void dustin_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
             }
 
             // See if a different max was found. If so, the current value has no meaning to us.
-            if(max > accumulator[d][r]) {
+            if(max > accumulator[d * accumulator_height + r]) {
                continue;
             }
             x1 = 0;
@@ -223,13 +280,87 @@ void dustin_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
          }
       }
    }
+}
+
+/*-----------------------------------------------------------
+dustin_Hough_Transform
+
+INPUTS
+   image - pointer to an image object.
+   hough_image - pointer to an image of the same size that receives the lines
+   threshold - votes needed for a line to be drawn
+
+DESCRIPTION
+   Same as above, but the lines are drawn into hough_image instead of
+   replacing the input. Every pixel of hough_image is written.
+
+RETURNS
+   Nothing
+-----------------------------------------------------------*/
+void dustin_Hough_Transform(bmpBITMAP_FILE &image, bmpBITMAP_FILE &hough_image, int threshold) {
+   int bitmap_width;
+   int bitmap_height;
+
+   Change_Brightness(hough_image, WHITE);
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   dustin_Accumulator accumulator(arena, bitmap_width, bitmap_height);
+
+   // Process through the entire image.
+   for (int y = 0; y < bitmap_height; y++) {
+      for (int x = 0; x < bitmap_width; x++) {
+
+         // If the pixel is marked as an edge element
+         if (image.image_ptr[y][x] == BLACK) {
+            accumulator.Vote(y, x, x + 1);
+         }
+      }
+   }
 
-   Copy_Image(hough_image, image);
-   Remove_Image(hough_image);
+   dustin_Draw_Lines(accumulator.votes, accumulator.height, bitmap_width, bitmap_height,
+                     threshold, hough_image);
 }
 
+/*-----------------------------------------------------------
+dustin_Hough_Transform
+
+INPUTS
+   runs - runs of edge elements
+   hough_image - pointer to an image of the size the runs describe,
+                 receives the lines
+   threshold - votes needed for a line to be drawn
+
+DESCRIPTION
+   Same as above, but the votes are cast from the runs, so the time
+   spent finding the edge elements depends on the number of runs
+   rather than the size of the image.
+
+RETURNS
+   Nothing
+-----------------------------------------------------------*/
+void dustin_Hough_Transform(const Edge_Runs &runs, bmpBITMAP_FILE &hough_image, int threshold) {
+
+   Change_Brightness(hough_image, WHITE);
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   dustin_Accumulator accumulator(arena, runs.Width(), runs.Height());
+
+   for (int y = 0; y < runs.Height(); y++) {
+      for (size_t r = runs.Row_Begin(y); r < runs.Row_End(y); r++) {
+         accumulator.Vote(y, runs.Run(r).start, runs.Run(r).end);
+      }
+   }
+
+   dustin_Draw_Lines(accumulator.votes, accumulator.height, runs.Width(), runs.Height(),
+                     threshold, hough_image);
+}
 
-void _draw_line(bmpBITMAP_FILE line_image, float x1, float y1, float x2, float y2) {
+void _draw_line(bmpBITMAP_FILE &line_image, float x1, float y1, float x2, float y2) {
 
    // Bresenham's line algorithm
    bool steep = (fabs(y2 - y1) > fabs(x2 - x1));
@@ -258,10 +389,13 @@ void _draw_line(bmpBITMAP_FILE line_image, float x1, float y1, float x2, float y
 
    for(int x=(int)x1; x<maxX; x++) {
 
-      if (x >= 0 && x < width_max && y >= 0 && y < height_max) {
-         if(steep)
+      // Bounds are checked against the row and column actually written
+      if(steep) {
+         if (x >= 0 && x < width_max && y >= 0 && y < height_max)
             line_image.image_ptr[y][x] = BLACK;
-         else
+      }
+      else {
+         if (y >= 0 && y < width_max && x >= 0 && x < height_max)
             line_image.image_ptr[x][y] = BLACK;
       }
 
@@ -273,21 +407,83 @@ void _draw_line(bmpBITMAP_FILE line_image, float x1, float y1, float x2, float y
    }
 }
 
+/*-----------------------------------------------------------
+outsource_Hough_Transform
+
+INPUTS
+   image - pointer to an image object.
+   threshold - votes needed for a line to be drawn
+
+DESCRIPTION
+   Finds the lines through the bright pixels of the image and draws
+   them on top of it. Voting is finished before any line is drawn, so
+   the lines are drawn straight onto image.
+
+RETURNS
+   Nothing
+-----------------------------------------------------------*/
 void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
-   bmpBITMAP_FILE hough_image;
-   Copy_Image (image, hough_image);
 
-   int w = Assemble_Integer(hough_image.info_header.biWidth);
-   int h = Assemble_Integer(hough_image.info_header.biHeight);
-   int _img_w = Assemble_Integer(hough_image.info_header.biWidth);
-   int _img_h = Assemble_Integer(hough_image.info_header.biHeight);
+   vector<hough_line_t> lines = outsource_Find_Lines(image, threshold);
+
+   outsource_Draw_Lines(image, lines);
+}
+
+/*-----------------------------------------------------------
+outsource_Hough_Lines
+
+INPUTS
+   image - pointer to an image object.
+   threshold - votes needed for a line to be drawn
+
+DESCRIPTION
+   Same as outsource_Hough_Transform, but leaves image alone.
+
+RETURNS
+   A copy of image with the lines drawn on it.
+-----------------------------------------------------------*/
+Image outsource_Hough_Lines(bmpBITMAP_FILE &image, int threshold) {
+
+   vector<hough_line_t> lines = outsource_Find_Lines(image, threshold);
+   Image hough_image = Image::Copy_Of(image);
+
+   outsource_Draw_Lines(hough_image, lines);
+
+   return hough_image;
+}
+
+/*-----------------------------------------------------------
+outsource_Find_Lines
+
+INPUTS
+   image - pointer to an image object.
+   threshold - votes needed for a line to be kept
+
+DESCRIPTION
+   Votes for lines through the pixels brighter than 250 and keeps the
+   local maxima that have at least threshold votes.
+
+RETURNS
+   The end points of each line, where it crosses the edges of the image.
+-----------------------------------------------------------*/
+vector<hough_line_t> outsource_Find_Lines(bmpBITMAP_FILE &image, int threshold) {
+
+   int w = Assemble_Integer(image.info_header.biWidth);
+   int h = Assemble_Integer(image.info_header.biHeight);
+   int _img_w = w;
+   int _img_h = h;
 
    //Create the accu
    double hough_h = ((sqrt(2.0) * (double)(h>w?h:w)) / 2.0);
    int _accu_h = hough_h * 2.0; // -r -> +r
    int _accu_w = 180;
 
-   unsigned int* _accu = (unsigned int*)calloc(_accu_h * _accu_w, sizeof(unsigned int));
+   // The accumulator comes from the arena and is released on return
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+   unsigned int* _accu = arena.Allocate_Array<unsigned int>(_accu_h * _accu_w);
+
+   memset(_accu, 0, _accu_h * _accu_w * sizeof(unsigned int));
 
    double center_x = w/2;
    double center_y = h/2;
@@ -308,10 +504,10 @@ void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
       }
    }
 
-   std::vector< std::pair< std::pair<int, int>, std::pair<int, int> > > lines;
+   std::vector<hough_line_t> lines;
 
    if(_accu == 0)
-      return;
+      return lines;
 
    for(int r=0;r<_accu_h;r++)
    {
@@ -359,7 +555,7 @@ void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
                x2 = ((double)(r-(_accu_h/2)) - ((y2 - (_img_h/2) ) * sin(t * DEG2RAD))) / cos(t * DEG2RAD) + (_img_w / 2);
             }
 
-            lines.push_back(std::pair< std::pair<int, int>, std::pair<int, int> >(std::pair<int, int>(x1,y1), std::pair<int, int>(x2,y2)));
+            lines.push_back(hough_line_t(std::pair<int, int>(x1,y1), std::pair<int, int>(x2,y2)));
 
          }
       }
@@ -367,8 +563,14 @@ void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
       
    std::cout << "lines: " << lines.size() << " " << threshold << std::endl;
 
+   return lines;
+}
+
+// Draws the lines found by outsource_Find_Lines onto image.
+static void outsource_Draw_Lines(bmpBITMAP_FILE &image, vector<hough_line_t> &lines) {
+
    // Draw the results. 
-   std::vector< std::pair< std::pair<int, int>, std::pair<int, int> > >::iterator it;
+   std::vector<hough_line_t>::iterator it;
    for(it=lines.begin();it!=lines.end();it++)
    {
       int x1 = it->first.first;
@@ -376,10 +578,7 @@ void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold) {
       int x2 = it->second.first;
       int y2 = it->second.second;
       cout << "Drawing from " << x1 << ", " << y1 << " to " << x2 << ", " << y2 << endl;
-      _draw_line(hough_image, x1, y1, x2, y2);
+      _draw_line(image, x1, y1, x2, y2);
       // cv::line(img_res, cv::Point(it->first.first, it->first.second), cv::Point(it->second.first, it->second.second), cv::Scalar( 0, 0, 255), 2, 8);
    }
-   Copy_Image(hough_image,image);
-   Remove_Image(hough_image);
-   return;
 }
\ No newline at end of file
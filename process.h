@@ -0,0 +1,28 @@
+// process.h
+// Declarations for the processing functions of the box finding program
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "runs.h"
+
+// A line found by outsource_Find_Lines, as a pair of end points
+typedef std::pair< std::pair<int, int>, std::pair<int, int> > hough_line_t;
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void dustin_Hough_Transform(bmpBITMAP_FILE &image, int threshold);
+void dustin_Hough_Transform(bmpBITMAP_FILE &image, bmpBITMAP_FILE &hough_image, int threshold);
+Image dustin_Hough_Lines(bmpBITMAP_FILE &image, int threshold);
+void dustin_Hough_Transform(const Edge_Runs &runs, bmpBITMAP_FILE &hough_image, int threshold);
+void outsource_Hough_Transform(bmpBITMAP_FILE &image, int threshold);
+Image outsource_Hough_Lines(bmpBITMAP_FILE &image, int threshold);
+std::vector<hough_line_t> outsource_Find_Lines(bmpBITMAP_FILE &image, int threshold);
+// ----------------------------------------------------------
+
+#endif
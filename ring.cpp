@@ -0,0 +1,245 @@
+// ring.cpp
+// Contains the ring of frames shared with a capture process, and the
+// loop that finds boxes and lines in each frame of it.
+
+// Standard header files
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+// POSIX header files
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "server.h"
+#include "ring.h"
+#include "cache.h"
+
+using namespace std;
+
+// Marks a shared memory object as a ring, "RING"
+const uint32_t FRAME_RING_MAGIC = 0x474e4952;
+
+// How long the writer and the reader sleep while they wait for each other
+const int FRAME_RING_WAIT_MICROSECONDS = 100;
+
+// The head and tail are on cache lines of their own, so the writer
+// storing one does not take the line of the other from the reader
+struct Frame_Ring_Header {
+   atomic<uint32_t> magic;
+   uint32_t width;
+   uint32_t height;
+   uint32_t slots;
+   atomic<uint32_t> closed;
+   alignas(64) atomic<uint64_t> head;
+   alignas(64) atomic<uint64_t> tail;
+};
+
+// The processes share the atomics through memory, so they must not
+// need a lock
+static_assert(atomic<uint64_t>::is_always_lock_free, "the ring needs lock free 64 bit atomics");
+static_assert(sizeof(Frame_Ring_Header) == 192, "the ring header is 192 bytes");
+
+Frame_Ring::Frame_Ring(const char *name, int width, int height, int slots)
+   : name(name), header(0), pixels(0), mapped_size(0), width(width), height(height), slots(slots) {
+
+   if (width <= 0 || height <= 0 || slots <= 0) {
+      cerr << "Error: a ring needs a size and at least one slot\n";
+      exit(110);
+   }
+
+   size_t object_size = sizeof(Frame_Ring_Header) + (size_t)slots * width * height;
+   int object = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+   if (object < 0 || ftruncate(object, object_size) != 0) {
+      cerr << "Error: cannot make the ring " << name << "\n";
+      exit(110);
+   }
+
+   Map(object, object_size);
+
+   // A new object is all zeros, so the indices start at 0 and the ring
+   // is open. The magic goes last, so a reader that sees it sees the
+   // sizes too.
+   header->width  = width;
+   header->height = height;
+   header->slots  = slots;
+   header->magic.store(FRAME_RING_MAGIC, memory_order_release);
+}
+
+Frame_Ring::Frame_Ring(const char *name)
+   : name(name), header(0), pixels(0), mapped_size(0), width(0), height(0), slots(0) {
+
+   int object = shm_open(name, O_RDWR, 0);
+   struct stat status;
+
+   if (object < 0 || fstat(object, &status) != 0 ||
+       (size_t)status.st_size < sizeof(Frame_Ring_Header)) {
+      cerr << "Error: cannot open the ring " << name << "\n";
+      exit(110);
+   }
+
+   Map(object, status.st_size);
+
+   // The sizes are only read once the magic says the writer has stored
+   // them, and must fit in an int and in the object
+   bool ring = header->magic.load(memory_order_acquire) == FRAME_RING_MAGIC;
+   size_t frames_size = mapped_size - sizeof(Frame_Ring_Header);
+
+   ring = ring && header->width  > 0 && header->width  <= (uint32_t)INT_MAX &&
+                  header->height > 0 && header->height <= (uint32_t)INT_MAX &&
+                  header->slots  > 0 && header->slots  <= (uint32_t)INT_MAX &&
+                  (size_t)header->width * header->height <= frames_size / header->slots;
+
+   if (!ring) {
+      cerr << "Error: " << name << " does not hold a ring\n";
+      exit(110);
+   }
+
+   width  = header->width;
+   height = header->height;
+   slots  = header->slots;
+}
+
+Frame_Ring::~Frame_Ring() {
+   munmap(header, mapped_size);
+}
+
+// Maps object, which is closed afterwards
+void Frame_Ring::Map(int object, size_t object_size) {
+
+   void *memory = mmap(0, object_size, PROT_READ | PROT_WRITE, MAP_SHARED, object, 0);
+
+   close(object);
+
+   if (memory == MAP_FAILED) {
+      cerr << "Error: cannot map the ring " << name << "\n";
+      exit(110);
+   }
+
+   header      = (Frame_Ring_Header *) memory;
+   pixels      = (byte_t *) memory + sizeof(Frame_Ring_Header);
+   mapped_size = object_size;
+}
+
+byte_t *Frame_Ring::Begin_Write() {
+
+   uint64_t head = header->head.load(memory_order_relaxed);
+
+   if (head - header->tail.load(memory_order_acquire) >= (uint64_t)slots)
+      return 0;
+
+   return pixels + (size_t)(head % slots) * width * height;
+}
+
+void Frame_Ring::End_Write() {
+   header->head.store(header->head.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void Frame_Ring::Close() {
+   header->closed.store(1, memory_order_release);
+}
+
+byte_t *Frame_Ring::Begin_Read() {
+
+   uint64_t tail = header->tail.load(memory_order_relaxed);
+
+   if (tail == header->head.load(memory_order_acquire))
+      return 0;
+
+   return pixels + (size_t)(tail % slots) * width * height;
+}
+
+void Frame_Ring::End_Read() {
+   header->tail.store(header->tail.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+bool Frame_Ring::Finished() const {
+
+   // Closed is read first, so a frame written before the ring was
+   // closed is never missed
+   return header->closed.load(memory_order_acquire) != 0 &&
+          header->tail.load(memory_order_relaxed) == header->head.load(memory_order_acquire);
+}
+
+Image_View Frame_Ring::View(byte_t *slot) const {
+
+   // The program holds rows bottom up, so the view starts at the last
+   // row of the slot and steps back a row at a time
+   return Image_View(slot + (size_t)(height - 1) * width, width, height, -width);
+}
+
+void Frame_Ring::Unlink() {
+   shm_unlink(name.c_str());
+}
+
+/*------------------------------------------------------------
+   Consume_Frame_Ring
+
+   INPUTS
+   ring    - The ring to read the frames from
+   request - The parameters of the stages. The source is not used.
+   report  - Called with what was found in each frame, in order
+   cache   - Results of frames seen before, or 0 for none
+
+   DESCRIPTION
+   Runs the stages of Detect on each frame of the ring as it arrives,
+   until the writer closes the ring. Preprocessing reads the frame
+   through a view of its slot, so nothing is copied between the capture
+   process and the first stage, and the slot is given back as soon as
+   the edges are in the frames of this thread. The frames are reused
+   from one frame to the next. A frame the cache has the result for is
+   given back at once, without running the stages.
+
+   RETURNS
+   Nothing, once the ring is closed and every frame has been read
+-------------------------------------------------------------*/
+void Consume_Frame_Ring(Frame_Ring &ring, const Detection_Request &request,
+                        const function<void(const Detection_Result &)> &report,
+                        Result_Cache *cache) {
+
+   Frame_Buffers frames;
+
+   while (!ring.Finished()) {
+      byte_t *slot = ring.Begin_Read();
+
+      if (slot == 0) {
+         this_thread::sleep_for(chrono::microseconds(FRAME_RING_WAIT_MICROSECONDS));
+         continue;
+      }
+
+      Image_View frame = ring.View(slot);
+      Detection_Result result;
+      Result_Key key;
+
+      if (cache) {
+         key = Make_Result_Key(frame, request);
+
+         if (cache->Find(key, result)) {
+            ring.End_Read();
+            report(result);
+            continue;
+         }
+      }
+
+      Thread_Arena().Reset();
+      Preprocess_Frame(frame, frames, request);
+      ring.End_Read();
+      Detect_Edges(frames, request, result);
+
+      if (cache)
+         cache->Insert(key, result);
+
+      report(result);
+   }
+}
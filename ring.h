@@ -0,0 +1,104 @@
+// ring.h
+// Declarations for taking frames from a capture process through a ring
+// of frames in POSIX shared memory.
+
+#ifndef RING_H
+#define RING_H
+
+#include <functional>
+#include <string>
+
+#include "image.h"
+#include "server.h"
+
+// Frames a ring holds when it is made with no count
+const int FRAME_RING_SLOTS = 4;
+
+// The shared header at the start of a ring, see Frame_Ring
+struct Frame_Ring_Header;
+
+class Result_Cache;
+
+/*-----------------------------------------------------------
+   Frame_Ring
+
+   DESCRIPTION
+   A ring of frames in a POSIX shared memory object, written by one
+   process, the capture process, and read by another, this one. The
+   object starts with a header,
+
+      uint32 magic, width, height, slots, closed
+      uint64 head     on a cache line of its own, at byte 64
+      uint64 tail     on a cache line of its own, at byte 128
+
+   and the slots follow at byte 192, each width x height grey pixels,
+   the top row first. The writer stores magic last, with release, so a
+   reader that finds it finds the sizes as well. head counts the frames
+   written and tail the frames read. Only the writer stores head and
+   only the reader stores tail, so no lock is needed: the writer fills
+   slot head % slots while head - tail < slots, then stores head + 1,
+   and the reader uses slot tail % slots while tail < head, then stores
+   tail + 1. The stores release and the loads acquire, so the pixels of
+   a slot are seen before the index that hands it over.
+
+   View() gives a slot as a bitmap without copying it, so the stages
+   read the frame where the capture process wrote it.
+------------------------------------------------------------*/
+class Frame_Ring {
+public:
+   // Makes the shared memory object name, for the writer
+   Frame_Ring(const char *name, int width, int height, int slots = FRAME_RING_SLOTS);
+
+   // Maps the shared memory object name, made by the writer
+   explicit Frame_Ring(const char *name);
+   ~Frame_Ring();
+
+   Frame_Ring(const Frame_Ring &) = delete;
+   Frame_Ring &operator=(const Frame_Ring &) = delete;
+
+   int Width() const { return width; }
+   int Height() const { return height; }
+   int Slots() const { return slots; }
+
+   // The writer. Begin_Write() gives the slot for the next frame, or 0
+   // while the ring is full, End_Write() hands it to the reader, and
+   // Close() says no more frames are coming.
+   byte_t *Begin_Write();
+   void End_Write();
+   void Close();
+
+   // The reader. Begin_Read() gives the oldest frame, or 0 while there
+   // is none, and End_Read() gives its slot back to the writer.
+   // Finished() is true once the ring is closed and every frame read.
+   byte_t *Begin_Read();
+   void End_Read();
+   bool Finished() const;
+
+   // The frame in slot as a bitmap, bottom row first
+   Image_View View(byte_t *slot) const;
+
+   // Removes the name of the shared memory object. The ring stays
+   // mapped until it is destroyed.
+   void Unlink();
+
+private:
+   void Map(int object, size_t object_size);
+
+   std::string name;
+   Frame_Ring_Header *header;
+   byte_t *pixels;
+   size_t mapped_size;
+   int width;
+   int height;
+   int slots;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Consume_Frame_Ring(Frame_Ring &ring, const Detection_Request &request,
+                        const std::function<void(const Detection_Result &)> &report,
+                        Result_Cache *cache = 0);
+// ----------------------------------------------------------
+
+#endif
@@ -0,0 +1,154 @@
+// runs.cpp
+// Contains the run-length form of an edge map.
+
+// Standard header files
+#include <string.h>
+
+#include "image.h"
+#include "preprocess.h"
+#include "runs.h"
+
+using namespace std;
+
+// ----------------------------------------------------------
+// Edge_Runs
+
+void Edge_Runs::Reset(int width, int height) {
+   this->width  = width;
+   this->height = height;
+   next_row = 0;
+   runs.clear();
+   row_first.assign(height + 1, 0);
+}
+
+void Edge_Runs::Add(int row, int start, int end) {
+   Edge_Run run;
+
+   while (next_row <= row) {
+      row_first[next_row++] = runs.size();
+   }
+
+   run.start = start;
+   run.end   = end;
+   runs.push_back(run);
+}
+
+void Edge_Runs::Finish() {
+   while (next_row <= height) {
+      row_first[next_row++] = runs.size();
+   }
+}
+
+long Edge_Runs::Pixels() const {
+   long pixels = 0;
+
+   for (size_t r = 0; r < runs.size(); r++) {
+      pixels += runs[r].end - runs[r].start;
+   }
+   return pixels;
+}
+
+size_t Edge_Runs::Bytes() const {
+   return runs.capacity() * sizeof(Edge_Run) + row_first.capacity() * sizeof(size_t);
+}
+
+// Adds the runs of pixels equal to value in one row
+static void Encode_Row(const byte_t *row, int width, byte_t value, int i, Edge_Runs &runs) {
+   int j = 0;
+
+   while (j < width) {
+      const byte_t *found = (const byte_t *)memchr(row + j, value, width - j);
+      int start;
+
+      if (!found)
+         return;
+
+      start = found - row;
+      j = start + 1;
+      while (j < width && row[j] == value) {
+         j++;
+      }
+      runs.Add(i, start, j);
+   }
+}
+
+/*------------------------------------------------------------
+   Encode_Runs
+
+   INPUTS
+   image - Pointer to an edge map, edge elements are BLACK
+   runs  - Receives the runs of edge elements
+
+   DESCRIPTION
+   Converts an edge map to runs.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Encode_Runs(bmpBITMAP_FILE &image, Edge_Runs &runs) {
+
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   runs.Reset(width, height);
+
+   for (int i = 0; i < height; i++) {
+      Encode_Row(image.image_ptr[i], width, BLACK, i, runs);
+   }
+
+   runs.Finish();
+}
+
+/*------------------------------------------------------------
+   Encode_Runs
+
+   INPUTS
+   mask   - width * height bytes, row by row
+   width  - Width of the image
+   height - Height of the image
+   value  - Value of the bytes that are edge elements
+   runs   - Receives the runs of edge elements
+
+   DESCRIPTION
+   Converts a stage's own working buffer to runs, so the stage can hand
+   on its edges without writing an edge map first.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Encode_Runs(const byte_t *mask, int width, int height, byte_t value, Edge_Runs &runs) {
+
+   runs.Reset(width, height);
+
+   for (int i = 0; i < height; i++) {
+      Encode_Row(mask + (size_t)i * width, width, value, i, runs);
+   }
+
+   runs.Finish();
+}
+
+/*------------------------------------------------------------
+   Decode_Runs
+
+   INPUTS
+   runs  - Runs of edge elements
+   image - Pointer to an image of the size the runs describe
+
+   DESCRIPTION
+   Draws the runs in BLACK on a WHITE image.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Decode_Runs(const Edge_Runs &runs, bmpBITMAP_FILE &image) {
+
+   for (int i = 0; i < runs.Height(); i++) {
+      byte_t *row = image.image_ptr[i];
+
+      memset(row, WHITE, runs.Width());
+
+      for (size_t r = runs.Row_Begin(i); r < runs.Row_End(i); r++) {
+         memset(row + runs.Run(r).start, BLACK, runs.Run(r).end - runs.Run(r).start);
+      }
+   }
+}
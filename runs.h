@@ -0,0 +1,78 @@
+// runs.h
+// Declarations for the run-length form of an edge map.
+
+#ifndef RUNS_H
+#define RUNS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "image.h"
+
+// Edge elements start..end-1 of a row
+struct Edge_Run {
+   int start;
+   int end;
+};
+
+/*-----------------------------------------------------------
+   Edge_Runs
+
+   DESCRIPTION
+   The edge elements of an edge map as runs of consecutive pixels,
+   row by row from the top and left to right within a row. Once edges
+   are thin, a frame holds far fewer runs than pixels, so stages that
+   walk the runs cost in proportion to the edges rather than the image.
+
+   The runs of row i are Run(Row_Begin(i)) .. Run(Row_End(i) - 1):
+
+      for (int i = 0; i < runs.Height(); i++)
+         for (size_t r = runs.Row_Begin(i); r < runs.Row_End(i); r++)
+            for (int j = runs.Run(r).start; j < runs.Run(r).end; j++)
+               ... pixel (i, j) is an edge element ...
+
+   Runs are added with Add(), in order, between Reset() and Finish().
+------------------------------------------------------------*/
+class Edge_Runs {
+public:
+   Edge_Runs() : width(0), height(0), next_row(0) {}
+
+   // Empties the runs and sets the size of the image they describe
+   void Reset(int width, int height);
+
+   // Adds a run to row. Rows must not go backwards.
+   void Add(int row, int start, int end);
+
+   // Completes the row index after the last Add()
+   void Finish();
+
+   int Width() const { return width; }
+   int Height() const { return height; }
+   size_t Size() const { return runs.size(); }
+   const Edge_Run &Run(size_t r) const { return runs[r]; }
+   size_t Row_Begin(int row) const { return row_first[row]; }
+   size_t Row_End(int row) const { return row_first[row + 1]; }
+
+   // Number of edge elements
+   long Pixels() const;
+
+   // Memory held by the runs and the row index
+   size_t Bytes() const;
+
+private:
+   std::vector<Edge_Run> runs;
+   std::vector<size_t> row_first;
+   int width;
+   int height;
+   int next_row;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Encode_Runs(bmpBITMAP_FILE &image, Edge_Runs &runs);
+void Encode_Runs(const byte_t *mask, int width, int height, byte_t value, Edge_Runs &runs);
+void Decode_Runs(const Edge_Runs &runs, bmpBITMAP_FILE &image);
+// ----------------------------------------------------------
+
+#endif
@@ -0,0 +1,662 @@
+// server.cpp
+// Contains the server that keeps the box finding program running and
+// answers requests sent to it over a Unix domain socket.
+
+// Standard header files
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <set>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <utility>
+
+// POSIX header files
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+#include "components.h"
+#include "process.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+
+using namespace std;
+
+// Requests longer than this are refused
+const size_t REQUEST_LINE_LIMIT = 4096;
+
+// A parameter a request may set, and the values it may take. The
+// largest keep the stages clear of overflow.
+struct Request_Parameter {
+   const char *name;
+   int Detection_Request::*field;
+   long smallest;
+   long largest;
+};
+
+static const Request_Parameter REQUEST_PARAMETERS[] = {
+   {"average",    &Detection_Request::average_size,   1, 1024},
+   {"contrast",   &Detection_Request::contrast_level, 0, 1 << 20},
+   {"op",         &Detection_Request::op_size,        3, 7},
+   {"edges",      &Detection_Request::edge_threshold, 0, 1 << 30},
+   {"min_pixels", &Detection_Request::min_pixels,     0, 1 << 30},
+   {"min_span",   &Detection_Request::min_span,       0, 1 << 30},
+   {"lines",      &Detection_Request::line_threshold, 0, 1 << 30}
+};
+
+Detection_Request::Detection_Request()
+   : shared_memory(false), width(0), height(0), average_size(4), contrast_level(2), op_size(7),
+     edge_threshold(550), min_pixels(60), min_span(31), line_threshold(170) {
+}
+
+/*------------------------------------------------------------
+   Parse_Request
+
+   INPUTS
+   line    - One line of a request, without its newline
+   request - Filled in from the line
+   error   - Says what is wrong with the line, if anything is
+
+   DESCRIPTION
+   A request is one of
+
+      FILE <path> [name=value ...]
+      SHM <name> <width>x<height> [name=value ...]
+
+   The names are average, contrast, op, edges, min_pixels, min_span
+   and lines, for the parameters of Detect in that order. Each value is
+   a whole number. average is at least 1, op is 3, 5 or 7, and the rest
+   are at least 0.
+
+   RETURNS
+   true if the line is a valid request
+-------------------------------------------------------------*/
+bool Parse_Request(const string &line, Detection_Request &request, string &error) {
+
+   istringstream words(line);
+   string kind;
+   string word;
+
+   request = Detection_Request();
+   words >> kind >> request.source;
+
+   if (kind == "SHM") {
+      char x = 0;
+
+      request.shared_memory = true;
+      if (!(words >> request.width >> x >> request.height) || x != 'x' ||
+          request.width <= 0 || request.height <= 0) {
+         error = "SHM needs a name and a size, as in SHM /frame 1024x768";
+         return false;
+      }
+   }
+   else if (kind != "FILE") {
+      error = "unknown request " + kind;
+      return false;
+   }
+
+   if (request.source.empty()) {
+      error = kind + " needs a source";
+      return false;
+   }
+
+   while (words >> word) {
+      size_t equals = word.find('=');
+      string name = word.substr(0, equals);
+      const Request_Parameter *parameter = 0;
+
+      for (size_t p = 0; p < sizeof(REQUEST_PARAMETERS) / sizeof(REQUEST_PARAMETERS[0]); p++) {
+         if (name == REQUEST_PARAMETERS[p].name)
+            parameter = &REQUEST_PARAMETERS[p];
+      }
+
+      if (parameter == 0 || equals == string::npos) {
+         error = "unknown parameter " + word;
+         return false;
+      }
+
+      const char *text = word.c_str() + equals + 1;
+      char *end;
+      long value;
+
+      errno = 0;
+      value = strtol(text, &end, 10);
+
+      if (end == text || *end != '\0' || errno == ERANGE ||
+          value < parameter->smallest || value > parameter->largest) {
+         error = name + " must be a whole number from " + to_string(parameter->smallest) +
+                 " to " + to_string(parameter->largest);
+         return false;
+      }
+      request.*parameter->field = value;
+   }
+
+   if (request.op_size != 3 && request.op_size != 5 && request.op_size != 7) {
+      error = "op must be 3, 5 or 7";
+      return false;
+   }
+
+   return true;
+}
+
+/*------------------------------------------------------------
+   Detect
+
+   INPUTS
+   frames  - The frame buffers, the frame is in the front one
+   request - The parameters of the stages
+   result  - Filled in with the boxes and lines
+
+   DESCRIPTION
+   Runs the chain main runs, Preprocess_Tiles, Thin_Edges and
+   Magic_eraser, then finds the box around each group of edges that is
+   left. outsource_Find_Lines votes for bright pixels, so it is given
+   the edges white on black, in the back frame.
+
+   Preprocess_Frame() and Detect_Edges() are the two halves, for a
+   frame that lives somewhere else, such as shared memory, and is only
+   needed until it has been preprocessed.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Detect(Frame_Buffers &frames, const Detection_Request &request, Detection_Result &result) {
+
+   Preprocess_Frame(frames.Front(), frames, request);
+   Detect_Edges(frames, request, result);
+}
+
+// Finds the edges of frame, which is left alone, in the front frame
+void Preprocess_Frame(bmpBITMAP_FILE &frame, Frame_Buffers &frames, const Detection_Request &request) {
+
+   frames.Prepare(frame);
+   Preprocess_Tiles(frame, frames.Back(), request.average_size, request.contrast_level,
+                    request.op_size, request.edge_threshold);
+   frames.Flip();
+}
+
+// The rest of Detect, on the edges in the front frame
+void Detect_Edges(Frame_Buffers &frames, const Detection_Request &request, Detection_Result &result) {
+
+   Thin_Edges(frames.Front());
+   Magic_eraser(frames.Front(), request.min_pixels, request.min_span);
+
+   Find_Components(frames.Front(), result.boxes);
+
+   bmpBITMAP_FILE &edges    = frames.Front();
+   bmpBITMAP_FILE &inverted = frames.Back();
+   int height = Assemble_Integer(edges.info_header.biHeight);
+   int width  = Assemble_Integer(edges.info_header.biWidth);
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         inverted.image_ptr[i][j] = 255 - edges.image_ptr[i][j];
+      }
+   }
+
+   result.lines = outsource_Find_Lines(inverted, request.line_threshold);
+}
+
+/*------------------------------------------------------------
+   Format_Result
+
+   INPUTS
+   result - What Detect found
+
+   DESCRIPTION
+   The reply to a request:
+
+      OK <boxes> <lines>
+      BOX <top> <left> <bottom> <right> <pixels>     once per box
+      LINE <x1> <y1> <x2> <y2>                       once per line
+      END
+
+   RETURNS
+   The reply, with a newline after each line
+-------------------------------------------------------------*/
+string Format_Result(const Detection_Result &result) {
+
+   ostringstream reply;
+
+   reply << "OK " << result.boxes.size() << " " << result.lines.size() << "\n";
+
+   for (size_t b = 0; b < result.boxes.size(); b++) {
+      const Component &box = result.boxes[b];
+
+      reply << "BOX " << box.top << " " << box.left << " " << box.bottom << " " << box.right
+            << " " << box.pixels << "\n";
+   }
+
+   for (size_t l = 0; l < result.lines.size(); l++) {
+      const hough_line_t &line = result.lines[l];
+
+      reply << "LINE " << line.first.first << " " << line.first.second << " "
+            << line.second.first << " " << line.second.second << "\n";
+   }
+
+   reply << "END\n";
+   return reply.str();
+}
+
+// ----------------------------------------------------------
+// Run_Server
+
+// What the threads of Run_Server share. open_connections are the
+// connections the workers are serving, so that SHUTDOWN can close them
+// while their clients are still connected.
+struct Server_State {
+   int listener;
+   atomic<bool> stopping;
+   Bounded_Queue<int> connections;
+   Result_Cache cache;
+   mutex connections_lock;
+   set<int> open_connections;
+
+   Server_State(int workers, const char *cache_file_name)
+      : listener(-1), stopping(false), connections(workers),
+        cache(RESULT_CACHE_ENTRIES, cache_file_name) {
+   }
+};
+
+// The bytes received on a connection that are not part of a line yet,
+// buffer[start] .. buffer[end-1]
+struct Line_Reader {
+   int connection;
+   char buffer[REQUEST_LINE_LIMIT];
+   size_t start;
+   size_t end;
+};
+
+enum Line_Status {
+   LINE_READ,
+   LINE_TOO_LONG,
+   LINE_CLOSED
+};
+
+// Reads one line from a connection into line, without its newline. A
+// line longer than REQUEST_LINE_LIMIT is read to its end but not kept.
+static Line_Status Receive_Line(Line_Reader &reader, string &line) {
+
+   bool too_long = false;
+
+   line.clear();
+
+   while (true) {
+      char *first = reader.buffer + reader.start;
+      char *last  = reader.buffer + reader.end;
+      char *newline = (char *) memchr(first, '\n', last - first);
+
+      if (!too_long)
+         line.append(first, newline ? newline : last);
+
+      if (line.size() > REQUEST_LINE_LIMIT) {
+         too_long = true;
+         line.clear();
+      }
+
+      if (newline) {
+         reader.start = newline + 1 - reader.buffer;
+         break;
+      }
+
+      ssize_t got = recv(reader.connection, reader.buffer, sizeof(reader.buffer), 0);
+
+      if (got <= 0)
+         return LINE_CLOSED;
+
+      reader.start = 0;
+      reader.end   = got;
+   }
+
+   line.erase(remove(line.begin(), line.end(), '\r'), line.end());
+   return too_long ? LINE_TOO_LONG : LINE_READ;
+}
+
+// Sends all of text, without a signal if the client has gone
+static void Send_Text(int connection, const string &text) {
+
+   size_t sent = 0;
+
+   while (sent < text.size()) {
+      ssize_t count = send(connection, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+
+      if (count <= 0)
+         return;
+      sent += count;
+   }
+}
+
+// True if the file in holds the rows the headers of decoder give, and
+// the frame is no larger than MAX_IMAGE_PIXELS, so a header that claims
+// more than the file has is refused before frames are allocated for it.
+// An RLE8 file can give many rows in a few bytes, so only its size is
+// capped.
+static bool Frame_Fits(const Bitmap_Decoder &decoder, istream &in) {
+
+   if ((long long)decoder.Width() * decoder.Height() > MAX_IMAGE_PIXELS)
+      return false;
+
+   if (decoder.Compressed())
+      return true;
+
+   in.clear();
+   in.seekg(0, ios::end);
+
+   long long size = in.tellg();
+   long long rows = (long long)decoder.Row_Stride() * (decoder.Height() - 1) + decoder.Row_Bytes();
+
+   return size >= 0 && decoder.Data_Offset() + rows <= size;
+}
+
+// Runs Detect on the frame of request, unless the cache has the result
+// for the frame already. A file is read into the front frame, without
+// allocating once the frames have its size. A shared memory frame is
+// preprocessed where it is, through a view, and is unmapped once its
+// edges are in the frames. Returns false with error set if the frame
+// cannot be opened, or the file is not an image that can be read, or is
+// larger than the file or MAX_IMAGE_PIXELS.
+static bool Detect_Request(Frame_Buffers &frames, const Detection_Request &request,
+                           Result_Cache &cache, Detection_Result &result, string &error) {
+
+   if (!request.shared_memory) {
+      ifstream in_file(request.source.c_str(), ios::in | ios::binary);
+
+      if (!in_file) {
+         error = "cannot open " + request.source;
+         return false;
+      }
+
+      Bitmap_Decoder decoder(in_file, request.source.c_str(), error);
+
+      if (!error.empty()) {
+         error = request.source + ": " + error;
+         return false;
+      }
+
+      if (!Frame_Fits(decoder, in_file)) {
+         error = request.source + ": the image is larger than the file or too large to read";
+         return false;
+      }
+
+      frames.Prepare(decoder.Format());
+      Thread_Arena().Reset();
+
+      if (!decoder.Read_Rows(in_file, frames.Front(), error)) {
+         error = request.source + ": " + error;
+         return false;
+      }
+
+      Result_Key key = Make_Result_Key(frames.Front(), request);
+
+      if (!cache.Find(key, result)) {
+         Detect(frames, request, result);
+         cache.Insert(key, result);
+      }
+      return true;
+   }
+
+   if ((long long)request.width * request.height > MAX_IMAGE_PIXELS) {
+      error = "the frame of " + request.source + " is too large";
+      return false;
+   }
+
+   size_t size = (size_t)request.width * request.height;
+   int object = shm_open(request.source.c_str(), O_RDONLY, 0);
+   struct stat status;
+   void *pixels;
+
+   if (object < 0 || fstat(object, &status) != 0 || (size_t)status.st_size < size) {
+      if (object >= 0)
+         close(object);
+      error = "cannot map " + request.source;
+      return false;
+   }
+
+   pixels = mmap(0, size, PROT_READ, MAP_SHARED, object, 0);
+   close(object);
+
+   if (pixels == MAP_FAILED) {
+      error = "cannot map " + request.source;
+      return false;
+   }
+
+   // The rows are stored top down, so the view starts at the last row
+   Image_View frame((byte_t *) pixels + (size_t)(request.height - 1) * request.width,
+                    request.width, request.height, -request.width);
+
+   Result_Key key = Make_Result_Key(frame, request);
+
+   if (cache.Find(key, result)) {
+      munmap(pixels, size);
+      return true;
+   }
+
+   Thread_Arena().Reset();
+   Preprocess_Frame(frame, frames, request);
+   munmap(pixels, size);
+
+   Detect_Edges(frames, request, result);
+   cache.Insert(key, result);
+   return true;
+}
+
+// Stops the server. Once stopping is set under connections_lock, no
+// connection is added to open_connections, so every connection a worker
+// is serving but the one that sent SHUTDOWN is shut down here, and a
+// worker blocked reading one sees it closed.
+static void Stop_Server(Server_State &state, int connection) {
+
+   lock_guard<mutex> guard(state.connections_lock);
+
+   state.stopping = true;
+   shutdown(state.listener, SHUT_RDWR);
+
+   for (set<int>::iterator open = state.open_connections.begin(); open != state.open_connections.end(); ++open) {
+      if (*open != connection)
+         shutdown(*open, SHUT_RDWR);
+   }
+}
+
+// Answers the requests on one connection until the client closes it.
+// SHUTDOWN stops the server, and STATS tells how the cache is doing. A
+// connection taken once the server is stopping is closed unanswered.
+static void Serve_Connection(Server_State &state, Frame_Buffers &frames, int connection) {
+
+   Line_Reader reader;
+   Line_Status status;
+   string line;
+
+   {
+      lock_guard<mutex> guard(state.connections_lock);
+
+      if (state.stopping) {
+         close(connection);
+         return;
+      }
+      state.open_connections.insert(connection);
+   }
+
+   reader.connection = connection;
+   reader.start      = 0;
+   reader.end        = 0;
+
+   while ((status = Receive_Line(reader, line)) != LINE_CLOSED) {
+      Detection_Request request;
+      Detection_Result result;
+      string error;
+
+      if (status == LINE_TOO_LONG) {
+         Send_Text(connection, "ERROR a request is at most " + to_string(REQUEST_LINE_LIMIT) +
+                               " bytes\n");
+         continue;
+      }
+
+      if (line == "SHUTDOWN") {
+         Stop_Server(state, connection);
+         Send_Text(connection, "OK 0 0\nEND\n");
+         break;
+      }
+
+      if (line == "STATS") {
+         Send_Text(connection, "STATS " + to_string(state.cache.Size()) + " " +
+                               to_string(state.cache.Hits()) + "\nEND\n");
+         continue;
+      }
+
+      bool answered;
+
+      try {
+         answered = Parse_Request(line, request, error) &&
+                    Detect_Request(frames, request, state.cache, result, error);
+      }
+      catch (const bad_alloc &) {
+         error = "there is not enough memory for the frame";
+         answered = false;
+      }
+
+      if (!answered) {
+         Send_Text(connection, "ERROR " + error + "\n");
+         continue;
+      }
+
+      Send_Text(connection, Format_Result(result));
+   }
+
+   {
+      lock_guard<mutex> guard(state.connections_lock);
+      state.open_connections.erase(connection);
+   }
+   close(connection);
+}
+
+// A worker. Its frames stay allocated from one request to the next.
+static void Server_Worker(Server_State &state) {
+
+   Frame_Buffers frames;
+   int connection;
+
+   while (state.connections.Take(connection)) {
+      Serve_Connection(state, frames, connection);
+   }
+}
+
+/*------------------------------------------------------------
+   Run_Server
+
+   INPUTS
+   socket_path - Where to listen. A socket already there is removed,
+                 anything else there stops the program.
+   workers     - Requests handled at once, or 0 for one per hardware
+                 thread
+   cache_file  - The index file of the result cache, or 0 to keep the
+                 results in memory only
+
+   DESCRIPTION
+   Listens on a Unix domain socket and answers requests, see
+   Parse_Request and Format_Result, until one of them is SHUTDOWN.
+   Each line of a connection is a request, and the reply is sent before
+   the next line is read, so a client can keep its connection open and
+   pay for nothing but the stages.
+
+   Each worker thread takes a connection and keeps it until the client
+   closes it. The workers keep their frames, and their arenas, from one
+   request to the next, so once the first frame of a size has been
+   seen, a request allocates nothing. The stages share the thread pool.
+
+   The workers share a Result_Cache. A frame that was sent before, with
+   the same parameters, is answered from it without running the stages,
+   which leaves reading and hashing the frame. A STATS request is
+   answered with the results in the cache and the requests it answered,
+
+      STATS <results> <hits>
+      END
+
+   A request that cannot be answered gets an ERROR reply and the server
+   carries on: a line that is not a request, or is longer than
+   REQUEST_LINE_LIMIT, a file that cannot be opened, or is not an image
+   that can be read, or whose headers give more rows than it holds, a
+   frame of more than MAX_IMAGE_PIXELS, and a shared memory object that
+   cannot be mapped.
+
+   SHUTDOWN shuts down the connections of the other clients, so the
+   server stops even while they are connected, and the connections still
+   waiting for a worker are closed unanswered.
+
+   RETURNS
+   Nothing, once the server has stopped
+-------------------------------------------------------------*/
+void Run_Server(const char *socket_path, int workers, const char *cache_file) {
+
+   struct sockaddr_un address;
+
+   if (workers <= 0)
+      workers = max((int)thread::hardware_concurrency(), 1);
+
+   if (strlen(socket_path) >= sizeof(address.sun_path)) {
+      cerr << "Error: the socket path " << socket_path << " is too long\n";
+      exit(109);
+   }
+
+   struct stat status;
+
+   if (lstat(socket_path, &status) == 0) {
+      if (!S_ISSOCK(status.st_mode)) {
+         cerr << "Error: " << socket_path << " is already there and is not a socket\n";
+         exit(109);
+      }
+      unlink(socket_path);
+   }
+
+   Server_State state(workers, cache_file);
+
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, socket_path);
+
+   state.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (state.listener < 0 || bind(state.listener, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+       listen(state.listener, 64) != 0) {
+      cerr << "Error: cannot listen on " << socket_path << "\n";
+      exit(109);
+   }
+
+   vector<thread> threads;
+
+   for (int w = 0; w < workers; w++) {
+      threads.push_back(thread(Server_Worker, ref(state)));
+   }
+
+   while (!state.stopping) {
+      int connection = accept(state.listener, 0, 0);
+
+      if (connection >= 0)
+         state.connections.Put(connection);
+      else if (errno != EINTR)
+         break;
+   }
+
+   state.connections.Close();
+
+   for (size_t w = 0; w < threads.size(); w++) {
+      threads[w].join();
+   }
+
+   close(state.listener);
+   unlink(socket_path);
+}
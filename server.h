@@ -0,0 +1,64 @@
+// server.h
+// Declarations for running the box finding program as a long running
+// server that takes requests on a Unix domain socket.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "components.h"
+#include "process.h"
+#include "pipeline.h"
+
+// Where Run_Server listens when it is given no path
+const char SERVER_SOCKET_PATH[] = "/tmp/vision.sock";
+
+/*-----------------------------------------------------------
+   Detection_Request
+
+   DESCRIPTION
+   One frame to find boxes and lines in, and the parameters of the
+   stages. The frame is an image file, or a shared memory object that
+   holds width x height grey pixels, the top row first. The parameters
+   start out as the ones main uses.
+------------------------------------------------------------*/
+struct Detection_Request {
+   std::string source;
+   bool shared_memory;
+   int width;
+   int height;
+
+   int average_size;
+   int contrast_level;
+   int op_size;
+   int edge_threshold;
+   int min_pixels;
+   int min_span;
+   int line_threshold;
+
+   Detection_Request();
+};
+
+// The boxes around the groups of edges left after Magic_eraser, and the
+// lines through the edges
+struct Detection_Result {
+   std::vector<Component> boxes;
+   std::vector<hough_line_t> lines;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+bool Parse_Request(const std::string &line, Detection_Request &request, std::string &error);
+void Detect(Frame_Buffers &frames, const Detection_Request &request, Detection_Result &result);
+void Preprocess_Frame(bmpBITMAP_FILE &frame, Frame_Buffers &frames, const Detection_Request &request);
+void Detect_Edges(Frame_Buffers &frames, const Detection_Request &request, Detection_Result &result);
+std::string Format_Result(const Detection_Result &result);
+void Run_Server(const char *socket_path = SERVER_SOCKET_PATH, int workers = 0,
+                const char *cache_file = 0);
+// ----------------------------------------------------------
+
+#endif
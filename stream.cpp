@@ -0,0 +1,446 @@
+// stream.cpp
+// Contains the code that reads, preprocesses and writes a bitmap a band
+// of rows at a time.
+
+// Standard header files
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+#include "arena.h"
+#include "preprocess.h"
+#include "stream.h"
+
+using namespace std;
+
+// ----------------------------------------------------------
+// Bitmap_Reader
+
+Bitmap_Reader::Bitmap_Reader(istream &in, const char *file_name) : in(in), decoder(in, file_name) {
+
+   format = decoder.Format();
+   stored.resize(decoder.Row_Bytes());
+
+   Rewind();
+}
+
+void Bitmap_Reader::Read_Row(byte_t *row) {
+
+   // The padding of the previous row is skipped here rather than after
+   // it, so a file whose last row is not padded can still be read.
+   // Rows stored from the top down are read from the last one back.
+   if (decoder.Top_Down())
+      in.seekg(decoder.Data_Offset() +
+               (streamoff)(decoder.Height() - 1 - next_row) * decoder.Row_Stride());
+   else if (next_row > 0 && !decoder.Compressed())
+      in.ignore(decoder.Row_Stride() - decoder.Row_Bytes());
+
+   if (decoder.Compressed()) {
+      decoder.Decode_RLE_Row(in, row, position);
+   }
+   else if (decoder.Verbatim()) {
+      in.read((char *) row, decoder.Width());
+   }
+   else {
+      in.read((char *) stored.data(), decoder.Row_Bytes());
+      decoder.Convert_Row(stored.data(), row);
+   }
+   next_row++;
+
+   if (!in) {
+      cerr << "Error reading row " << next_row - 1 << " of the bitmap\n";
+      exit(107);
+   }
+}
+
+void Bitmap_Reader::Rewind() {
+   in.clear();
+   in.seekg(decoder.Data_Offset());
+   next_row = 0;
+   position.skip_rows = 0;
+   position.column    = 0;
+}
+
+// ----------------------------------------------------------
+// Bitmap_Writer
+
+Bitmap_Writer::Bitmap_Writer(ostream &out, const bmpBITMAP_FILE &format, Image_File_Type type)
+   : out(out), format(format), type(type), next_row(0) {
+
+   int stored_height = Assemble_Integer(format.info_header.biHeight);
+
+   width    = Assemble_Integer(format.info_header.biWidth);
+   height   = abs(stored_height);
+   padding  = Calc_Padding(width);
+   top_down = stored_height < 0;
+
+   switch (type) {
+      case FILE_RLE:
+         // The headers give the size of the rows, so they wait for Finish()
+         row_ends.reserve(height);
+         return;
+
+      case FILE_PGM:
+         out << "P5\n" << width << " " << height << "\n255\n";
+         break;
+
+      case FILE_RAW:
+         break;
+
+      default:
+         out.write((const char *) &format.file_header, sizeof(bmpFILEHEADER));
+         out.write((const char *) &format.info_header, sizeof(bmpINFOHEADER));
+         out.write((const char *) &format.palette, sizeof(bmpPALLETTE));
+         break;
+   }
+
+   data_start = out.tellp();
+
+   if (!out) {
+      cerr << "Error writing the bitmap headers\n";
+      exit(108);
+   }
+}
+
+void Bitmap_Writer::Write_Row(const byte_t *row) {
+
+   static const char zeros[4] = {0};
+
+   switch (type) {
+      case FILE_RLE:
+         RLE8_Row(row, width, encoded);
+         row_ends.push_back(encoded.size());
+         break;
+
+      case FILE_PGM:
+      case FILE_RAW:
+         // The top row goes first, so rows that come from the bottom up
+         // are put in their place
+         if (!top_down) {
+            if (data_start == streampos(-1)) {
+               cerr << "Error: a PGM or raw file is written from the bottom up, "
+                    << "which needs a stream that can seek\n";
+               exit(108);
+            }
+            out.seekp(data_start + (streamoff)(height - 1 - next_row) * width);
+         }
+         out.write((const char *) row, width);
+         break;
+
+      default:
+         out.write((const char *) row, width);
+         out.write(zeros, padding);
+         break;
+   }
+   next_row++;
+
+   if (!out) {
+      cerr << "Error writing bitmap data\n";
+      exit(104);
+   }
+}
+
+void Bitmap_Writer::Finish() {
+
+   if (type == FILE_RLE) {
+      vector<byte_t> stored;
+
+      // An RLE8 bitmap is stored from the bottom up, and each row ends
+      // with the end of a line, the last with the end of the bitmap
+      stored.reserve(encoded.size() + (size_t)next_row * 2);
+
+      for (int k = 0; k < next_row; k++) {
+         int r = top_down ? next_row - 1 - k : k;
+         size_t start = r > 0 ? row_ends[r - 1] : 0;
+
+         stored.insert(stored.end(), encoded.begin() + start, encoded.begin() + row_ends[r]);
+         stored.push_back(0);
+         stored.push_back(k == next_row - 1 ? 1 : 0);
+      }
+
+      Disassemble_Integer(height, format.info_header.biHeight);
+      Write_RLE8_Data(out, format, stored);
+   }
+   else if (type != FILE_BMP && !top_down) {
+      out.seekp(data_start + (streamoff)height * width);
+   }
+
+   out.flush();
+
+   if (!out) {
+      cerr << "Error writing bitmap data\n";
+      exit(104);
+   }
+}
+
+// ----------------------------------------------------------
+// Stream_Preprocess
+
+// format with its height changed to rows and a table of row pointers
+// from the arena, which the caller fills in
+static void Band_Image(Frame_Arena &arena, const bmpBITMAP_FILE &format, int rows,
+                       bmpBITMAP_FILE &band) {
+   band = format;
+   Disassemble_Integer(rows, band.info_header.biHeight);
+   band.image_ptr = arena.Allocate_Array<byte_t *>(rows > 0 ? rows : 1);
+}
+
+// Reads every row from reader and smooths it as Average_Blocks would,
+// handing each row to row_done, in order, once it is final. block has
+// room for size rows.
+static void Average_Rows(Bitmap_Reader &reader, int size, bmpBITMAP_FILE &block,
+                         const function<void(int, byte_t *)> &row_done) {
+   int height = reader.Height();
+
+   reader.Rewind();
+
+   for (int i = 0; i < height; i++) {
+      int top = size > 1 ? i - i % size : i;
+
+      // Average_Blocks leaves the last row of blocks alone
+      if (size <= 1 || top >= height - size) {
+         reader.Read_Row(block.image_ptr[0]);
+         row_done(i, block.image_ptr[0]);
+         continue;
+      }
+
+      reader.Read_Row(block.image_ptr[i - top]);
+
+      if (i - top == size - 1) {
+         Average_Block_Row(block, 0, size);
+
+         for (int a = 0; a < size; a++) {
+            row_done(top + a, block.image_ptr[a]);
+         }
+      }
+   }
+}
+
+// The edge rows waiting to be thinned. Rows first .. first+count-1 are
+// held back to back in rows, which has room for a band and a halo above
+// and below it.
+struct Stream_Bands {
+   byte_t *rows;
+   int first;
+   int count;
+   int band_start;
+   int band_rows;
+   int halo_rows;
+   byte_t *thinned;
+};
+
+// The rows that have to be held before the band can be thinned
+static int Band_Bottom(const Stream_Bands &bands, int height) {
+   return min(bands.band_start + bands.band_rows + bands.halo_rows, height);
+}
+
+// Thins the band with its halo, writes the band and keeps the rows the
+// next band needs
+static void Thin_Band(Stream_Bands &bands, int width, int height,
+                      Thinning_Algorithm algorithm, Bitmap_Writer &writer) {
+   int band_end = min(bands.band_start + bands.band_rows, height);
+   int next_first = max(band_end - bands.halo_rows, 0);
+   int drop = next_first - bands.first;
+
+   // The halo rows of the next band must not be thinned yet, so the
+   // band is thinned in a copy
+   memcpy(bands.thinned, bands.rows, (size_t)bands.count * width);
+
+   Image_View view(bands.thinned, width, bands.count, width);
+   Thin_Edges(view, algorithm);
+
+   for (int i = bands.band_start; i < band_end; i++) {
+      writer.Write_Row(bands.thinned + (size_t)(i - bands.first) * width);
+   }
+
+   memmove(bands.rows, bands.rows + (size_t)drop * width, (size_t)(bands.count - drop) * width);
+   bands.count     -= drop;
+   bands.first      = next_first;
+   bands.band_start = band_end;
+}
+
+static void Stream_Bitmap(Bitmap_Reader &reader, ostream &out, Image_File_Type type,
+                          int average_size, int contrast_level, int op_size, int threshold,
+                          Thinning_Algorithm algorithm, int band_rows, int halo_rows);
+
+/*------------------------------------------------------------
+   Stream_Preprocess
+
+   INPUTS
+   in             - A seekable stream holding an 8 bit bitmap
+   out            - Stream the preprocessed bitmap is written to
+   average_size   - Size of the blocks for Average
+   contrast_level - Level for Change_Contrast
+   op_size        - Size of the Kirsch operator, 3, 5 or 7
+   threshold      - Threshold for Kirsh_detect_egdes
+   algorithm      - Algorithm for Thin_Edges
+   band_rows      - Rows thinned and written at a time
+   halo_rows      - Rows above and below each band thinned with it
+
+   DESCRIPTION
+   Runs Average, Histogram_Equalization, Change_Contrast,
+   Kirsh_detect_egdes and Thin_Edges over the bitmap without ever
+   holding more than a few bands of rows, so the size of the image is
+   only limited by the disk.
+
+   The image is read twice. The first pass smooths the rows and counts
+   the histogram. Equalization and contrast are then one table, which
+   the second pass applies to the smoothed rows as they come. The
+   Kirsch operator reads a ring of its last op_size rows, and its rows
+   wait until a band and the halo below it are ready. Each band is
+   thinned together with its halo, and only the band is written.
+
+   Every stage but thinning gives exactly the result it gives on the
+   whole image. Thinning is done a band at a time. THIN_ZHANG_SUEN only
+   looks at the neighbours of each pixel, so it matches as long as the
+   band settles within halo_rows iterations, which is far more than
+   the edges of Kirsh_detect_egdes need. THIN_STEINFELD_ROSENFELD
+   decides when to stop, and which points to keep, over the whole
+   image, so a few pixels near the bands may differ.
+
+   The rows are handled from the bottom up, as Load_Bitmap_File holds
+   them, and the padding of each row is skipped on input and written
+   on output.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Stream_Preprocess(istream &in, ostream &out, int average_size, int contrast_level,
+                       int op_size, int threshold, Thinning_Algorithm algorithm,
+                       int band_rows, int halo_rows) {
+
+   Bitmap_Reader reader(in);
+
+   Stream_Bitmap(reader, out, FILE_BMP, average_size, contrast_level, op_size, threshold,
+                 algorithm, band_rows, halo_rows);
+}
+
+// Stream_Preprocess from reader to out, written as a file of type
+static void Stream_Bitmap(Bitmap_Reader &reader, ostream &out, Image_File_Type type,
+                          int average_size, int contrast_level, int op_size, int threshold,
+                          Thinning_Algorithm algorithm, int band_rows, int halo_rows) {
+
+   int width  = reader.Width();
+   int height = reader.Height();
+
+   Frame_Arena &arena = Thread_Arena();
+   Arena_Scope scratch(arena);
+
+   // Pass 1: the histogram of the smoothed image
+   int block_rows = max(average_size, 1);
+   byte_t *block_pixels = arena.Allocate_Array<byte_t>((size_t)block_rows * width);
+   bmpBITMAP_FILE block;
+   long long histogram[256] = {0};
+
+   Band_Image(arena, reader.Format(), block_rows, block);
+   for (int a = 0; a < block_rows; a++) {
+      block.image_ptr[a] = block_pixels + (size_t)a * width;
+   }
+
+   Average_Rows(reader, average_size, block, [&](int, byte_t *row) {
+      for (int j = 0; j < width; j++) {
+         histogram[row[j]]++;
+      }
+   });
+
+   byte_t equalized[256];
+   byte_t contrast[256];
+   byte_t levels[256];
+
+   Equalization_Table(histogram, equalized);
+   Contrast_Table(contrast_level, contrast);
+   for (int v = 0; v < 256; v++) {
+      levels[v] = contrast[equalized[v]];
+   }
+
+   // The Kirsch operator reads a ring of the last ring_rows rows, and
+   // writes into the rows waiting to be thinned. Both are reached
+   // through tables of row pointers as tall as the image, so
+   // Kirsh_Edge_Row works with the row numbers of the whole image.
+   int ring_rows = max(op_size, 1) + 1;
+   byte_t *ring = arena.Allocate_Array<byte_t>((size_t)ring_rows * width);
+   bmpBITMAP_FILE smoothed;
+   bmpBITMAP_FILE edges;
+
+   Band_Image(arena, reader.Format(), height, smoothed);
+   Band_Image(arena, reader.Format(), height, edges);
+
+   Stream_Bands bands;
+   int capacity;
+
+   bands.band_rows  = max(band_rows, 1);
+   bands.halo_rows  = max(halo_rows, 0);
+   bands.first      = 0;
+   bands.count      = 0;
+   bands.band_start = 0;
+
+   capacity       = bands.band_rows + 2 * bands.halo_rows;
+   bands.rows     = arena.Allocate_Array<byte_t>((size_t)capacity * width);
+   bands.thinned  = arena.Allocate_Array<byte_t>((size_t)capacity * width);
+
+   // Pass 2
+   Bitmap_Writer writer(out, reader.Format(), type);
+   int next_edge = 0;
+   long edge_elnt = 0;
+
+   Average_Rows(reader, average_size, block, [&](int i, byte_t *row) {
+      byte_t *slot = ring + (size_t)(i % ring_rows) * width;
+
+      for (int j = 0; j < width; j++) {
+         slot[j] = levels[row[j]];
+      }
+      smoothed.image_ptr[i] = slot;
+
+      // Each edge row reads up to op_size-2 rows below it
+      while (next_edge < height && min(max(next_edge + op_size - 2, next_edge), height - 1) <= i) {
+         edges.image_ptr[next_edge] = bands.rows + (size_t)(next_edge - bands.first) * width;
+         edge_elnt += Kirsh_Edge_Row(smoothed, edges, next_edge, op_size, threshold);
+         bands.count++;
+         next_edge++;
+
+         // The last rows may complete more than one band
+         while (bands.band_start < height && bands.first + bands.count == Band_Bottom(bands, height)) {
+            Thin_Band(bands, width, height, algorithm, writer);
+         }
+      }
+   });
+   writer.Finish();
+
+   cout << "there were: " << edge_elnt << " edge elements detected!" << endl;
+}
+
+/*------------------------------------------------------------
+   Stream_Preprocess
+
+   INPUTS
+   in_file_name  - Name of the file to read
+   out_file_name - Name of the file to write
+   The rest are the same as above
+
+   DESCRIPTION
+   Same as above, but reads and writes the named files, of the types
+   File_Type() gives by their extensions. The raw size of a raw file
+   is in its name.
+
+   RETURNS
+   Nothing
+-------------------------------------------------------------*/
+void Stream_Preprocess(const char *in_file_name, const char *out_file_name, int average_size,
+                       int contrast_level, int op_size, int threshold, Thinning_Algorithm algorithm,
+                       int band_rows, int halo_rows) {
+
+   ifstream in_file;
+   ofstream out_file;
+
+   open_input_file(in_file, in_file_name);
+   Open_Output_File(out_file, out_file_name);
+
+   Bitmap_Reader reader(in_file, in_file_name);
+
+   Stream_Bitmap(reader, out_file, File_Type(out_file_name), average_size, contrast_level,
+                 op_size, threshold, algorithm, band_rows, halo_rows);
+}
@@ -0,0 +1,124 @@
+// stream.h
+// Declarations for reading, preprocessing and writing a bitmap a band of
+// rows at a time, for images too large to hold in memory.
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <iostream>
+#include <vector>
+
+#include "image.h"
+#include "preprocess.h"
+
+// Rows thinned together by Stream_Preprocess, and the rows above and
+// below each band that are thinned with it but not written
+const int STREAM_BAND_ROWS = 64;
+const int STREAM_HALO_ROWS = 32;
+
+/*-----------------------------------------------------------
+   Bitmap_Reader
+
+   DESCRIPTION
+   Reads the rows of a bitmap from a stream one at a time, from the
+   bottom of the picture up, as Load_Bitmap_File holds them. Rows that
+   are not 8 bit grey are converted as they are read, see
+   Bitmap_Decoder, and the padding at the end of each row is skipped.
+   Only the headers and one row are kept in memory.
+
+   Given the name of the file, PGM and raw files are read as well, see
+   File_Type(). Their rows, and those of a bitmap whose height is
+   negative, are stored from the top down, so the stream is seeked to
+   each row in turn.
+
+   Rewind() goes back to the first row, so a seekable stream can be
+   read more than once.
+------------------------------------------------------------*/
+class Bitmap_Reader {
+public:
+   // Reads the headers and palette from the start of in
+   explicit Bitmap_Reader(std::istream &in, const char *file_name = 0);
+
+   Bitmap_Reader(const Bitmap_Reader &) = delete;
+   Bitmap_Reader &operator=(const Bitmap_Reader &) = delete;
+
+   int Width() const { return decoder.Width(); }
+   int Height() const { return decoder.Height(); }
+
+   // The headers and palette of the grey rows, with no pixels
+   const bmpBITMAP_FILE &Format() const { return format; }
+
+   // Reads the next row into row, which holds Width() pixels
+   void Read_Row(byte_t *row);
+
+   void Rewind();
+
+private:
+   std::istream &in;
+   Bitmap_Decoder decoder;
+   bmpBITMAP_FILE format;
+   std::vector<byte_t> stored;
+   Bitmap_Decoder::RLE_Position position;
+   int next_row;
+};
+
+/*-----------------------------------------------------------
+   Bitmap_Writer
+
+   DESCRIPTION
+   Writes an image to a stream one row at a time, as a bitmap or as
+   any of the other types of File_Type(). The rows are given in the
+   order Bitmap_Reader reads them: from the bottom up, or from the top
+   down when the height of format is negative.
+
+   A bitmap keeps the order of the rows. Its headers and palette are
+   written first, and each row is followed by its padding.
+
+   PGM and raw files are stored from the top down. Rows given from the
+   bottom up are put in their place with seekp(), so out has to be a
+   file, or another stream that can seek, for those.
+
+   An RLE8 bitmap is stored from the bottom up, and its headers give
+   the size of the compressed rows, so the rows are compressed as they
+   come and held until Finish() writes the file. Edge maps compress to
+   a small part of their size.
+
+   Finish() is called after the last row.
+------------------------------------------------------------*/
+class Bitmap_Writer {
+public:
+   // Writes the headers of format to out, if they go first
+   Bitmap_Writer(std::ostream &out, const bmpBITMAP_FILE &format, Image_File_Type type = FILE_BMP);
+
+   Bitmap_Writer(const Bitmap_Writer &) = delete;
+   Bitmap_Writer &operator=(const Bitmap_Writer &) = delete;
+
+   void Write_Row(const byte_t *row);
+   void Finish();
+
+private:
+   std::ostream &out;
+   bmpBITMAP_FILE format;
+   Image_File_Type type;
+   int width;
+   int height;
+   int padding;
+   bool top_down;
+   int next_row;
+   std::streampos data_start;
+   std::vector<byte_t> encoded;
+   std::vector<size_t> row_ends;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+void Stream_Preprocess(std::istream &in, std::ostream &out, int average_size, int contrast_level,
+                       int op_size, int threshold, Thinning_Algorithm algorithm,
+                       int band_rows = STREAM_BAND_ROWS, int halo_rows = STREAM_HALO_ROWS);
+void Stream_Preprocess(const char *in_file_name, const char *out_file_name, int average_size,
+                       int contrast_level, int op_size, int threshold, Thinning_Algorithm algorithm,
+                       int band_rows = STREAM_BAND_ROWS, int halo_rows = STREAM_HALO_ROWS);
+// ----------------------------------------------------------
+
+#endif
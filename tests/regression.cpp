@@ -0,0 +1,2481 @@
+// regression.cpp
+// Golden-image regression harness for the image processing stages.
+//
+// Every stage is run on images/im1.bmp .. images/im7.bmp. Stages that have
+// expected output in tests/<stage>/test1.bmp .. test7.bmp are compared
+// against it pixel-for-pixel. Every additional backend registered for a
+// stage is compared against the stage's reference (first) backend.
+//
+// Usage (from the top of the repository):
+//    tests/regression [stage name ...]
+
+// Standard header files
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// POSIX header files
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Classes
+#include "../image.h"
+#include "../preprocess.h"
+#include "../process.h"
+#include "../components.h"
+#include "../runs.h"
+#include "../pipeline.h"
+#include "../stream.h"
+#include "../batch.h"
+#include "../server.h"
+#include "../ring.h"
+#include "../cache.h"
+
+const int INPUT_COUNT = 7;
+
+// A single implementation of a stage. The image is modified in place.
+struct Stage_Backend {
+   const char *name;
+   void (*run)(bmpBITMAP_FILE &image);
+};
+
+// A stage, its golden output directory (or 0 if there is none), and the
+// backends that implement it. backends[0] is the reference implementation.
+// The other backends may differ from it by up to tolerance levels.
+struct Regression_Stage {
+   const char *name;
+   const char *golden_dir;
+   int tolerance;
+   vector<Stage_Backend> backends;
+};
+
+// Summary of the differences between two images
+struct Diff_Summary {
+   long mismatches;
+   long pixels;
+   int max_diff;
+   int first_row;
+   int first_col;
+   int min_row;
+   int min_col;
+   int max_row;
+   int max_col;
+};
+
+// Copies the pixels of src over those of dst, which must be the same size
+void Copy_Pixels(bmpBITMAP_FILE &src, bmpBITMAP_FILE &dst) {
+   int height = Assemble_Integer(src.info_header.biHeight);
+   int width  = Assemble_Integer(src.info_header.biWidth);
+
+   for (int i = 0; i < height; i++) {
+      memcpy(dst.image_ptr[i], src.image_ptr[i], width);
+   }
+}
+
+// Exchanges the headers and pixels of two images, so a result takes the
+// place of the image without a copy. Both must own their pixels.
+void Swap_Image(bmpBITMAP_FILE &image_a, bmpBITMAP_FILE &image_b) {
+   bmpBITMAP_FILE temp = image_a;
+
+   image_a = image_b;
+   image_b = temp;
+}
+
+// ----------------------------------------------------------
+// Stage wrappers
+
+void Run_Histogram_Equalization(bmpBITMAP_FILE &image) {
+   Histogram_Equalization(image);
+}
+
+void Run_Change_Contrast(bmpBITMAP_FILE &image) {
+   Change_Contrast(image, 2);
+}
+
+// Straightforward box blur, summing the whole window for each pixel
+void Reference_Box_Blur(bmpBITMAP_FILE &image, int radius) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   bmpBITMAP_FILE blurred;
+
+   Copy_Image(image, blurred);
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         int sum = 0;
+         int count = 0;
+
+         for (int a = max(i - radius, 0); a <= min(i + radius, height - 1); a++) {
+            for (int b = max(j - radius, 0); b <= min(j + radius, width - 1); b++) {
+               sum += image.image_ptr[a][b];
+               count++;
+            }
+         }
+         blurred.image_ptr[i][j] = (sum + count / 2) / count;
+      }
+   }
+
+   Swap_Image(image, blurred);
+   Remove_Image(blurred);
+}
+
+void Run_Reference_Box_Blur_3(bmpBITMAP_FILE &image) {
+   Reference_Box_Blur(image, 3);
+}
+
+void Run_Box_Blur_3(bmpBITMAP_FILE &image) {
+   Box_Blur(image, 3);
+}
+
+void Run_Reference_Box_Blur_12(bmpBITMAP_FILE &image) {
+   Reference_Box_Blur(image, 12);
+}
+
+void Run_Box_Blur_12(bmpBITMAP_FILE &image) {
+   static Frame_Buffers frames;
+
+   frames.Load(image);
+   Box_Blur(frames, 12);
+   Copy_Pixels(frames.Front(), image);
+}
+
+// Gaussian blur computed in double precision, with the edge pixels
+// repeated past the border
+void Reference_Gaussian_Blur(bmpBITMAP_FILE &image, double sigma) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   int radius = int(ceil(3 * sigma));
+   vector<double> weights(2 * radius + 1);
+   vector<double> rows((size_t)height * width);
+   double total = 0;
+
+   for (int k = -radius; k <= radius; k++) {
+      weights[k + radius] = exp(-0.5 * k * k / (sigma * sigma));
+      total += weights[k + radius];
+   }
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         double sum = 0;
+
+         for (int k = -radius; k <= radius; k++) {
+            sum += weights[k + radius] * image.image_ptr[i][min(max(j + k, 0), width - 1)];
+         }
+         rows[(size_t)i * width + j] = sum / total;
+      }
+   }
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         double sum = 0;
+
+         for (int k = -radius; k <= radius; k++) {
+            sum += weights[k + radius] * rows[(size_t)min(max(i + k, 0), height - 1) * width + j];
+         }
+         image.image_ptr[i][j] = int(sum / total + 0.5);
+      }
+   }
+}
+
+void Run_Reference_Gaussian_1_5(bmpBITMAP_FILE &image) {
+   Reference_Gaussian_Blur(image, 1.5);
+}
+
+void Run_Gaussian_Kernel_1_5(bmpBITMAP_FILE &image) {
+   Gaussian_Blur(image, 1.5f);
+}
+
+void Run_Reference_Gaussian_6(bmpBITMAP_FILE &image) {
+   Reference_Gaussian_Blur(image, 6);
+}
+
+void Run_Gaussian_Recursive_6(bmpBITMAP_FILE &image) {
+   static Frame_Buffers frames;
+
+   frames.Load(image);
+   Gaussian_Blur(frames, 6.0f);
+   Copy_Pixels(frames.Front(), image);
+}
+
+// Straightforward median filter, partially sorting the whole window for
+// each pixel. The edge pixels are repeated past the border.
+void Reference_Median_Filter(bmpBITMAP_FILE &image, int radius) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   bmpBITMAP_FILE filtered;
+   vector<byte_t> window;
+
+   Copy_Image(image, filtered);
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         window.clear();
+
+         for (int a = i - radius; a <= i + radius; a++) {
+            for (int b = j - radius; b <= j + radius; b++) {
+               window.push_back(image.image_ptr[min(max(a, 0), height - 1)]
+                                               [min(max(b, 0), width - 1)]);
+            }
+         }
+         nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+         filtered.image_ptr[i][j] = window[window.size() / 2];
+      }
+   }
+
+   Swap_Image(image, filtered);
+   Remove_Image(filtered);
+}
+
+void Run_Median_Network(bmpBITMAP_FILE &image, int radius) {
+   Image filtered = Image::Same_Format(image);
+
+   Median_Filter_Network(image, filtered, radius);
+   Swap_Image(image, filtered);
+}
+
+void Run_Median_Histogram(bmpBITMAP_FILE &image, int radius) {
+   Image filtered = Image::Same_Format(image);
+
+   Median_Filter_Histogram(image, filtered, radius);
+   Swap_Image(image, filtered);
+}
+
+void Run_Reference_Median_1(bmpBITMAP_FILE &image) {
+   Reference_Median_Filter(image, 1);
+}
+
+void Run_Median_Network_1(bmpBITMAP_FILE &image) {
+   Run_Median_Network(image, 1);
+}
+
+void Run_Median_Histogram_1(bmpBITMAP_FILE &image) {
+   Run_Median_Histogram(image, 1);
+}
+
+void Run_Reference_Median_2(bmpBITMAP_FILE &image) {
+   Reference_Median_Filter(image, 2);
+}
+
+void Run_Median_Network_2(bmpBITMAP_FILE &image) {
+   Run_Median_Network(image, 2);
+}
+
+void Run_Median_Histogram_2(bmpBITMAP_FILE &image) {
+   Run_Median_Histogram(image, 2);
+}
+
+void Run_Reference_Median_5(bmpBITMAP_FILE &image) {
+   Reference_Median_Filter(image, 5);
+}
+
+void Run_Median_Frames_5(bmpBITMAP_FILE &image) {
+   static Frame_Buffers frames;
+
+   frames.Load(image);
+   Median_Filter(frames, 5);
+   Copy_Pixels(frames.Front(), image);
+}
+
+void Run_Kirsh(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+}
+
+// The frames are kept between runs so that reusing them is tested too
+void Run_Kirsh_Frames(bmpBITMAP_FILE &image) {
+   static Frame_Buffers frames;
+
+   frames.Load(image);
+   Kirsh_detect_egdes(frames, 7, 550);
+   Copy_Pixels(frames.Front(), image);
+}
+
+// Sobel gradient of pixel (i, j) and the offset to the neighbour along it
+int Reference_Gradient(bmpBITMAP_FILE &image, int i, int j, int &di, int &dj) {
+   byte_t **p = image.image_ptr;
+   int gx = (p[i-1][j+1] + 2 * p[i][j+1] + p[i+1][j+1]) - (p[i-1][j-1] + 2 * p[i][j-1] + p[i+1][j-1]);
+   int gy = (p[i+1][j-1] + 2 * p[i+1][j] + p[i+1][j+1]) - (p[i-1][j-1] + 2 * p[i-1][j] + p[i-1][j+1]);
+
+   if (abs(gy) * 70 < abs(gx) * 29) {
+      di = 0;
+      dj = 1;
+   }
+   else if (abs(gx) * 70 < abs(gy) * 29) {
+      di = 1;
+      dj = 0;
+   }
+   else {
+      di = 1;
+      dj = (gx > 0) == (gy > 0) ? 1 : -1;
+   }
+   return abs(gx) + abs(gy);
+}
+
+// Canny detector written directly from its definition. The edges are
+// grown from the strong pixels by sweeping the image until nothing changes.
+void Reference_Canny(bmpBITMAP_FILE &image, int low_threshold, int high_threshold) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<vector<int> > magnitude(height, vector<int>(width, 0));
+   vector<vector<int> > state(height, vector<int>(width, 0));
+   bool changed = true;
+   int di, dj;
+
+   for (int i = 1; i < height - 1; i++) {
+      for (int j = 1; j < width - 1; j++) {
+         magnitude[i][j] = Reference_Gradient(image, i, j, di, dj);
+      }
+   }
+
+   for (int i = 1; i < height - 1; i++) {
+      for (int j = 1; j < width - 1; j++) {
+         int m = Reference_Gradient(image, i, j, di, dj);
+
+         if (m >= low_threshold && m > magnitude[i-di][j-dj] && m >= magnitude[i+di][j+dj])
+            state[i][j] = m >= high_threshold ? 2 : 1;
+      }
+   }
+
+   while (changed) {
+      changed = false;
+
+      for (int i = 1; i < height - 1; i++) {
+         for (int j = 1; j < width - 1; j++) {
+            if (state[i][j] != 1)
+               continue;
+
+            for (int a = i - 1; a <= i + 1; a++) {
+               for (int b = j - 1; b <= j + 1; b++) {
+                  if (state[a][b] == 2 && state[i][j] == 1) {
+                     state[i][j] = 2;
+                     changed = true;
+                  }
+               }
+            }
+         }
+      }
+   }
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         image.image_ptr[i][j] = state[i][j] == 2 ? 0 : 255;
+      }
+   }
+}
+
+void Run_Reference_Canny(bmpBITMAP_FILE &image) {
+   Reference_Canny(image, 100, 250);
+}
+
+void Run_Canny_Frames(bmpBITMAP_FILE &image) {
+   static Frame_Buffers frames;
+
+   frames.Load(image);
+   Canny_detect_egdes(frames, 100, 250);
+   Copy_Pixels(frames.Front(), image);
+}
+
+void Run_Canny_Runs(bmpBITMAP_FILE &image) {
+   Edge_Runs runs;
+
+   Canny_Edge_Runs(image, 100, 250, runs);
+   Decode_Runs(runs, image);
+}
+
+// Zhang-Suen thinning written directly from its definition, deleting the
+// marked pixels of each subiteration once the whole image is checked
+void Reference_Zhang_Suen(bmpBITMAP_FILE &image) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<vector<int> > black(height, vector<int>(width));
+   bool changed = true;
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         black[i][j] = image.image_ptr[i][j] == 0;
+      }
+   }
+
+   while (changed) {
+      changed = false;
+
+      for (int subiteration = 0; subiteration < 2; subiteration++) {
+         vector<pair<int, int> > marked;
+
+         for (int i = 1; i < height - 1; i++) {
+            for (int j = 1; j < width - 1; j++) {
+               // P2 .. P9 clockwise from the pixel above
+               int p[8] = { black[i-1][j], black[i-1][j+1], black[i][j+1], black[i+1][j+1],
+                            black[i+1][j], black[i+1][j-1], black[i][j-1], black[i-1][j-1] };
+               int count = 0;
+               int transitions = 0;
+
+               if (!black[i][j])
+                  continue;
+
+               for (int k = 0; k < 8; k++) {
+                  count += p[k];
+                  if (!p[k] && p[(k + 1) % 8])
+                     transitions++;
+               }
+
+               if (count < 2 || count > 6 || transitions != 1)
+                  continue;
+
+               if (subiteration == 0 && ((p[0] && p[2] && p[4]) || (p[2] && p[4] && p[6])))
+                  continue;
+               if (subiteration == 1 && ((p[0] && p[2] && p[6]) || (p[0] && p[4] && p[6])))
+                  continue;
+
+               marked.push_back(make_pair(i, j));
+            }
+         }
+
+         for (size_t m = 0; m < marked.size(); m++) {
+            black[marked[m].first][marked[m].second] = 0;
+         }
+         if (!marked.empty())
+            changed = true;
+      }
+   }
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         image.image_ptr[i][j] = black[i][j] ? 0 : 255;
+      }
+   }
+}
+
+void Run_Reference_Zhang_Suen(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+   Reference_Zhang_Suen(image);
+}
+
+void Run_Zhang_Suen(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+}
+
+// Erases small components found one at a time by a breadth-first flood
+// fill from each unvisited edge element
+void Reference_Magic_eraser(bmpBITMAP_FILE &image, int min_pixels, int min_span) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<vector<bool> > visited(height, vector<bool>(width, false));
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         vector<pair<int, int> > component;
+         int top = i, bottom = i, left = j, right = j;
+
+         if (visited[i][j] || image.image_ptr[i][j] != 0)
+            continue;
+
+         visited[i][j] = true;
+         component.push_back(make_pair(i, j));
+
+         for (size_t next = 0; next < component.size(); next++) {
+            int a = component[next].first;
+            int b = component[next].second;
+
+            top    = min(top, a);
+            bottom = max(bottom, a);
+            left   = min(left, b);
+            right  = max(right, b);
+
+            for (int y = max(a - 1, 0); y <= min(a + 1, height - 1); y++) {
+               for (int x = max(b - 1, 0); x <= min(b + 1, width - 1); x++) {
+                  if (!visited[y][x] && image.image_ptr[y][x] == 0) {
+                     visited[y][x] = true;
+                     component.push_back(make_pair(y, x));
+                  }
+               }
+            }
+         }
+
+         if ((int)component.size() < min_pixels &&
+             max(bottom - top + 1, right - left + 1) < min_span) {
+            for (size_t p = 0; p < component.size(); p++) {
+               image.image_ptr[component[p].first][component[p].second] = 255;
+            }
+         }
+      }
+   }
+}
+
+void Run_Reference_Magic_eraser(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   Reference_Magic_eraser(image, 60, 31);
+}
+
+void Run_Magic_eraser(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   Magic_eraser(image, 60, 31);
+}
+
+void Run_Magic_eraser_Runs(bmpBITMAP_FILE &image) {
+   Edge_Runs runs;
+
+   Kirsh_detect_egdes(image, 7, 550);
+   Zhang_Suen_Thin_Edges(image, runs);
+   Magic_eraser(runs, 60, 31);
+   Decode_Runs(runs, image);
+}
+
+void Run_dustin_Hough(bmpBITMAP_FILE &image) {
+   Image lines = Image::Same_Format(image);
+
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   Magic_eraser(image, 60, 31);
+   dustin_Hough_Transform(image, lines, 150);
+   Swap_Image(image, lines);
+}
+
+void Run_dustin_Hough_Runs(bmpBITMAP_FILE &image) {
+   Edge_Runs runs;
+
+   Kirsh_detect_egdes(image, 7, 550);
+   Zhang_Suen_Thin_Edges(image, runs);
+   Magic_eraser(runs, 60, 31);
+   dustin_Hough_Transform(runs, image, 150);
+}
+
+// The windowed line detector as it was before the direction table, with
+// every direction unrolled by hand
+void Reference_Hough_transform(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges, int reduction, int window, int std_dev_threshold, int presence_threshold, int outline) {
+
+   int bitmap_width;
+   int bitmap_height;
+   int threshold;
+   int x_inc;
+   int y_inc;
+   int hough_histogram[16] = {0};
+
+   bitmap_height = Assemble_Integer(image.info_header.biHeight);
+   bitmap_width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = 0; i < bitmap_height; i++) {
+      for (int j = 0; j < bitmap_width; j++) {
+         final_edges.image_ptr[i][j] = 255;
+      }
+   }
+
+   // Create Hough Histogram
+   // It is setup currently to check for 16 different degrees of angles:
+   // We are checking for lines that would be drawn from + to *
+   //
+   //                      * | *
+   //                      * | *
+   //                    * * * * *
+   //                * * *   |   * * *
+   //          - - - - - - - + - * - - - - -
+   //                        |
+   //
+   // The histogram is represented correspondingly:
+   // hough_histogram[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15]
+   //
+   //                      9 | 7
+   //                     10 | 6
+   //                   1211 8 5 4
+   //               151413   |   3 2 1
+   //          - - - - - - - + - 0 - - - - -
+   //                        |
+
+   for (int i = 0; i < bitmap_height-window; i += window) {
+      for (int j = 0; j < bitmap_width-window; j += window) {
+
+         for(int a = i; a < i+window; a++) {
+            for(int b = j; b < j+window; b++) {
+               if(int(image.image_ptr[a][b]) == 0) {
+
+                  // Check for horizontal (0 degree) lines
+                  x_inc = 2;
+                  while(b-x_inc > j) {
+                     if(int(image.image_ptr[a][b-x_inc]) == 0) { hough_histogram[0]++; }
+                     x_inc += 2;
+                  }
+
+                  if(a-1 >= i){
+
+                     // Check for (~11.25 degree) lines
+                     x_inc = 4;
+                     y_inc = 1;
+                     while(b-x_inc > j && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[1]++; }
+                        x_inc += 4;
+                        y_inc++;
+                     }
+
+                     // Check for (~22.5 degree) lines
+                     x_inc = 3;
+                     y_inc = 1;
+                     while(b-x_inc > j && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[2]++; }
+                        x_inc += 3;
+                        y_inc++;
+                     }
+
+                     // Check for (~33.75 degree) lines
+                     x_inc = 2;
+                     y_inc = 1;
+                     while(b-x_inc > j && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[3]++; }
+                        x_inc += 2;
+                        y_inc++;
+                     }
+
+                     // Check for (45 degree) lines
+                     x_inc = 2;
+                     y_inc = 2;
+                     while(b-x_inc > j && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[4]++; }
+                        x_inc += 2;
+                        y_inc += 2;
+                     }
+
+                     if(a-2 >= i){
+
+                        // Check for (~56.25 degree) lines
+                        x_inc = 1;
+                        y_inc = 2;
+                        while(b-x_inc > j && a-y_inc > i) {
+                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[5]++; }
+                           x_inc++;
+                           y_inc += 2;
+                        }
+
+                        if(a-3 >= i){
+
+                           // Check for (~67.5 degree) lines
+                           x_inc = 1;
+                           y_inc = 3;
+                           while(b-x_inc > j && a-y_inc > i) {
+                              if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[6]++; }
+                              x_inc++;
+                              y_inc += 3;
+                           }
+
+                           if(a-4 >= i){
+
+                              // Check for (~78.75 degree) lines
+                              x_inc = 1;
+                              y_inc = 4;
+                              while(b-x_inc > j && a-y_inc > i) {
+                                 if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { hough_histogram[7]++; }
+                                 x_inc++;
+                                 y_inc += 4;
+                              }
+
+                              // Check for (90 degree) lines
+                              y_inc = 2;
+                              while(a-y_inc > i) {
+                                 if(int(image.image_ptr[a-y_inc][b]) == 0) { hough_histogram[8]++; }
+                                 y_inc += 2;
+                              }
+
+                              // Check for (~101.25 degree) lines
+                              x_inc = 1;
+                              y_inc = 4;
+                              while(b+x_inc < j+window && a-y_inc > i) {
+                                 if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[9]++; }
+                                 x_inc++;
+                                 y_inc += 4;
+                              }
+                           }
+
+                           // Check for (~112.5 degree) lines
+                           x_inc = 1;
+                           y_inc = 3;
+                           while(b+x_inc < j+window && a-y_inc > i) {
+                              if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[10]++; }
+                              x_inc++;
+                              y_inc += 3;
+                           }
+                        }
+
+                        // Check for (~123.75 degree) lines
+                        x_inc = 1;
+                        y_inc = 2;
+                        while(b+x_inc < j+window && a-y_inc > i) {
+                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[11]++; }
+                           x_inc++;
+                           y_inc += 2;
+                        }
+                     }
+
+                     // Check for (135 degree) lines
+                     x_inc = 2;
+                     y_inc = 2;
+                     while(b+x_inc < j+window && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[12]++; }
+                        x_inc += 2;
+                        y_inc += 2;
+                     }
+
+                     // Check for (~146.25 degree) lines
+                     x_inc = 2;
+                     y_inc = 1;
+                     while(b+x_inc < j+window && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[13]++; }
+                        x_inc += 2;
+                        y_inc++;
+                     }
+
+                     // Check for (~157.5 degree) lines
+                     x_inc = 3;
+                     y_inc = 1;
+                     while(b+x_inc < j+window && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[14]++; }
+                        x_inc += 3;
+                        y_inc++;
+                     }
+
+                     // Check for (~168.75 degree) lines
+                     x_inc = 4;
+                     y_inc = 1;
+                     while(b+x_inc < j+window && a-y_inc > i) {
+                        if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { hough_histogram[15]++; }
+                        x_inc += 4;
+                        y_inc++;
+                     }
+                  }
+               }
+            }
+         }
+
+         // Measurements of the hough_histogram
+         long average = 0;
+         long std_dev = 0;
+         long intermediate;
+
+         // Find average
+         for(int ic = 0; ic < 16; ic++) {
+            average += hough_histogram[ic];
+         }
+
+         average = average/16;
+
+         // Find standard deviation
+         for(int ic = 0; ic < 16; ic++) {
+            intermediate = hough_histogram[ic] - average;
+            std_dev += pow(intermediate,2);
+         }
+
+         std_dev = sqrt(std_dev/16);
+
+         threshold = hough_histogram[0];
+
+         for(int ic = 1; ic < 16; ic++) {
+            if(hough_histogram[ic] > threshold) {
+               threshold = hough_histogram[ic];
+            }
+         }
+
+         threshold -= reduction;
+
+         int presence;
+         if(std_dev > std_dev_threshold) {
+
+            for(int a = i; a < i+window; a++) {
+               for(int b = j; b < j+window; b++) {
+                  if(int(image.image_ptr[a][b]) == 0) {
+
+                     // Write in horizontal (0 degree) lines
+                     x_inc = 2;
+                     presence = 0;
+
+                     // First measure presence
+                     while(b-x_inc > j && hough_histogram[0] > threshold) {
+                        if(int(image.image_ptr[a][b-x_inc]) == 0) { presence++; }
+                        x_inc += 2;
+                     }
+
+                     // If presence passes threshold, draw line. (Example in POD)
+                     if(presence > presence_threshold) {
+                        x_inc = 2;
+                        while(b-x_inc > j) {
+                           final_edges.image_ptr[a][b-x_inc] = 0;
+                           x_inc += 2;
+                        }
+                     }
+
+                     if(a-1 >= i) {
+
+                        // Write in (~11.25 degree) lines
+                        x_inc = 4;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b-x_inc > j && a-y_inc > i && hough_histogram[1] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                           x_inc += 4;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 4;
+                           y_inc = 1;
+                           while(b-x_inc > j && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                              x_inc += 4;
+                              y_inc++;
+                           }
+                        }
+
+                        // Write in (~22.5 degree) lines
+                        x_inc = 3;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b-x_inc > j && a-y_inc > i && hough_histogram[2] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                           x_inc += 3;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 3;
+                           y_inc = 1;
+                           while(b-x_inc > j && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                              x_inc += 3;
+                              y_inc++;
+                           }
+                        }
+
+                        // Write in (~33.75 degree) lines
+                        x_inc = 2;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b-x_inc > j && a-y_inc > i && hough_histogram[3] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                           x_inc += 2;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 2;
+                           y_inc = 1;
+                           while(b-x_inc > j && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                              x_inc += 2;
+                              y_inc++;
+                           }
+                        }
+
+                        // Write in (45 degree) lines
+                        x_inc = 2;
+                        y_inc = 2;
+                        presence = 0;
+                        while(b-x_inc > j && a-y_inc > i && hough_histogram[4] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                           x_inc += 2;
+                           y_inc += 2;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 2;
+                           y_inc = 2;
+                           while(b-x_inc > j && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                              x_inc += 2;
+                              y_inc += 2;
+                           }
+                        }
+
+                        if(a-2 >= i){
+
+                           // Write in (~56.25 degree) lines
+                           x_inc = 1;
+                           y_inc = 2;
+                           presence = 0;
+                           while(b-x_inc > j && a-y_inc > i && hough_histogram[5] > threshold) {
+                              if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                              x_inc++;
+                              y_inc += 2;
+                           }
+
+                           if(presence > presence_threshold) {
+                              x_inc = 1;
+                              y_inc = 2;
+                              while(b-x_inc > j && a-y_inc > i) {
+                                 final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                                 x_inc++;
+                                 y_inc += 2;
+                              }
+                           }
+
+                           if(a-3 >= i){
+
+                              // Write in (~67.5 degree) lines
+                              x_inc = 1;
+                              y_inc = 3;
+                              presence = 0;
+                              while(b-x_inc > j && a-y_inc > i && hough_histogram[6] > threshold) {
+                                 if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                                 x_inc++;
+                                 y_inc += 3;
+                              }
+
+                              if(presence > presence_threshold) {
+                                 x_inc = 1;
+                                 y_inc = 3;
+                                 while(b-x_inc > j && a-y_inc > i) {
+                                    final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                                    x_inc++;
+                                    y_inc += 3;
+                                 }
+                              }
+
+                              if(a-4 >= i){
+
+                                 // Write in (~78.75 degree) lines
+                                 x_inc = 1;
+                                 y_inc = 4;
+                                 presence = 0;
+                                 while(b-x_inc > j && a-y_inc > i && hough_histogram[7] > threshold) {
+                                    if(int(image.image_ptr[a-y_inc][b-x_inc]) == 0) { presence++; }
+                                    x_inc++;
+                                    y_inc += 4;
+                                 }
+
+                                 if(presence > presence_threshold) {
+                                    x_inc = 1;
+                                    y_inc = 4;
+                                    while(b-x_inc > j && a-y_inc > i) {
+                                       final_edges.image_ptr[a-y_inc][b-x_inc] = 0;
+                                       x_inc++;
+                                       y_inc += 4;
+                                    }
+                                 }
+
+                                 // Write in (90 degree) lines
+                                 y_inc = 2;
+                                 presence = 0;
+                                 while(a-y_inc > i && hough_histogram[8] > threshold) {
+                                    if(int(image.image_ptr[a-y_inc][b]) == 0) { presence++; }
+                                    y_inc += 2;
+                                 }
+
+                                 if(presence > presence_threshold) {
+                                    y_inc = 2;
+                                    while(a-y_inc > i) {
+                                       final_edges.image_ptr[a-y_inc][b] = 0;
+                                       y_inc += 2;
+                                    }
+                                 }
+
+                                 // Write in (~101.25 degree) lines
+                                 x_inc = 1;
+                                 y_inc = 4;
+                                 presence = 0;
+                                 while(b+x_inc < j+window && a-y_inc > i && hough_histogram[9] > threshold) {
+                                    if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                                    x_inc++;
+                                    y_inc += 4;
+                                 }
+
+                                 if(presence > presence_threshold) {
+                                    x_inc = 1;
+                                    y_inc = 4;
+                                    while(b+x_inc < j+window && a-y_inc > i) {
+                                       final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                                       x_inc++;
+                                       y_inc += 4;
+                                    }
+                                 }
+                              }
+
+                              // Write in (~112.5 degree) lines
+                              x_inc = 1;
+                              y_inc = 3;
+                              presence = 0;
+                              while(b+x_inc < j+window && a-y_inc > i && hough_histogram[10] > threshold) {
+                                 if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                                 x_inc++;
+                                 y_inc += 3;
+                              }
+
+                              if(presence > presence_threshold) {
+                                 x_inc = 1;
+                                 y_inc = 3;
+                                 while(b+x_inc < j+window && a-y_inc > i) {
+                                    final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                                    x_inc++;
+                                    y_inc += 3;
+                                 }
+                              }
+                           }
+
+                           // Write in (~123.75 degree) lines
+                           x_inc = 1;
+                           y_inc = 2;
+                           presence = 0;
+                           while(b+x_inc < j+window && a-y_inc > i && hough_histogram[11] > threshold) {
+                              if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                              x_inc++;
+                              y_inc += 2;
+                           }
+
+                           if(presence > presence_threshold) {
+                              x_inc = 1;
+                              y_inc = 2;
+                              while(b+x_inc < j+window && a-y_inc > i) {
+                                 final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                                 x_inc++;
+                                 y_inc += 2;
+                              }
+                           }
+                        }
+
+                        // Write in (135 degree) lines
+                        x_inc = 2;
+                        y_inc = 2;
+                        presence = 0;
+                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[12] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                           x_inc += 2;
+                           y_inc += 2;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 2;
+                           y_inc = 2;
+                           while(b+x_inc < j+window && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                              x_inc += 2;
+                              y_inc += 2;
+                           }
+                        }
+
+                        // Write in (~146.25 degree) lines
+                        x_inc = 2;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[13] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                           x_inc += 2;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 2;
+                           y_inc = 1;
+                           while(b+x_inc < j+window && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                              x_inc += 2;
+                              y_inc++;
+                           }
+                        }
+
+                        // Check for (~157.5 degree) lines
+                        x_inc = 3;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[14] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                           x_inc += 3;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 3;
+                           y_inc = 1;
+                           while(b+x_inc < j+window && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                              x_inc += 3;
+                              y_inc++;
+                           }
+                        }
+
+                        // Check for (~168.75 degree) lines
+                        x_inc = 4;
+                        y_inc = 1;
+                        presence = 0;
+                        while(b+x_inc < j+window && a-y_inc > i && hough_histogram[15] > threshold) {
+                           if(int(image.image_ptr[a-y_inc][b+x_inc]) == 0) { presence++; }
+                           x_inc += 4;
+                           y_inc++;
+                        }
+
+                        if(presence > presence_threshold) {
+                           x_inc = 4;
+                           y_inc = 1;
+                           while(b+x_inc < j+window && a-y_inc > i) {
+                              final_edges.image_ptr[a-y_inc][b+x_inc] = 0;
+                              x_inc += 4;
+                              y_inc++;
+                           }
+                        }
+                     }
+                  }
+
+                  // Optional parameter allows the outline of the window to be printed out
+                  if(outline && (a == i+window-1 || a == i || b == j+window-1 || b == j)) {
+                     final_edges.image_ptr[a][b] = 0;
+                  }
+               }
+            }
+
+         }
+
+         // Prints a snap shot of one window of the image.
+         // The snap shot will include the number of edge elements that voted for each line,
+         // the estabilshed threshold for this window, and the standard deviation of the
+         // hough_histogram for this window.
+         if(j > 400 && j < 500 && i > 400 && i < 500) {
+
+            for(int a = i; a < i+window; a++) {
+               for(int b = j; b < j+window; b++) {
+                  if(outline && (a == i+window-3 || a == i || b == j+window-3 || b == j)) {
+                     final_edges.image_ptr[a][b] = 0;
+                  }
+               }
+            }
+
+            cout << "Hough Histogram for first block horizontal lines:" << endl;
+            for(int i = 0; i < 16; i++) {
+               cout << "Angle: " << i << " " << hough_histogram[i] << endl;
+            }
+            cout << "Threshold: " << threshold << endl;
+            cout << "STDDEV: " << std_dev << endl;
+         }
+
+         // Reinitilize hough_histogram to zeros.
+         for(int i = 0; i < 16; i++) {
+            hough_histogram[i] = 0;
+         }
+
+      }
+   }
+}
+
+// Runs the windowed line detector on the thinned Kirsch edges with the
+// window snapshot it prints sent nowhere
+void Run_Hough(bmpBITMAP_FILE &image, int reduction, int window, int std_dev_threshold,
+               int presence_threshold, int outline, int directions, bool reference) {
+   Image lines = Image::Same_Format(image);
+   streambuf *console = cout.rdbuf(0);
+
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   if (reference)
+      Reference_Hough_transform(image, lines, reduction, window, std_dev_threshold,
+                                presence_threshold, outline);
+   else
+      Hough_transform(image, lines, reduction, window, std_dev_threshold,
+                      presence_threshold, outline, directions);
+   cout.rdbuf(console);
+   Swap_Image(image, lines);
+}
+
+void Run_Reference_Hough(bmpBITMAP_FILE &image) {
+   Run_Hough(image, 20, 46, 0, 5, 0, 16, true);
+}
+
+void Run_Hough_Table(bmpBITMAP_FILE &image) {
+   Run_Hough(image, 20, 46, 0, 5, 0, 16, false);
+}
+
+void Run_Reference_Hough_Outline(bmpBITMAP_FILE &image) {
+   Run_Hough(image, 10, 50, 4, 4, 1, 16, true);
+}
+
+void Run_Hough_Table_Outline(bmpBITMAP_FILE &image) {
+   Run_Hough(image, 10, 50, 4, 4, 1, 16, false);
+}
+
+// The overlapping windows written directly from their description: the
+// histogram of every window is counted over its own four cells, and each
+// line is followed while the windows around the pixels it reaches accept
+// its direction
+void Reference_Hough_Overlapping(bmpBITMAP_FILE &image, bmpBITMAP_FILE &final_edges,
+                                 int reduction, int window, int std_dev_threshold,
+                                 int presence_threshold, int outline, int directions) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   Hough_Direction table[HOUGH_MAX_DIRECTIONS];
+   int count = Hough_Direction_Table(directions, table);
+   int size = max(window / 2, 1);
+   int cell_rows = (height + size - 1) / size;
+   int cell_columns = (width + size - 1) / size;
+   vector<vector<unsigned int> > accepted(cell_rows, vector<unsigned int>(cell_columns, 0));
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         final_edges.image_ptr[i][j] = 255;
+      }
+   }
+
+   for (int r = 0; r < max(cell_rows - 1, 1); r++) {
+      for (int c = 0; c < max(cell_columns - 1, 1); c++) {
+         vector<long> histogram(count, 0);
+         int last_row = min(r + 1, cell_rows - 1);
+         int last_column = min(c + 1, cell_columns - 1);
+         unsigned int window_accepted = 0;
+
+         for (int y = r; y <= last_row; y++) {
+            for (int x = c; x <= last_column; x++) {
+               int top = y * size, bottom = min(top + size, height);
+               int left = x * size, right = min(left + size, width);
+
+               for (int a = top; a < bottom; a++) {
+                  for (int b = left; b < right; b++) {
+                     if (image.image_ptr[a][b] != 0)
+                        continue;
+
+                     for (int d = 0; d < count; d++) {
+                        if (a - top < table[d].min_rows)
+                           continue;
+
+                        // Stops short of the top row and outer columns of the cell
+                        for (int k = 1; ; k++) {
+                           int ay = a - k * table[d].dy;
+                           int bx = b + k * table[d].dx;
+
+                           if ((table[d].dx < 0 && bx <= left) ||
+                               (table[d].dx > 0 && bx >= right) ||
+                               (table[d].dy > 0 && ay <= top))
+                              break;
+                           histogram[d] += image.image_ptr[ay][bx] == 0;
+                        }
+                     }
+                  }
+               }
+            }
+         }
+
+         long average = 0, variance = 0, std_dev;
+         long strongest = histogram[0];
+
+         for (int d = 0; d < count; d++) {
+            average += histogram[d];
+            strongest = max(strongest, histogram[d]);
+         }
+         average /= count;
+         for (int d = 0; d < count; d++) {
+            variance += (histogram[d] - average) * (histogram[d] - average);
+         }
+         std_dev = sqrt(variance / count);
+
+         if (std_dev <= std_dev_threshold)
+            continue;
+
+         for (int d = 0; d < count; d++) {
+            if (histogram[d] > strongest - reduction)
+               window_accepted |= 1u << d;
+         }
+
+         for (int y = r; y <= last_row; y++) {
+            for (int x = c; x <= last_column; x++) {
+               accepted[y][x] |= window_accepted;
+            }
+         }
+
+         if (outline) {
+            int top = r * size, bottom = min((last_row + 1) * size, height) - 1;
+            int left = c * size, right = min((last_column + 1) * size, width) - 1;
+
+            for (int a = top; a <= bottom; a++) {
+               for (int b = left; b <= right; b++) {
+                  if (a == top || a == bottom || b == left || b == right)
+                     final_edges.image_ptr[a][b] = 0;
+               }
+            }
+         }
+      }
+   }
+
+   for (int a = 0; a < height; a++) {
+      for (int b = 0; b < width; b++) {
+         int r = a / size, c = b / size;
+
+         if (image.image_ptr[a][b] != 0)
+            continue;
+
+         for (int d = 0; d < count; d++) {
+            vector<pair<int, int> > line;
+            int presence = 0;
+
+            if (!(accepted[r][c] & (1u << d)))
+               continue;
+
+            for (int k = 1; ; k++) {
+               int y = a - k * table[d].dy;
+               int x = b + k * table[d].dx;
+
+               if (y < max(r - 1, 0) * size || x < max(c - 1, 0) * size ||
+                   x >= min((c + 2) * size, width) || !(accepted[y / size][x / size] & (1u << d)))
+                  break;
+
+               presence += image.image_ptr[y][x] == 0;
+               line.push_back(make_pair(y, x));
+            }
+
+            if (presence > presence_threshold) {
+               for (size_t p = 0; p < line.size(); p++) {
+                  final_edges.image_ptr[line[p].first][line[p].second] = 0;
+               }
+            }
+         }
+      }
+   }
+}
+
+void Run_Reference_Hough_Overlapping(bmpBITMAP_FILE &image) {
+   Image lines = Image::Same_Format(image);
+
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   Reference_Hough_Overlapping(image, lines, 20, 46, 0, 5, 1, 16);
+   Swap_Image(image, lines);
+}
+
+void Run_Hough_Overlapping(bmpBITMAP_FILE &image) {
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+   Hough_transform(image, 20, 46, 0, 5, 1, 16, HOUGH_OVERLAPPING);
+}
+
+// Smoothing, levels and edges, one stage after another
+void Run_Preprocess_Stages(bmpBITMAP_FILE &image) {
+   Average(image, 4);
+   Histogram_Equalization(image);
+   Change_Contrast(image, 2);
+   Kirsh_detect_egdes(image, 7, 550);
+}
+
+// The same stages on a view of the image, whose rows the stages must
+// write into rather than replace
+void Run_Preprocess_View(bmpBITMAP_FILE &image) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   Image_View view(image, 0, 0, width, height);
+
+   Run_Preprocess_Stages(view);
+}
+
+void Run_Preprocess_Tiles(bmpBITMAP_FILE &image) {
+   Image edges = Image::Same_Format(image);
+
+   Preprocess_Tiles(image, edges, 4, 2, 7, 550);
+   Swap_Image(image, edges);
+}
+
+// Tiles that are not a whole number of blocks, and far more of them
+void Run_Preprocess_Small_Tiles(bmpBITMAP_FILE &image) {
+   Image edges = Image::Same_Format(image);
+
+   Preprocess_Tiles(image, edges, 4, 2, 7, 550, 5);
+   Swap_Image(image, edges);
+}
+
+// The preprocessing chain of main, with the whole image in memory
+void Run_Preprocess_Chain(bmpBITMAP_FILE &image) {
+   Average(image, 4);
+   Histogram_Equalization(image);
+   Change_Contrast(image, 2);
+   Kirsh_detect_egdes(image, 7, 550);
+   Thin_Edges(image, THIN_ZHANG_SUEN);
+}
+
+// The same chain a band at a time, through an in-memory bitmap file,
+// which is compressed with RLE8 if rle is set
+void Stream_Through_Memory(bmpBITMAP_FILE &image, bool rle) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   stringstream in;
+   stringstream out;
+
+   if (rle) {
+      Write_RLE8_File(in, image);
+   }
+   else {
+      Bitmap_Writer writer(in, image);
+      for (int i = 0; i < height; i++) {
+         writer.Write_Row(image.image_ptr[i]);
+      }
+   }
+
+   Stream_Preprocess(in, out, 4, 2, 7, 550, THIN_ZHANG_SUEN);
+
+   Bitmap_Reader reader(out);
+   for (int i = 0; i < height; i++) {
+      reader.Read_Row(image.image_ptr[i]);
+   }
+}
+
+void Run_Stream_Preprocess(bmpBITMAP_FILE &image) {
+   Stream_Through_Memory(image, false);
+}
+
+void Run_Stream_RLE8(bmpBITMAP_FILE &image) {
+   Stream_Through_Memory(image, true);
+}
+
+// The same chain a band at a time from one file to another, each of the
+// type its name gives
+void Stream_Through_Files(bmpBITMAP_FILE &image, const char *in_file_name,
+                          const char *out_file_name) {
+   Save_Bitmap_File(image, in_file_name);
+   Stream_Preprocess(in_file_name, out_file_name, 4, 2, 7, 550, THIN_ZHANG_SUEN);
+
+   Image result(out_file_name);
+   remove(in_file_name);
+   remove(out_file_name);
+
+   Copy_Pixels(result, image);
+}
+
+// Rows read from the top down and written from the bottom up
+void Run_Stream_PGM_To_RLE8(bmpBITMAP_FILE &image) {
+   Stream_Through_Files(image, "build/stream_in.pgm", "build/stream_out.rle");
+}
+
+// Rows read from the bottom up and written from the top down
+void Run_Stream_BMP_To_PGM(bmpBITMAP_FILE &image) {
+   Stream_Through_Files(image, "build/stream_in.bmp", "build/stream_out.pgm");
+}
+
+// The same chain through Run_Batch. The image is saved to a file and
+// processed three times, with room for one frame in each queue, so the
+// loader and writer have to wait for the stages. A job for a file that
+// is not there and one for a file that is not an image sit between them,
+// and must be skipped. The result is the first output that differs from
+// the others, if any does, and the image is left alone if a bad job was
+// not skipped.
+void Run_Batch_Files(bmpBITMAP_FILE &image) {
+   const int JOBS = 3;
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<Batch_Job> jobs;
+   Image results[JOBS];
+
+   Save_Bitmap_File(image, "build/batch_in.bmp");
+
+   for (int k = 0; k < JOBS; k++) {
+      Batch_Job job;
+
+      job.in_file_name  = "build/batch_in.bmp";
+      job.out_file_name = "build/batch_out" + to_string(k) + ".bmp";
+      jobs.push_back(job);
+   }
+
+   Batch_Job missing;
+   Batch_Job not_an_image;
+
+   missing.in_file_name       = "build/batch_missing.bmp";
+   missing.out_file_name      = "build/batch_skipped.bmp";
+   not_an_image.in_file_name  = "tests/regression.cpp";
+   not_an_image.out_file_name = "build/batch_skipped.bmp";
+   jobs.insert(jobs.begin() + 1, missing);
+   jobs.insert(jobs.begin() + 2, not_an_image);
+
+   Run_Batch(jobs, [](Frame_Buffers &frames) {
+      Preprocess_Tiles(frames, 4, 2, 7, 550);
+      Thin_Edges(frames.Front(), THIN_ZHANG_SUEN);
+   }, 1);
+
+   jobs.erase(jobs.begin() + 1, jobs.begin() + 3);
+
+   if (ifstream("build/batch_skipped.bmp")) {
+      remove("build/batch_skipped.bmp");
+      for (int k = 0; k < JOBS; k++) {
+         remove(jobs[k].out_file_name.c_str());
+      }
+      remove("build/batch_in.bmp");
+      return;
+   }
+
+   int chosen = 0;
+
+   for (int k = 0; k < JOBS; k++) {
+      results[k] = Image(jobs[k].out_file_name.c_str());
+      remove(jobs[k].out_file_name.c_str());
+
+      for (int i = 0; i < height && chosen == 0; i++) {
+         if (memcmp(results[k][i], results[0][i], width) != 0)
+            chosen = k;
+      }
+   }
+   remove("build/batch_in.bmp");
+
+   Copy_Pixels(results[chosen], image);
+}
+
+// Draws what Detect found onto a white image, the border of each box and
+// the ends of each line, clipped to the image
+void Draw_Detections(const Detection_Result &result, bmpBITMAP_FILE &image) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = 0; i < height; i++) {
+      memset(image.image_ptr[i], WHITE, width);
+   }
+
+   for (size_t b = 0; b < result.boxes.size(); b++) {
+      const Component &box = result.boxes[b];
+
+      for (int j = box.left; j <= box.right; j++) {
+         image.image_ptr[box.top][j] = image.image_ptr[box.bottom][j] = BLACK;
+      }
+      for (int i = box.top; i <= box.bottom; i++) {
+         image.image_ptr[i][box.left] = image.image_ptr[i][box.right] = BLACK;
+      }
+   }
+
+   for (size_t l = 0; l < result.lines.size(); l++) {
+      const hough_line_t &line = result.lines[l];
+      pair<int, int> ends[2] = {line.first, line.second};
+
+      for (int e = 0; e < 2; e++) {
+         int x = min(max(ends[e].first, 0), width - 1);
+         int y = min(max(ends[e].second, 0), height - 1);
+
+         image.image_ptr[y][x] = BLACK;
+      }
+   }
+}
+
+// Detect, called directly
+void Run_Detect(bmpBITMAP_FILE &image) {
+   Frame_Buffers frames;
+   Detection_Request request;
+   Detection_Result result;
+
+   frames.Load(image);
+   Detect(frames, request, result);
+   Draw_Detections(result, image);
+}
+
+// Reads a reply of the server back into a Detection_Result
+void Parse_Reply(const string &reply, Detection_Result &result) {
+   istringstream lines(reply);
+   string word;
+
+   while (lines >> word) {
+      if (word == "BOX") {
+         Component box;
+
+         lines >> box.top >> box.left >> box.bottom >> box.right >> box.pixels;
+         result.boxes.push_back(box);
+      }
+      else if (word == "LINE") {
+         hough_line_t line;
+
+         lines >> line.first.first >> line.first.second >> line.second.first >> line.second.second;
+         result.lines.push_back(line);
+      }
+   }
+}
+
+// Sends one request line and returns the reply, up to its END line
+string Ask_Server(int connection, const string &request) {
+   string reply;
+   char c;
+
+   send(connection, request.data(), request.size(), MSG_NOSIGNAL);
+
+   while (recv(connection, &c, 1, 0) == 1) {
+      reply += c;
+      if (c == '\n' && (reply.compare(0, 6, "ERROR ") == 0 ||
+                        (reply.size() >= 4 && reply.compare(reply.size() - 4, 4, "END\n") == 0)))
+         break;
+   }
+
+   return reply;
+}
+
+// Saves image to file_name with a header that gives it width by height
+// pixels, whatever the rows that follow hold
+void Save_Oversized_Bitmap(bmpBITMAP_FILE &image, const char *file_name, int width, int height) {
+   const int sizes[2] = {width, height};
+   fstream file;
+
+   Save_Bitmap_File(image, file_name);
+   file.open(file_name, ios::in | ios::out | ios::binary);
+   file.seekp(18); // biWidth, then biHeight
+
+   for (int s = 0; s < 2; s++) {
+      for (int b = 0; b < 4; b++) {
+         file.put((char) ((unsigned) sizes[s] >> (8 * b)));
+      }
+   }
+}
+
+// Sends requests the server must refuse, and carry on after: a file that
+// is not an image, a bitmap cut short, bitmaps whose headers give more
+// rows than they hold or more pixels than MAX_IMAGE_PIXELS, parameters
+// that are not numbers or are out of range, and a line far too long.
+// Returns true if every reply is an ERROR.
+bool Refuses_Bad_Requests(int connection, bmpBITMAP_FILE &image) {
+   const char NOT_AN_IMAGE[] = "build/server_bad.bmp";
+   const char CUT_SHORT[]    = "build/server_short.bmp";
+   const char MISSING_ROWS[] = "build/server_missing_rows.bmp";
+   const char TOO_LARGE[]    = "build/server_too_large.bmp";
+   vector<string> requests;
+   bool refused = true;
+
+   ofstream(NOT_AN_IMAGE) << "not a bitmap\n";
+   Save_Bitmap_File(image, CUT_SHORT);
+   if (truncate(CUT_SHORT, 5000) != 0) {
+      cerr << "Error: cannot cut " << CUT_SHORT << " short\n";
+      exit(1);
+   }
+   Save_Oversized_Bitmap(image, MISSING_ROWS, 1 << 14, 1 << 14);
+   Save_Oversized_Bitmap(image, TOO_LARGE, 1 << 30, 1 << 30);
+
+   requests.push_back(string("FILE ") + NOT_AN_IMAGE + "\n");
+   requests.push_back(string("FILE ") + CUT_SHORT + "\n");
+   requests.push_back(string("FILE ") + MISSING_ROWS + "\n");
+   requests.push_back(string("FILE ") + TOO_LARGE + "\n");
+   requests.push_back(string("FILE ") + CUT_SHORT + " average=0\n");
+   requests.push_back(string("FILE ") + CUT_SHORT + " contrast=-1\n");
+   requests.push_back(string("FILE ") + CUT_SHORT + " edges=12x\n");
+   requests.push_back(string("FILE ") + CUT_SHORT + " lines=99999999999999999999\n");
+   requests.push_back(string("FILE ") + string(10000, 'x') + "\n");
+
+   for (size_t r = 0; r < requests.size(); r++) {
+      if (Ask_Server(connection, requests[r]).compare(0, 6, "ERROR ") != 0)
+         refused = false;
+   }
+
+   remove(NOT_AN_IMAGE);
+   remove(CUT_SHORT);
+   remove(MISSING_ROWS);
+   remove(TOO_LARGE);
+   return refused;
+}
+
+// Connects to the server listening at address, which may not be
+// listening yet
+int Connect_To_Server(const struct sockaddr_un &address) {
+   int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   while (connect(connection, (const struct sockaddr *) &address, sizeof(address)) != 0) {
+      this_thread::sleep_for(chrono::milliseconds(10));
+   }
+
+   return connection;
+}
+
+// Starts a server with two workers, sends it request over one connection
+// and then a second time over another, and shuts it down. The first
+// connection starts with requests the server must refuse. The second
+// reply must come from the result cache, which STATS shows as one result
+// and one hit. A client that sends nothing stays connected throughout,
+// and SHUTDOWN must close its connection. If a reply differs from the
+// first, or a bad request was not refused, or the cache was not used, or
+// the idle connection was left open, nothing is drawn.
+void Through_Server(bmpBITMAP_FILE &image, const string &request) {
+   const char SOCKET_PATH[] = "build/regression.sock";
+   struct sockaddr_un address;
+   string replies[2];
+   string stats;
+   bool refused = false;
+   char c;
+
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strcpy(address.sun_path, SOCKET_PATH);
+   unlink(SOCKET_PATH);
+
+   thread server(Run_Server, SOCKET_PATH, 2, (const char *) 0);
+   int idle = Connect_To_Server(address);
+
+   for (int k = 0; k < 3; k++) {
+      int connection = Connect_To_Server(address);
+
+      if (k == 0)
+         refused = Refuses_Bad_Requests(connection, image);
+      if (k < 2)
+         replies[k] = Ask_Server(connection, request);
+      if (k == 1)
+         stats = Ask_Server(connection, "STATS\n");
+      if (k == 2)
+         Ask_Server(connection, "SHUTDOWN\n");
+      close(connection);
+   }
+
+   server.join();
+
+   bool idle_closed = recv(idle, &c, 1, 0) == 0;
+
+   close(idle);
+
+   Detection_Result result;
+
+   if (refused && idle_closed && replies[1] == replies[0] && stats == "STATS 1 1\nEND\n")
+      Parse_Reply(replies[0], result);
+   Draw_Detections(result, image);
+}
+
+void Run_Server_File(bmpBITMAP_FILE &image) {
+   Save_Bitmap_File(image, "build/server_in.bmp");
+   Through_Server(image, "FILE build/server_in.bmp\n");
+   remove("build/server_in.bmp");
+}
+
+// The frame in a shared memory object, the top row first
+void Run_Server_Shared_Memory(bmpBITMAP_FILE &image) {
+   const char NAME[] = "/vision_regression";
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   size_t size = (size_t)width * height;
+   int object = shm_open(NAME, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+   if (object < 0 || ftruncate(object, size) != 0) {
+      cerr << "Error: cannot create " << NAME << "\n";
+      exit(1);
+   }
+
+   byte_t *pixels = (byte_t *) mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, object, 0);
+
+   close(object);
+   for (int i = 0; i < height; i++) {
+      memcpy(pixels + (size_t)(height - 1 - i) * width, image.image_ptr[i], width);
+   }
+   munmap(pixels, size);
+
+   Through_Server(image, string("SHM ") + NAME + " " + to_string(width) + "x" + to_string(height) + "\n");
+   shm_unlink(NAME);
+}
+
+// The frame written three times to a ring of two slots by a writer
+// thread, so the writer has to wait for the reader. The result is the
+// first that differs from the others, if any does.
+void Run_Frame_Ring(bmpBITMAP_FILE &image) {
+   const char NAME[] = "/vision_regression_ring";
+   const int FRAMES = 3;
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   vector<Detection_Result> results;
+
+   Frame_Ring ring(NAME, width, height, 2);
+   Frame_Ring reader(NAME);
+
+   ring.Unlink();
+
+   thread writer([&]() {
+      for (int k = 0; k < FRAMES; k++) {
+         byte_t *slot;
+
+         while ((slot = ring.Begin_Write()) == 0) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+         }
+         for (int i = 0; i < height; i++) {
+            memcpy(slot + (size_t)(height - 1 - i) * width, image.image_ptr[i], width);
+         }
+         ring.End_Write();
+      }
+      ring.Close();
+   });
+
+   Consume_Frame_Ring(reader, Detection_Request(), [&results](const Detection_Result &result) {
+      results.push_back(result);
+   });
+   writer.join();
+
+   // A frame that went missing leaves nothing drawn
+   if (results.size() != FRAMES)
+      results.assign(1, Detection_Result());
+
+   size_t chosen = 0;
+
+   for (size_t k = 0; k < results.size() && chosen == 0; k++) {
+      if (Format_Result(results[k]) != Format_Result(results[0]))
+         chosen = k;
+   }
+
+   Draw_Detections(results[chosen], image);
+}
+
+// The lines of a text file
+size_t Count_Lines(const char *file_name) {
+   ifstream in(file_name);
+   string line;
+   size_t count = 0;
+
+   while (getline(in, line)) {
+      count++;
+   }
+
+   return count;
+}
+
+// Puts key with other parameters, and so other results, in a cache of
+// two with an index file, after lines that must be skipped: one with
+// counts far larger than it holds, one with no boxes, and one cut short.
+// The file must never pass twice the capacity, and reading it back must
+// keep the last two results. Returns true if it does.
+bool Index_Stays_Small(const char *index_file_name, Result_Key key, const Detection_Result &result) {
+   const size_t CAPACITY = 2;
+   bool small = true;
+
+   {
+      ofstream out(index_file_name, ios::out | ios::trunc);
+
+      out << "1 640 480 4 2 7 550 60 31 170 4000000000000 0\n";
+      out << "2 640 480 4 2 7 550 60 31 170 5 0\n";
+      out << "3 640 480 4 2 7\n";
+   }
+
+   {
+      Result_Cache cache(CAPACITY, index_file_name);
+
+      small = cache.Size() == 0 && Count_Lines(index_file_name) == 0;
+
+      for (int k = 0; k < 5; k++) {
+         key.parameters[6] = k;
+         cache.Insert(key, result);
+         small = small && Count_Lines(index_file_name) < 2 * CAPACITY;
+      }
+   }
+
+   Result_Cache reloaded(CAPACITY, index_file_name);
+   Detection_Result found;
+
+   key.parameters[6] = 4;
+   small = small && reloaded.Size() == CAPACITY && reloaded.Find(key, found);
+   key.parameters[6] = 2;
+   small = small && !reloaded.Find(key, found);
+
+   return small && Count_Lines(index_file_name) == CAPACITY;
+}
+
+// A result put in a cache with an index file, and found again by a
+// second cache that reads the file. A key with other parameters must not
+// be found.
+void Run_Result_Cache(bmpBITMAP_FILE &image) {
+   const char INDEX_FILE[] = "build/regression.cache";
+   Detection_Request request;
+   Detection_Result result;
+
+   remove(INDEX_FILE);
+
+   {
+      Result_Cache cache(RESULT_CACHE_ENTRIES, INDEX_FILE);
+      Frame_Buffers frames;
+
+      frames.Load(image);
+      Result_Key key = Make_Result_Key(frames.Front(), request);
+
+      Detect(frames, request, result);
+      cache.Insert(key, result);
+   }
+
+   Result_Cache reloaded(RESULT_CACHE_ENTRIES, INDEX_FILE);
+   Detection_Request other;
+   Detection_Result found;
+
+   other.line_threshold++;
+
+   if (!reloaded.Find(Make_Result_Key(image, request), found) ||
+       reloaded.Find(Make_Result_Key(image, other), result) || reloaded.Hits() != 1 ||
+       !Index_Stays_Small(INDEX_FILE, Make_Result_Key(image, request), found))
+      found = Detection_Result();
+
+   remove(INDEX_FILE);
+   Draw_Detections(found, image);
+}
+
+// Colours of a level of grey, as blue, green, red
+void Grey_Colour(byte_t level, byte_t bgr[3]) {
+   bgr[0] = bgr[1] = bgr[2] = level;
+}
+
+void Tinted_Colour(byte_t level, byte_t bgr[3]) {
+   bgr[0] = level;
+   bgr[1] = 255 - level;
+   bgr[2] = level / 2;
+}
+
+/*-----------------------------------------------------------
+   Load_Converted
+
+   INPUTS
+   image       - Image to save and load back
+   bits        - 8, 24 or 32 bits per pixel
+   top_down    - Store the rows from the top of the picture down
+   header_size - Size of the info header, 40 or more
+   colour      - Colour each level of grey is saved as
+
+   DESCRIPTION
+   Saves image to a file in a layout other than the one the program
+   writes, then loads it over image with Load_Bitmap_File. At 8 bits
+   the palette is reversed, so each pixel is saved as 255 minus its
+   level.
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Load_Converted(bmpBITMAP_FILE &image, int bits, bool top_down, int header_size,
+                    void (*colour)(byte_t level, byte_t bgr[3])) {
+   const char *file_name = "build/load_test.bmp";
+   int height  = Assemble_Integer(image.info_header.biHeight);
+   int width   = Assemble_Integer(image.info_header.biWidth);
+   int stride  = (width * bits + 31) / 32 * 4;
+   int palette = bits == 8 ? 1024 : 0;
+   vector<byte_t> header(14 + header_size + palette, 0);
+   vector<byte_t> row(stride, 0);
+   ofstream out(file_name, ios::out | ios::binary);
+
+   header[0] = 'B';
+   header[1] = 'M';
+   Disassemble_Integer(header.size() + (size_t)stride * height, &header[2]);
+   Disassemble_Integer(header.size(), &header[10]);
+   Disassemble_Integer(header_size, &header[14]);
+   Disassemble_Integer(width, &header[18]);
+   Disassemble_Integer(top_down ? -height : height, &header[22]);
+   header[26] = 1;
+   header[28] = bits;
+
+   for (int c = 0; c < palette / 4; c++) {
+      colour(255 - c, &header[14 + header_size + 4*c]);
+   }
+   out.write((const char *) header.data(), header.size());
+
+   for (int r = 0; r < height; r++) {
+      byte_t *levels = image.image_ptr[top_down ? height - 1 - r : r];
+
+      for (int j = 0; j < width; j++) {
+         if (bits == 8)
+            row[j] = 255 - levels[j];
+         else
+            colour(levels[j], &row[j * bits / 8]);
+      }
+      out.write((const char *) row.data(), stride);
+   }
+   out.close();
+
+   Image loaded(file_name);
+   remove(file_name);
+
+   Copy_Pixels(loaded, image);
+}
+
+void Load_24_Bit(bmpBITMAP_FILE &image) {
+   Load_Converted(image, 24, false, 40, Grey_Colour);
+}
+
+void Load_32_Bit_Top_Down(bmpBITMAP_FILE &image) {
+   Load_Converted(image, 32, true, 40, Grey_Colour);
+}
+
+// A version 5 info header and a palette that is not in order
+void Load_Reversed_Palette(bmpBITMAP_FILE &image) {
+   Load_Converted(image, 8, false, 124, Grey_Colour);
+}
+
+// The luminance of Tinted_Colour
+void Tinted_Luminance(bmpBITMAP_FILE &image) {
+   int height = Assemble_Integer(image.info_header.biHeight);
+   int width  = Assemble_Integer(image.info_header.biWidth);
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         byte_t bgr[3];
+
+         Tinted_Colour(image.image_ptr[i][j], bgr);
+         image.image_ptr[i][j] = (29 * bgr[0] + 150 * bgr[1] + 77 * bgr[2] + 128) / 256;
+      }
+   }
+}
+
+void Load_Tinted_24_Bit(bmpBITMAP_FILE &image) {
+   Load_Converted(image, 24, false, 40, Tinted_Colour);
+}
+
+void Load_Tinted_32_Bit(bmpBITMAP_FILE &image) {
+   Load_Converted(image, 32, true, 108, Tinted_Colour);
+}
+
+// Saves image to the named file and loads it back, by way of the format
+// the name gives
+void Save_And_Load(bmpBITMAP_FILE &image, const char *file_name) {
+   Save_Bitmap_File(image, file_name);
+
+   Image loaded(file_name);
+   remove(file_name);
+
+   Copy_Pixels(loaded, image);
+}
+
+void Load_PGM(bmpBITMAP_FILE &image) {
+   Save_And_Load(image, "build/load_test.pgm");
+}
+
+void Load_Raw(bmpBITMAP_FILE &image) {
+   Save_And_Load(image, "build/load_test.1024x768.raw");
+}
+
+void Load_RLE8(bmpBITMAP_FILE &image) {
+   Save_And_Load(image, "build/load_test.rle");
+}
+
+// Encodes image into memory and decodes it back
+void Through_Memory(bmpBITMAP_FILE &image, Image_File_Type type) {
+   vector<byte_t> data;
+   Image decoded;
+
+   Encode_Image(image, data, type);
+   Decode_Image(data.data(), data.size(), decoded, type);
+
+   Copy_Pixels(decoded, image);
+}
+
+void Load_Memory(bmpBITMAP_FILE &image) {
+   Through_Memory(image, FILE_BMP);
+}
+
+void Load_Memory_RLE8(bmpBITMAP_FILE &image) {
+   Through_Memory(image, FILE_RLE);
+}
+
+// Writes image to a stream twice, as a pipe would carry two frames, and
+// reads them back. There must be nothing after the second.
+void Through_Pipe(bmpBITMAP_FILE &image, Image_File_Type type) {
+   int width  = Assemble_Integer(image.info_header.biWidth);
+   int height = Assemble_Integer(image.info_header.biHeight);
+   stringstream pipe;
+   Image first;
+   Image second;
+   Image extra;
+
+   Write_Image(pipe, image, type);
+   Write_Image(pipe, image, type);
+
+   Read_Image(pipe, first, type, width, height);
+   Read_Image(pipe, second, type, width, height);
+
+   if (Read_Image(pipe, extra, type, width, height)) {
+      image.image_ptr[0][0] ^= 1;
+      return;
+   }
+
+   Copy_Pixels(first, image);
+   Copy_Pixels(second, image);
+}
+
+void Load_Piped(bmpBITMAP_FILE &image) {
+   Through_Pipe(image, FILE_BMP);
+}
+
+void Load_Piped_PGM(bmpBITMAP_FILE &image) {
+   Through_Pipe(image, FILE_PGM);
+}
+
+void Load_Piped_Raw(bmpBITMAP_FILE &image) {
+   Through_Pipe(image, FILE_RAW);
+}
+
+void Run_Unchanged(bmpBITMAP_FILE &) {
+}
+
+void Add_Backend(Regression_Stage &stage, const char *name,
+                 void (*run)(bmpBITMAP_FILE &image)) {
+   Stage_Backend backend;
+
+   backend.name = name;
+   backend.run  = run;
+   stage.backends.push_back(backend);
+}
+
+/*-----------------------------------------------------------
+   Build_Stages
+
+   INPUTS
+   stages - Vector to fill with the stages under test
+
+   DESCRIPTION
+   Registers the stages, their golden output and their backends.
+   Optimized backends are appended after the reference so they are
+   checked against it.
+
+   RETURNS
+   Nothing
+------------------------------------------------------------*/
+void Build_Stages(vector<Regression_Stage> &stages) {
+   Regression_Stage stage;
+
+   stage.name       = "Load";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Unchanged);
+   Add_Backend(stage, "24 bit", Load_24_Bit);
+   Add_Backend(stage, "32 bit top down", Load_32_Bit_Top_Down);
+   Add_Backend(stage, "reversed palette", Load_Reversed_Palette);
+   Add_Backend(stage, "pgm", Load_PGM);
+   Add_Backend(stage, "raw", Load_Raw);
+   Add_Backend(stage, "rle8", Load_RLE8);
+   Add_Backend(stage, "memory", Load_Memory);
+   Add_Backend(stage, "memory rle8", Load_Memory_RLE8);
+   Add_Backend(stage, "piped", Load_Piped);
+   Add_Backend(stage, "piped pgm", Load_Piped_PGM);
+   Add_Backend(stage, "piped raw", Load_Piped_Raw);
+   stages.push_back(stage);
+
+   stage.name       = "Colour";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Tinted_Luminance);
+   Add_Backend(stage, "24 bit", Load_Tinted_24_Bit);
+   Add_Backend(stage, "32 bit", Load_Tinted_32_Bit);
+   stages.push_back(stage);
+
+   stage.name       = "Histogram Equalization";
+   stage.golden_dir = "tests/Histogram Equalization";
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Histogram_Equalization);
+   stages.push_back(stage);
+
+   stage.name       = "Contrast";
+   stage.golden_dir = "tests/Contrast";
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Change_Contrast);
+   stages.push_back(stage);
+
+   stage.name       = "Box Blur 3";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Box_Blur_3);
+   Add_Backend(stage, "running sums", Run_Box_Blur_3);
+   stages.push_back(stage);
+
+   stage.name       = "Box Blur 12";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Box_Blur_12);
+   Add_Backend(stage, "running sums", Run_Box_Blur_12);
+   stages.push_back(stage);
+
+   stage.name       = "Gaussian 1.5";
+   stage.golden_dir = 0;
+   stage.tolerance  = 1;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Gaussian_1_5);
+   Add_Backend(stage, "fixed point", Run_Gaussian_Kernel_1_5);
+   stages.push_back(stage);
+
+   stage.name       = "Gaussian 6";
+   stage.golden_dir = 0;
+   stage.tolerance  = 8;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Gaussian_6);
+   Add_Backend(stage, "recursive", Run_Gaussian_Recursive_6);
+   stages.push_back(stage);
+
+   stage.name       = "Median 1";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Median_1);
+   Add_Backend(stage, "network", Run_Median_Network_1);
+   Add_Backend(stage, "histogram", Run_Median_Histogram_1);
+   stages.push_back(stage);
+
+   stage.name       = "Median 2";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Median_2);
+   Add_Backend(stage, "network", Run_Median_Network_2);
+   Add_Backend(stage, "histogram", Run_Median_Histogram_2);
+   stages.push_back(stage);
+
+   stage.name       = "Median 5";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Median_5);
+   Add_Backend(stage, "histogram", Run_Median_Frames_5);
+   stages.push_back(stage);
+
+   stage.name       = "Kirsch";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Kirsh);
+   Add_Backend(stage, "ping-pong", Run_Kirsh_Frames);
+   stages.push_back(stage);
+
+   stage.name       = "Zhang-Suen";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Zhang_Suen);
+   Add_Backend(stage, "threaded", Run_Zhang_Suen);
+   stages.push_back(stage);
+
+   stage.name       = "Magic eraser";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Magic_eraser);
+   Add_Backend(stage, "union-find", Run_Magic_eraser);
+   Add_Backend(stage, "runs", Run_Magic_eraser_Runs);
+   stages.push_back(stage);
+
+   stage.name       = "dustin Hough";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_dustin_Hough);
+   Add_Backend(stage, "runs", Run_dustin_Hough_Runs);
+   stages.push_back(stage);
+
+   stage.name       = "Hough 20/46";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Hough);
+   Add_Backend(stage, "table", Run_Hough_Table);
+   stages.push_back(stage);
+
+   stage.name       = "Hough 10/50 outline";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Hough_Outline);
+   Add_Backend(stage, "table", Run_Hough_Table_Outline);
+   stages.push_back(stage);
+
+   stage.name       = "Hough overlapping";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Hough_Overlapping);
+   Add_Backend(stage, "shared cells", Run_Hough_Overlapping);
+   stages.push_back(stage);
+
+   stage.name       = "Preprocess";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Preprocess_Stages);
+   Add_Backend(stage, "view", Run_Preprocess_View);
+   Add_Backend(stage, "tiles", Run_Preprocess_Tiles);
+   Add_Backend(stage, "small tiles", Run_Preprocess_Small_Tiles);
+   stages.push_back(stage);
+
+   stage.name       = "Stream";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Preprocess_Chain);
+   Add_Backend(stage, "bands", Run_Stream_Preprocess);
+   Add_Backend(stage, "rle8 bands", Run_Stream_RLE8);
+   Add_Backend(stage, "pgm to rle8 files", Run_Stream_PGM_To_RLE8);
+   Add_Backend(stage, "bmp to pgm files", Run_Stream_BMP_To_PGM);
+   Add_Backend(stage, "batch", Run_Batch_Files);
+   stages.push_back(stage);
+
+   stage.name       = "Server";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Detect);
+   Add_Backend(stage, "file", Run_Server_File);
+   Add_Backend(stage, "shared memory", Run_Server_Shared_Memory);
+   Add_Backend(stage, "ring", Run_Frame_Ring);
+   Add_Backend(stage, "cache", Run_Result_Cache);
+   stages.push_back(stage);
+
+   stage.name       = "Canny";
+   stage.golden_dir = 0;
+   stage.tolerance  = 0;
+   stage.backends.clear();
+   Add_Backend(stage, "reference", Run_Reference_Canny);
+   Add_Backend(stage, "stack", Run_Canny_Frames);
+   Add_Backend(stage, "runs", Run_Canny_Runs);
+   stages.push_back(stage);
+}
+
+/*-----------------------------------------------------------
+   Compare_Images
+
+   INPUTS
+   actual    - Image produced by the stage
+   expected  - Image it should match
+   tolerance - Largest difference that still counts as a match
+
+   DESCRIPTION
+   Compares the two images pixel-for-pixel.
+
+   RETURNS
+   A summary of the differences. Images of different sizes are
+   reported as entirely mismatched.
+------------------------------------------------------------*/
+Diff_Summary Compare_Images(bmpBITMAP_FILE &actual, bmpBITMAP_FILE &expected, int tolerance) {
+   Diff_Summary diff;
+   int height = Assemble_Integer(actual.info_header.biHeight);
+   int width  = Assemble_Integer(actual.info_header.biWidth);
+
+   diff.mismatches = 0;
+   diff.pixels     = (long)height * width;
+   diff.max_diff   = 0;
+   diff.first_row  = diff.first_col = -1;
+   diff.min_row    = diff.min_col   = -1;
+   diff.max_row    = diff.max_col   = -1;
+
+   if (height != Assemble_Integer(expected.info_header.biHeight) ||
+       width  != Assemble_Integer(expected.info_header.biWidth)) {
+      diff.mismatches = diff.pixels;
+      diff.max_diff   = 255;
+      return diff;
+   }
+
+   for (int i = 0; i < height; i++) {
+      for (int j = 0; j < width; j++) {
+         int delta = abs(int(actual.image_ptr[i][j]) - int(expected.image_ptr[i][j]));
+
+         if (delta <= tolerance)
+            continue;
+
+         if (diff.mismatches == 0) {
+            diff.first_row = diff.min_row = diff.max_row = i;
+            diff.first_col = diff.min_col = diff.max_col = j;
+         }
+
+         diff.mismatches++;
+         diff.max_diff = max(diff.max_diff, delta);
+         diff.min_row  = min(diff.min_row, i);
+         diff.max_row  = max(diff.max_row, i);
+         diff.min_col  = min(diff.min_col, j);
+         diff.max_col  = max(diff.max_col, j);
+      }
+   }
+
+   return diff;
+}
+
+/*-----------------------------------------------------------
+   Report
+
+   INPUTS
+   label - Description of the comparison
+   diff  - Result of Compare_Images
+
+   DESCRIPTION
+   Prints a one line result, followed by a diff summary on failure.
+
+   RETURNS
+   true if the images matched
+------------------------------------------------------------*/
+bool Report(const string &label, Diff_Summary &diff) {
+
+   if (diff.mismatches == 0) {
+      cout << "PASS " << label << endl;
+      return true;
+   }
+
+   cout << "FAIL " << label << endl;
+   cout << "     " << diff.mismatches << " of " << diff.pixels << " pixels differ ("
+        << fixed << setprecision(3) << 100.0 * diff.mismatches / diff.pixels << "%)"
+        << ", max difference " << diff.max_diff << endl;
+
+   if (diff.first_row >= 0) {
+      cout << "     first at row " << diff.first_row << " col " << diff.first_col
+           << ", differences within rows " << diff.min_row << "-" << diff.max_row
+           << " cols " << diff.min_col << "-" << diff.max_col << endl;
+   }
+
+   return false;
+}
+
+bool Selected(const Regression_Stage &stage, int argc, char *argv[]) {
+   if (argc < 2)
+      return true;
+
+   for (int i = 1; i < argc; i++) {
+      if (stage.name == string(argv[i]))
+         return true;
+   }
+   return false;
+}
+
+int main(int argc, char *argv[]) {
+   vector<Regression_Stage> stages;
+   int failures = 0;
+   int checks = 0;
+   char file_name[256];
+
+   Build_Stages(stages);
+
+   for (int k = 1; k <= INPUT_COUNT; k++) {
+      bmpBITMAP_FILE input;
+
+      sprintf(file_name, "images/im%d.bmp", k);
+      Load_Bitmap_File(input, file_name);
+
+      for (size_t s = 0; s < stages.size(); s++) {
+         Regression_Stage &stage = stages[s];
+         bmpBITMAP_FILE reference;
+
+         if (!Selected(stage, argc, argv))
+            continue;
+
+         Copy_Image(input, reference);
+         stage.backends[0].run(reference);
+
+         if (stage.golden_dir) {
+            bmpBITMAP_FILE golden;
+            Diff_Summary diff;
+
+            sprintf(file_name, "%s/test%d.bmp", stage.golden_dir, k);
+            Load_Bitmap_File(golden, file_name);
+
+            diff = Compare_Images(reference, golden, 0);
+            checks++;
+            if (!Report(string(stage.name) + " [" + stage.backends[0].name + "] im" +
+                        to_string(k) + " vs golden", diff))
+               failures++;
+
+            Remove_Image(golden);
+         }
+
+         for (size_t b = 1; b < stage.backends.size(); b++) {
+            bmpBITMAP_FILE result;
+            Diff_Summary diff;
+
+            Copy_Image(input, result);
+            stage.backends[b].run(result);
+
+            diff = Compare_Images(result, reference, stage.tolerance);
+            checks++;
+            if (!Report(string(stage.name) + " [" + stage.backends[b].name + "] im" +
+                        to_string(k) + " vs reference", diff))
+               failures++;
+
+            Remove_Image(result);
+         }
+
+         Remove_Image(reference);
+      }
+
+      Remove_Image(input);
+   }
+
+   cout << endl << checks - failures << " of " << checks << " checks passed" << endl;
+
+   return failures == 0 ? 0 : 1;
+}
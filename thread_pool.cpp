@@ -0,0 +1,126 @@
+// thread_pool.cpp
+// Contains the worker threads that stages split their work over.
+
+// Standard header files
+#include <algorithm>
+#include <utility>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+Thread_Pool::Thread_Pool(int threads) : stopping(false) {
+
+   if (threads <= 0)
+      threads = max((int)thread::hardware_concurrency() - 1, 1);
+
+   for (int t = 0; t < threads; t++) {
+      workers.push_back(thread(&Thread_Pool::Work, this));
+   }
+}
+
+Thread_Pool::~Thread_Pool() {
+   {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+   }
+   ready.notify_all();
+
+   for (size_t t = 0; t < workers.size(); t++) {
+      workers[t].join();
+   }
+}
+
+void Thread_Pool::Submit(function<void()> task) {
+   {
+      lock_guard<mutex> guard(lock);
+      tasks.push_back(std::move(task));
+   }
+   ready.notify_one();
+}
+
+// Runs tasks until the pool is destroyed. The tasks left in the queue
+// are run before the workers stop.
+void Thread_Pool::Work() {
+
+   while (true) {
+      function<void()> task;
+
+      {
+         unique_lock<mutex> guard(lock);
+
+         while (!stopping && tasks.empty()) {
+            ready.wait(guard);
+         }
+         if (tasks.empty())
+            return;
+
+         task = std::move(tasks.front());
+         tasks.pop_front();
+      }
+
+      task();
+   }
+}
+
+/*------------------------------------------------------------
+   Thread_Pool::Parallel_For
+
+   INPUTS
+   first, last - Range of elements, usually rows, to work on
+   body      - Called with the begin and end of each piece
+   min_chunk - Smallest piece worth handing to another thread
+
+   DESCRIPTION
+   Splits the range into one piece per worker plus one for the calling
+   thread, which does its piece while the workers do theirs.
+
+   RETURNS
+   Nothing, once every piece is done
+-------------------------------------------------------------*/
+void Thread_Pool::Parallel_For(int first, int last, const function<void(int, int)> &body,
+                               int min_chunk) {
+
+   int count = last - first;
+
+   if (count <= 0)
+      return;
+
+   int pieces = min(Size() + 1, max(count / max(min_chunk, 1), 1));
+
+   if (pieces == 1) {
+      body(first, last);
+      return;
+   }
+
+   mutex done_lock;
+   condition_variable done;
+   int remaining = pieces - 1;
+
+   for (int p = 1; p < pieces; p++) {
+      int begin = first + (long)count * p / pieces;
+      int end   = first + (long)count * (p + 1) / pieces;
+
+      Submit([&, begin, end]() {
+         body(begin, end);
+
+         lock_guard<mutex> guard(done_lock);
+         if (--remaining == 0)
+            done.notify_one();
+      });
+   }
+
+   body(first, first + count / pieces);
+
+   unique_lock<mutex> guard(done_lock);
+   while (remaining > 0) {
+      done.wait(guard);
+   }
+}
+
+// The pool shared by the stages, started on first use
+Thread_Pool &Shared_Thread_Pool() {
+   static Thread_Pool pool;
+
+   return pool;
+}
@@ -0,0 +1,63 @@
+// thread_pool.h
+// Declarations for the worker threads that stages split their work over.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*-----------------------------------------------------------
+   Thread_Pool
+
+   DESCRIPTION
+   A fixed set of worker threads that run queued tasks. Parallel_For()
+   splits a range of rows over the workers and the calling thread and
+   returns when all of them are done. Each thread has its own arena, see
+   Thread_Arena(), so the tasks may use it for their temporaries.
+
+   Parallel_For() waits for its tasks, so it must not be called from a
+   task of the same pool.
+------------------------------------------------------------*/
+class Thread_Pool {
+public:
+   // With no thread count, one worker per hardware thread besides the
+   // calling one
+   explicit Thread_Pool(int threads = 0);
+   ~Thread_Pool();
+
+   Thread_Pool(const Thread_Pool &) = delete;
+   Thread_Pool &operator=(const Thread_Pool &) = delete;
+
+   // Queues a task to run on one of the workers
+   void Submit(std::function<void()> task);
+
+   // Calls body(begin, end) on pieces of [first, last) of at least
+   // min_chunk elements, in parallel
+   void Parallel_For(int first, int last, const std::function<void(int, int)> &body,
+                     int min_chunk = 1);
+
+   // Number of worker threads
+   int Size() const { return workers.size(); }
+
+private:
+   void Work();
+
+   std::mutex lock;
+   std::condition_variable ready;
+   std::deque<std::function<void()> > tasks;
+   std::vector<std::thread> workers;
+   bool stopping;
+};
+
+// ----------------------------------------------------------
+// Function Declarations
+
+Thread_Pool &Shared_Thread_Pool();
+// ----------------------------------------------------------
+
+#endif